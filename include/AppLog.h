@@ -6,26 +6,34 @@
 #include <sstream>
 #include <string>
 #include <streambuf>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 using namespace std;
 
+class AppLog;
+
 class teebuf: public std::streambuf
 {
 public:
-    // Construct a streambuf which tees output to both input
-    // streambufs.
+    // Collects what one thread writes to one log level. Each flush
+    // (std::endl) hands the text so far to the AppLog as one record,
+    // which its writer thread tees to the log file and console.
     teebuf();
-    void connect(std::streambuf * sbuf1, std::streambuf * sbuf2);
-    void connect(std::streambuf * sbuf1);
+    void connect(AppLog * log, int level);
 private:
-    // This tee buffer has no buffer. So every character "overflows"
-    // and can be put directly into the teed buffers.
+    // Characters go into a small put area, only full chunks overflow
+    // into the record.
     virtual int overflow(int c);
 
-    // Sync both teed buffers.
+    // Publish the record.
     virtual int sync();
 private:
-    std::streambuf * sb1;
-    std::streambuf * sb2;
+    AppLog * log;
+    int level;
+    std::string record;
+    char chunk[256];
 };
 
 
@@ -33,11 +41,11 @@ private:
 class teestream : public std::ostream
 {
 public:
-    // Construct an ostream which tees output to the supplied
-    // ostreams.
+    // Construct an ostream which publishes records to the AppLog
+    // writer thread.
     teestream();
-    void connect(std::ostream & o1, std::ostream & o2);
-    void connect(std::ostream & o1);
+    ~teestream();
+    void connect(AppLog * log, int level);
 private:
     teebuf tbuf;
 };
@@ -49,35 +57,102 @@ private:
 #define APPLOG_INFO 2
 #define APPLOG_WARNING 3
 #define APPLOG_ERROR 4
+#define APPLOG_DEBUG 5
 
 #define LOGMASK_PRINT 1
 #define LOGMASK_INFO 2
 #define LOGMASK_WARNING 4
 #define LOGMASK_ERROR 8
+#define LOGMASK_DEBUG 16
 #define LOGMASK_ALL (LOGMASK_PRINT | LOGMASK_INFO | LOGMASK_WARNING | LOGMASK_ERROR)
 #define LOGMASK_NOINFO (LOGMASK_PRINT | LOGMASK_WARNING | LOGMASK_ERROR)
 
+// levels compiled in at all; DEBUG only in builds without NDEBUG
+#ifndef APPLOG_COMPILED_MASK
+#ifdef NDEBUG
+#define APPLOG_COMPILED_MASK LOGMASK_ALL
+#else
+#define APPLOG_COMPILED_MASK (LOGMASK_ALL | LOGMASK_DEBUG)
+#endif
+#endif
+
+// Filtering logging: nothing right of the macro is evaluated (no formatting,
+// no arguments) unless the level is compiled in and enabled for console or
+// file, e.g.  LOG_DEBUG(logger) << "rects: " << n << std::endl;
+#define APPLOG_IF(log, level, mask) \
+    if (!((APPLOG_COMPILED_MASK & (mask)) && (log).enabled(level))) ; else
+#define LOG_PRINT(log)   APPLOG_IF(log, APPLOG_PRINT, LOGMASK_PRINT) (log).PRINT()
+#define LOG_INFO(log)    APPLOG_IF(log, APPLOG_INFO, LOGMASK_INFO) (log).INFO()
+#define LOG_WARNING(log) APPLOG_IF(log, APPLOG_WARNING, LOGMASK_WARNING) (log).WARNING()
+#define LOG_ERROR(log)   APPLOG_IF(log, APPLOG_ERROR, LOGMASK_ERROR) (log).ERROR()
+#define LOG_DEBUG(log)   APPLOG_IF(log, APPLOG_DEBUG, LOGMASK_DEBUG) (log).DEBUG()
+
+// Asynchronous application log: each thread formats into its own streams,
+// complete records go through a bounded lock-free ring (multiple producers,
+// the writer thread as single consumer) to the log file and console.
 class AppLog {
+    static const uint32_t RING_SIZE = 1024; // power of 2
+    static const uint32_t ROUTE_FILE = 1;
+    static const uint32_t ROUTE_CONSOLE = 2;
+
+    struct log_slot {
+        std::atomic<uint64_t> seq; // == position + 1 when filled
+        int level;
+        uint32_t routes; // ROUTE_* as of publishing
+        std::string text;
+    };
+
     bool opened;
-    int stream_id;
+    std::atomic<uint32_t> console_mask;
+    std::atomic<uint32_t> file_mask;
     std::string filename;
     std::ofstream log_stream;
-    teestream print;
-    teestream info;
-    teestream warning;
-    teestream error;
 
+    log_slot ring[RING_SIZE];
+    std::atomic<uint64_t> head; // next position to claim, producers
+    uint64_t tail;              // next position to write, writer only
+
+    std::atomic<bool> running;
+    std::atomic<uint32_t> producers; // publish calls between checking running and their slot store
+    std::atomic<bool> writer_idle;
+    std::mutex idle_mutex;
+    std::condition_variable idle_cv;
+    std::mutex direct_mutex; // records arriving after the writer stopped
+    std::condition_variable stopped_cv;
+    bool stopped;            // final drain done, under direct_mutex
+    std::thread writer;
+
+    void write_loop();
+    bool write_records();
+    void write_record(int level, uint32_t routes, const std::string &text);
+    teestream &stream(int level);
 
     public:
         //AppLog();
-        AppLog(std::string log_name, uint32_t printmask);
+        AppLog(std::string log_name, uint32_t printmask, uint32_t filemask = LOGMASK_ALL);
         ~AppLog();
+
+        void set_console_mask(uint32_t mask);
+        void set_file_mask(uint32_t mask);
+        static int mask_from_level(std::string level, uint32_t &mask); // "debug" .. "error"
+        int set_levels(std::string console, std::string file); // empty keeps the current mask
+
+        // level goes to console or file at all
+        bool enabled(int level) {
+            return ((console_mask.load(std::memory_order_relaxed) | file_mask.load(std::memory_order_relaxed))
+                    & (1u << (level - 1))) != 0;
+        }
+
+        // takes the text of a complete record, leaves an empty string
+        void publish(int level, std::string &text);
+
         teestream &PRINT();
         teestream &INFO();
         teestream &WARNING();
         teestream &ERROR();
+        teestream &DEBUG();
 
 };
 
 
-#endif // APPLOG_H
\ No newline at end of file
+#endif // APPLOG_H
@@ -0,0 +1,160 @@
+#ifndef APPSTATS_H
+#define APPSTATS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <cstddef>
+#include <new>
+
+// memory pools of the tracked buffers and containers
+enum stats_pool { POOL_BITMAP, POOL_TAG_BITMAP, POOL_RECTS, POOL_OUTSIDES, POOL_VERTICES,
+                  POOL_TRIANGLES, POOL_MORPH, POOL_PGM, POOL_COUNT };
+
+// bytes allocated and allocations made during a stage or item, and the
+// highest live total above its start
+struct stats_mem {
+    uint64_t allocated, allocs;
+    int64_t peak;
+};
+
+// Per-stage timing and counters, off unless enabled. Samples belong to the
+// item (e.g. glyph) the recording thread is working on, so they can be
+// summed up per item and per run, printed as a table or written as Chrome
+// trace JSON (chrome://tracing, ui.perfetto.dev).
+class AppStats {
+    struct event {
+        const char *name;
+        int item;
+        int tid;
+        uint64_t start_ns, dur_ns;
+        stats_mem mem;
+    };
+    struct counter {
+        const char *name;
+        int item;
+        int tid;
+        uint64_t at_ns;
+        uint64_t value;
+    };
+
+    std::atomic<bool> on;
+    std::atomic<int> thread_count;
+    uint64_t t0_ns;
+
+    std::mutex mutex;
+    std::vector<std::string> items;
+    std::vector<event> events;
+    std::vector<counter> counters;
+    std::vector<stats_mem> item_mem;
+    std::vector<int> item_pool; // pool with the highest peak of each item
+
+    // process wide, per pool
+    std::atomic<int64_t> pool_live[POOL_COUNT];
+    std::atomic<int64_t> pool_peak[POOL_COUNT];
+    std::atomic<uint64_t> pool_allocated[POOL_COUNT];
+    std::atomic<uint64_t> pool_allocs[POOL_COUNT];
+
+    int current_item();
+    int thread_id();
+
+    public:
+        AppStats();
+
+        void enable(bool enable = true) { on.store(enable, std::memory_order_relaxed); }
+        bool enabled() { return on.load(std::memory_order_relaxed); }
+
+        uint64_t now_ns();
+
+        // samples of this thread go to the item until end_item()
+        void begin_item(std::string name);
+        void end_item(stats_mem mem = (stats_mem){0, 0, 0});
+
+        void add_time(const char *name, uint64_t start_ns, uint64_t dur_ns, stats_mem mem = (stats_mem){0, 0, 0});
+        void count(const char *name, uint64_t value);
+
+        // memory accounting of the tracked pools; the mark functions measure
+        // this thread's allocations from mark_mem() to mem_since()
+        void mem_alloc(int pool, size_t bytes);
+        void mem_free(int pool, size_t bytes);
+        int64_t mark_mem(stats_mem &start);
+        stats_mem mem_since(stats_mem &start, int64_t outer_peak);
+
+        void write_table(std::ostream &out);
+        int write_trace(std::string filename);
+};
+
+extern AppStats appstats;
+
+// times its scope and the allocations in it; next() ends the current stage
+// and starts another
+class ScopedTimer {
+    const char *name;
+    uint64_t start_ns;
+    stats_mem mem_start;
+    int64_t outer_peak;
+
+    public:
+        ScopedTimer(const char *stage_name);
+        ~ScopedTimer();
+        void next(const char *stage_name);
+};
+
+// attributes the samples of its scope to an item, which is timed as a whole
+class ScopedItem {
+    bool active;
+    uint64_t start_ns;
+    stats_mem mem_start;
+    int64_t outer_peak;
+    std::string name;
+
+    public:
+        ScopedItem(std::string item_name);
+        ~ScopedItem();
+};
+
+// calloc()/free() of buffers counted in a pool while stats are enabled
+void *stats_calloc(int pool, size_t count, size_t size);
+void stats_free(int pool, void *ptr);
+
+// allocator counting container memory in a pool
+template <class T, int POOL>
+struct stats_allocator {
+    typedef T value_type;
+    template <class U> struct rebind { typedef stats_allocator<U, POOL> other; };
+
+    stats_allocator() {}
+    template <class U> stats_allocator(const stats_allocator<U, POOL> &) {}
+
+    T *allocate(size_t n)
+    {
+        T *p = static_cast<T *>(::operator new(n * sizeof(T)));
+        if (appstats.enabled())
+            appstats.mem_alloc(POOL, n * sizeof(T));
+        return p;
+    }
+    void deallocate(T *p, size_t n)
+    {
+        if (appstats.enabled())
+            appstats.mem_free(POOL, n * sizeof(T));
+        ::operator delete(p);
+    }
+};
+template <class T, class U, int POOL>
+bool operator==(const stats_allocator<T, POOL> &, const stats_allocator<U, POOL> &) { return true; }
+template <class T, class U, int POOL>
+bool operator!=(const stats_allocator<T, POOL> &, const stats_allocator<U, POOL> &) { return false; }
+
+template <class T, int POOL>
+using stats_vector = std::vector<T, stats_allocator<T, POOL>>;
+
+#define APPSTATS_CAT2(a, b) a##b
+#define APPSTATS_CAT(a, b) APPSTATS_CAT2(a, b)
+#define STATS_TIMER(name) ScopedTimer APPSTATS_CAT(stats_timer_, __LINE__)(name)
+#define STATS_COUNT(name, value) \
+    do { if (appstats.enabled()) appstats.count(name, value); } while (0)
+
+#endif // APPSTATS_H
@@ -0,0 +1,37 @@
+#ifndef GRAYIMAGE_H
+#define GRAYIMAGE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "TypeBitmap.h"
+
+// 8 bit grayscale image (0 black .. 255 white) for converting artwork into
+// type bitmaps: decodes PNM (P1-P6) and PNG in-process, area-average resize,
+// fixed or Otsu threshold into a TypeBitmap.
+class GrayImage {
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> pixels;
+
+    int loadPNM(const std::vector<uint8_t> &file);
+    int loadPNG(const std::vector<uint8_t> &file);
+
+    public:
+        GrayImage();
+
+        int load(std::string filename);
+        static bool is_supported(std::string filename);
+
+        uint32_t getWidth();
+        uint32_t getHeight();
+        uint8_t* getAddress();
+
+        int resize(uint32_t new_width, uint32_t new_height, GrayImage &target);
+        int resize_to_height(uint32_t new_height, GrayImage &target);
+
+        uint8_t otsu_threshold();
+        int threshold(uint8_t thr, TypeBitmap &TBM); // darker than thr becomes ink
+};
+
+#endif // GRAYIMAGE_H
@@ -0,0 +1,50 @@
+#ifndef MESHCHECK_H
+#define MESHCHECK_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "TypeBitmap.h"
+
+// Integrity check of a generated mesh. The mesh has to be closed and
+// consistently wound (every half-edge once, its opposite once), and its
+// signed volume has to match the voxel volume of the same sort from
+// TypeVolume (ink area x depth of drive, body, foot and nicks). Open edges
+// that only form T-junctions, edges of pixels touching at a corner and
+// zero area triangles are reported but do not fail the check, slicers
+// close them. Both checks are linear in the mesh and the number of
+// distinct cross-sections.
+struct mesh_validation {
+    mesh_check mesh;
+    uint64_t expected_voxels; // pixels x pixels x layers, as mesh.volume
+    double volume_error_pct;  // mesh against expected volume
+    bool watertight;          // no holes, every half-edge used once
+    bool volume_ok;           // within the tolerance
+};
+
+// checks the mesh of the last generateMesh() call, with the same parameters
+int validate_mesh(TypeBitmap &TBM, reduced_foot foot, std::vector<nick> &nicks,
+                  float UVstretchXY, float UVstretchZ, float tolerance_pct, mesh_validation &result);
+
+// one line summary, e.g. for a per glyph log
+std::string describe_validation(mesh_validation &result);
+
+// The mesh sliced back into pixels (MeshSlicer) against the analytic
+// sections of TypeSlicer. The glyph layers of those are the bitmap, so the
+// top surface has to reproduce it pixel for pixel.
+struct raster_validation {
+    uint32_t layers;            // layers compared
+    uint32_t bad_layers;        // layers with any mismatch
+    uint64_t mismatched;        // pixels over all layers
+    uint64_t worst_mismatched;  // pixels in the worst layer
+    int32_t worst_z;
+    int32_t first_x, first_y, first_z; // first mismatch from the top, -1 if none
+};
+
+// the glyph surface layer and every step-th layer below it (step 1: all)
+int raster_check(TypeBitmap &TBM, reduced_foot foot, std::vector<nick> &nicks,
+                 float UVstretchXY, float UVstretchZ, uint32_t step, raster_validation &result);
+
+std::string describe_raster(raster_validation &result);
+
+#endif // MESHCHECK_H
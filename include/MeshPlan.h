@@ -0,0 +1,43 @@
+#ifndef MESHPLAN_H
+#define MESHPLAN_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+#include "TypeBitmap.h"
+
+// Cost estimate of meshing one bitmap, from its bitmap_stats. The
+// coefficients were fitted to the rectangle mesher over real glyphs
+// (24..72pt, all foot modes): triangles follow the outline (corners and
+// edge length, within about 10%), time is dominated by the quadratic
+// vertex welding plus a per-pixel part for the tag bitmap.
+struct mesh_plan {
+    std::string name;
+    bool valid;             // false if the bitmap could not be loaded or measured
+    bitmap_stats stats;
+    uint64_t hash;          // first check for identical bitmaps
+    int duplicate_of;       // index of the first identical bitmap, -1 if none
+
+    uint64_t rects, vertices, triangles;
+    uint64_t mesh_bytes;    // bitmap, tag bitmap, rects and mesh vectors while meshing
+    uint64_t output_bytes;  // all selected output formats
+    double seconds;         // meshing time
+};
+
+// estimate for the loaded bitmap; formats: stl, obj, ply, 3mf.
+// On failure the plan stays invalid, named but without an estimate.
+int plan_mesh(TypeBitmap &TBM, std::string name, std::vector<std::string> &formats, mesh_plan &plan);
+
+// marks later bitmaps identical to an earlier one as duplicates (valid plans
+// only); bitmaps[i] is the bitmap of plans[i], compared when the hashes match
+void mark_duplicates(std::vector<mesh_plan> &plans, const std::vector<packed_bitmap> &bitmaps);
+
+// indices of the bitmaps to mesh, most expensive first (duplicates and invalid plans left out)
+std::vector<size_t> largest_first(std::vector<mesh_plan> &plans);
+
+// per bitmap table and totals, with wall time and peak memory of
+// largest-first scheduling on the given number of jobs
+void write_plan(std::ostream &out, std::vector<mesh_plan> &plans, uint32_t jobs = 1);
+
+#endif // MESHPLAN_H
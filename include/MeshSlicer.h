@@ -0,0 +1,52 @@
+#ifndef MESHSLICER_H
+#define MESHSLICER_H
+
+#include <cstdint>
+#include <vector>
+#include "t3t_support_types.h"
+#include "TypeSlicer.h"
+
+// Scanline slicer for a triangle mesh in mm (as from TypeBitmap::getMesh()).
+// Yields the same layer_section as TypeSlicer::section() for the solid the
+// mesh encloses, so any mesher's output can be compared with the analytic
+// sections and, in the glyph layers, with the bitmap itself. Layer z is cut
+// at its center plane z - 0.5; a pixel is solid when its center lies inside
+// (even-odd rule).
+// Triangles are kept sorted by height; slicing layers from the top down only
+// visits the triangles that span the current layer.
+class MeshSlicer {
+    int32_t w, h;
+    float RS, LH;
+
+    struct tri_span {
+        float z_lo, z_hi; // in layers
+        uint32_t index;
+    };
+    std::vector<pos3d_t> verts;     // in pixels and layers, Y pointing down
+    std::vector<idx_tri_t> tris;
+    std::vector<tri_span> by_top;   // highest first
+    std::vector<uint32_t> active;   // triangles reaching down to the last plane
+    size_t next;                    // first triangle of by_top not yet active
+    float last_zc;
+
+    struct crossing {
+        int32_t row;
+        float x;
+    };
+    std::vector<crossing> crossings;
+
+    public:
+        MeshSlicer();
+
+        int setup(const std::vector<pos3d_t> &vertices, const std::vector<idx_tri_t> &triangles,
+                  float raster_mm, float layer_mm, uint32_t width, uint32_t height);
+
+        // cheapest when called for descending z
+        int section(int32_t z, layer_section &S);
+};
+
+// pixels in exactly one of the sections; first_x/first_y: first such pixel
+uint64_t diff_sections(const layer_section &A, const layer_section &B, uint32_t height,
+                       int32_t &first_x, int32_t &first_y);
+
+#endif // MESHSLICER_H
@@ -0,0 +1,51 @@
+#ifndef MESHWRITER_H
+#define MESHWRITER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include "t3t_support_types.h"
+
+// Block-buffered output for the mesh exporters.
+// Numbers are formatted directly into one large buffer with std::to_chars
+// and handed to the file in big blocks, never line by line.
+class OutBuffer {
+    std::ofstream out;
+    std::vector<char> buf;
+    size_t fill;
+    uint64_t total;
+    bool crc_on;
+    uint32_t crc;
+    size_t crc_from; // start of the checksummed bytes still in buf
+
+    void drain();
+
+    public:
+        OutBuffer(size_t block_size = (4 << 20));
+        ~OutBuffer();
+
+        int open(std::string filename);
+        bool is_open();
+        int close();
+
+        void put(char c);
+        void put(const char *s, size_t n);
+        void put(const char *s);
+        void put(const std::string &s);
+        void put_float(float f);    // shortest round-trip representation
+        void put_uint(uint32_t u);
+
+        uint64_t bytes_written();
+
+        // CRC-32 (ZIP) of everything put between the two calls
+        void start_crc();
+        uint32_t end_crc();
+};
+
+
+// Indexed mesh exporters - vertex coordinates in mm, indices start at 0
+int writePLY(std::string filename, const std::vector<pos3d_t> &vertices, const std::vector<idx_tri_t> &triangles);
+int write3MF(std::string filename, const std::vector<pos3d_t> &vertices, const std::vector<idx_tri_t> &triangles);
+
+#endif // MESHWRITER_H
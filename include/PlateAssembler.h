@@ -0,0 +1,92 @@
+#ifndef PLATEASSEMBLER_H
+#define PLATEASSEMBLER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include "t3t_support_types.h"
+
+// binary STL: 80 byte header, uint32 triangle count, then packed 50 byte records
+// (normal, three vertices, uint16 attribute)
+#define STL_HEADER_SIZE 84
+#define STL_RECORD_SIZE 50
+
+struct mesh_bbox {
+    float lowX, highX, lowY, highY, lowZ, highZ;
+};
+
+// Lays out sort meshes on build platforms and writes one welded mesh per plate.
+// Meshes are held as packed binary STL records, either borrowed (e.g. a mapped
+// STL file, must outlive the assembler) or converted from an indexed mesh such
+// as TypeBitmap::getMesh() produces. All positions in mm.
+class PlateAssembler {
+    struct plate_mesh {
+        std::string name;
+        const uint8_t *records;
+        uint32_t tri_count;
+        mesh_bbox bbox;
+        std::vector<uint8_t> owned; // records of converted indexed meshes
+    };
+
+    struct sort_instance {
+        int mesh;
+        float offsetX, offsetY, offsetZ;
+        bool rotated; // turned 90 degrees about Z: (x, y) -> (-y, x)
+        int plate;
+    };
+
+    struct plate_t {
+        std::vector<int> sorts; // instance indices
+        float used_area;
+    };
+
+    float platformX, platformY;
+    float gapX, gapY;
+    bool auto_mode, allow_rotation;
+
+    std::deque<plate_mesh> meshes;
+    std::unordered_map<std::string, int> mesh_index;
+    std::vector<std::vector<int>> rows; // mesh ids per structure row
+    std::vector<sort_instance> instances;
+    std::vector<plate_t> plates;
+    uint32_t skipped; // sorts larger than the platform in the last layout()
+
+    void rows_layout();
+    void auto_layout();
+    void translate(const sort_instance &sort, uint8_t *dst);
+
+    public:
+        PlateAssembler();
+
+        void set_platform(float size_X, float size_Y, float gap_X, float gap_Y);
+        void set_layout(bool automatic, bool rotation);
+
+        static void get_bbox(const uint8_t *records, uint32_t tri_count, mesh_bbox &bbox);
+
+        int add_mesh(std::string name, const uint8_t *records, uint32_t tri_count,
+                     const mesh_bbox *bbox = nullptr);
+        int add_mesh(std::string name, const std::vector<pos3d_t> &vertices,
+                     const std::vector<idx_tri_t> &triangles);
+        int find_mesh(std::string name);
+
+        void add_row(const std::vector<int> &mesh_ids);
+        void clear_rows();
+
+        int layout();
+
+        uint32_t plate_count();
+        uint32_t skipped_count();
+        uint32_t plate_sort_count(uint32_t plate);
+        float plate_fill(uint32_t plate);
+
+        int get_plate_mesh(uint32_t plate, std::vector<pos3d_t> &vertices,
+                           std::vector<idx_tri_t> &triangles);
+        int write_plate_STL(uint32_t plate, std::string filename);
+        int write_plate(uint32_t plate, std::string output_base,
+                        bool stl, bool ply, bool tmf);
+        int write_plates(std::string output_base, bool stl, bool ply, bool tmf);
+};
+
+#endif // PLATEASSEMBLER_H
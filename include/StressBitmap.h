@@ -0,0 +1,30 @@
+#ifndef STRESSBITMAP_H
+#define STRESSBITMAP_H
+
+#include <cstdint>
+#include <string>
+#include "TypeBitmap.h"
+
+// Synthetic worst cases for the mesher and the per-pixel loops, at any size:
+//   solid, empty  one rectangle / nothing
+//   checker       squares of cell pixels (cell 1: every pixel its own rect)
+//   noise         random cells, density of them inked
+//   diagonals     1 pixel wide 45 degree lines both ways, cell apart
+//   text          dense block of stroke letters with cell pixels x-height
+//   logo          disc over the whole bitmap: rings, spokes, wavy rim
+//   blobs         one glyph-like shape (bowl, stem, bar, serifs)
+// Structure scales with cell, so sizes are comparable within a family.
+struct stress_params {
+    std::string family;
+    uint32_t width, height;
+    uint32_t cell;   // structure size in pixels, 0: height / 40
+    float density;   // noise: share of inked cells
+    uint32_t seed;   // noise, text
+};
+
+extern const char *stress_families[];
+extern const int stress_family_count;
+
+int make_stress_bitmap(TypeBitmap &TBM, stress_params &params);
+
+#endif // STRESSBITMAP_H
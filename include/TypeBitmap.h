@@ -5,6 +5,7 @@
 #include <string>
 #include <vector>
 #include "t3t_support_types.h" 
+#include "AppStats.h"
 
 enum reduced_foot_mode { no_foot, bevel, step, supports, pyramids};
 
@@ -35,7 +36,68 @@ struct nick {
     nick() { type = nick_undefined; }
 };
 
+// Dimensions of the sort around the glyph, in pixels (X/Y) and layers (Z):
+// glyph surface at DOD, body top at 0, body bottom at -BH. Shared by
+// generateMesh() and TypeSlicer, so both build the same solid.
+struct sort_geometry {
+    int32_t w, h;
+    int32_t DOD, BH;
+    int32_t FZ, FXY; // reduced foot height and inset
+    int32_t US;      // body upper strip, the nicks follow below it
+
+    struct nick_layer {
+        nick_type type;
+        int32_t top;        // depth below body top
+        int32_t NH, TD, RD; // nick height, triangle depth, rect depth
+        std::vector<int32_t> start_z, end_z, start_y, end_y; // circle segments, from top
+    };
+    std::vector<nick_layer> nick_layers;
+
+    // supports foot
+    int32_t SSW, HTW, IG, HSW, TSG;
+    int32_t support_intervalsY;
+    int32_t FH1, FH2, FH3, FH4, FH5; // z of the support layer boundaries
+    std::vector<int32_t> support_segments_x1, support_segments_x2;
+
+    // pyramids foot
+    int32_t PFH, PTCH, PH;
+    std::vector<int32_t> pyramid_base_X_points, pyramid_base_Y_points; // count+1 boundaries
+    std::vector<int32_t> pyramid_top_X_points, pyramid_top_Y_points;   // a pair per pyramid
+};
+
+// cheap bitmap statistics, input to the mesh cost estimate
+struct bitmap_stats {
+    uint64_t pixels;    // width x height
+    uint64_t ink;       // set pixels
+    uint64_t row_edges; // ink/background changes along rows, the border counts as background
+    uint64_t col_edges; // the same along columns
+    uint64_t corners;   // outline corners: 2x2 windows with 1 or 3 set pixels, diagonal pairs twice
+};
+
+// bitmap kept at 1 bit per pixel, rows padded to whole bytes as in P4
+struct packed_bitmap {
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> bits;
+
+    bool operator==(const packed_bitmap &other) const = default;
+};
+
+// topology and volume of the generated mesh
+struct mesh_check {
+    uint64_t triangles;
+    uint64_t edges;        // distinct undirected edges
+    uint64_t open_edges;   // half-edges without the opposite one: holes, T-junctions
+    double hole_area;      // vector area spanned by the open edges, 0 if they are all T-junctions
+    uint64_t shared_edges; // half-edges used more often than their opposite: flipped winding
+    uint64_t nonmanifold_edges; // more than two faces, consistently wound: pixels touching at a corner
+    uint64_t degenerate;   // triangles with a repeated vertex
+    double volume;         // signed, in pixels x pixels x layers; positive when facing outwards
+};
+
 class TypeBitmap {
+    friend struct TypeBitmapBench; // t3t_bench times the private hot paths
+
     bool loaded;
     uint8_t *bitmap;
     uint32_t bm_width;
@@ -49,16 +111,18 @@ class TypeBitmap {
         int32_t width, height; // u32?
         int32_t tag;
     };
-    std::vector<STLrect> glyph_rects;
-    std::vector<STLrect> body_rects;
+    stats_vector<STLrect, POOL_RECTS> glyph_rects;
+    stats_vector<STLrect, POOL_RECTS> body_rects;
+    STLrect mesh_box; // ink bounding box, grown over too thin body bands
 
     // for optimized mesh conversion
     struct mesh_triangle {
         intvec3d_t N;
         uint32_t v1, v2, v3; // vertex indices
     };
-    std::vector<intvec3d_t> vertices;
-    std::vector<mesh_triangle> triangles;
+    stats_vector<intvec3d_t, POOL_VERTICES> vertices;
+    stats_vector<mesh_triangle, POOL_TRIANGLES> triangles;
+    uint64_t weld_lookups, weld_probes; // find_or_add_vertex() statistics
 
     dim_t type_height;
     dim_t depth_of_drive;
@@ -69,11 +133,15 @@ class TypeBitmap {
                        intvec3d_t v1, intvec3d_t v2, intvec3d_t v3,
                        intvec3d_t v4 = {0, 0, INT32_MAX});
 
-    void fill_rectangle(int32_t *bm32, STLrect rect); // not needed
+    void fill_rectangle(int32_t *bm32, STLrect rect);
+    void add_body_band(int32_t top, int32_t left, int32_t bottom, int32_t right, int32_t &tag_cnt);
+    void find_ink_box(int32_t &tag_cnt);
     int find_rectangles(void);
 
     uint32_t find_or_add_vertex(intvec3d_t v);
 
+    int morph(float radius, bool invert);
+
 
     public:
         TypeBitmap();
@@ -84,18 +152,42 @@ class TypeBitmap {
         void unload();
         int load(std::string filename);
         bool is_loaded();
+        uint32_t getWidth();
+        uint32_t getHeight();
+        uint8_t* getAddress();
 
-        int store(std::string filename);
+        int store(std::string filename, bool binary = false); // P1, or P4 if binary
+        int pack(packed_bitmap &packed);
+        int unpack(const packed_bitmap &packed);
         int newBitmap(uint32_t width, uint32_t height);
         int pasteGlyph(uint8_t *glyph, uint32_t g_width, uint32_t g_height, uint32_t top_pos, uint32_t left_pos);
         void threshold(uint8_t thr);
         void mirror();
 
+        // bit-parallel morphology with a disc of radius in (fractional) pixels
+        int dilate(float radius);
+        int erode(float radius);
+        int compensate_edges(float px);
+
+        uint64_t hash(); // same size and pixels give the same hash
+        int measure(bitmap_stats &stats);
+
         int set_type_parameters(dim_t TH, dim_t DOD, dim_t RS, dim_t LH);
+        int get_type_parameters(dim_t &TH, dim_t &DOD, dim_t &RS, dim_t &LH);
 
+        int get_sort_geometry(reduced_foot foot, std::vector<nick> &nicks, float UVstretchXY, float UVstretchZ,
+                              sort_geometry &G);
         int generateMesh(reduced_foot foot, std::vector<nick> &nicks, float UVstretchXY, float UVstretchZ);
-        int writeOBJ(std::string filename);
+        int writeOBJ(std::string filename, bool normals = false);
         int writeSTL(std::string filename);
+        int writePLY(std::string filename);
+        int write3MF(std::string filename);
+
+        // edge-manifoldness, winding and signed volume in one pass over the mesh
+        int check_mesh(mesh_check &check);
+
+        // welded mesh in mm, indices start at 0
+        int getMesh(std::vector<pos3d_t> &mesh_vertices, std::vector<idx_tri_t> &mesh_triangles);
 };
 
 #endif // TYPEBITMAP_H
\ No newline at end of file
@@ -0,0 +1,80 @@
+#ifndef TYPESLICER_H
+#define TYPESLICER_H
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include "TypeBitmap.h"
+
+// run of solid pixels [x0, x1) within one row
+struct xrun_t {
+    int32_t x0, x1;
+};
+
+// cross-section of a sort in one layer, as runs row by row
+struct layer_section {
+    std::vector<uint32_t> row_start; // index of first run per row; height+1 entries
+    std::vector<xrun_t> runs;
+};
+
+// building a section row by row, shared by TypeSlicer and MeshSlicer so both
+// encode runs the same way
+static inline void push_run(layer_section &S, int32_t x0, int32_t x1)
+{
+    if (x1 <= x0)
+        return;
+
+    // merge with touching run of the current row
+    if ((S.runs.size() > S.row_start.back()) && (S.runs.back().x1 >= x0)) {
+        S.runs.back().x1 = std::max(S.runs.back().x1, x1);
+        return;
+    }
+    S.runs.push_back((xrun_t) {x0, x1});
+}
+
+static inline void end_row(layer_section &S)
+{
+    S.row_start.push_back(S.runs.size());
+}
+
+static inline void clear_section(layer_section &S)
+{
+    S.row_start.assign(1, 0);
+    S.runs.clear();
+}
+
+// Analytic slicer for a type sort.
+// Yields the per-layer cross-sections of the solid that generateMesh() builds
+// from the same bitmap and body/foot/nick parameters, directly in printer
+// pixels (X/Y) and layers (Z), without going through a mesh.
+// Layer z covers the slab between z-1 and z in generateMesh() coordinates:
+// glyph surface at z_top(), body top at 0, foot bottom at z_bottom().
+class TypeSlicer {
+    bool ready;
+    int32_t w, h;
+
+    reduced_foot_mode foot_mode;
+    sort_geometry G;     // from TypeBitmap::get_sort_geometry(), as generateMesh() uses it
+    int32_t body_end;    // depth below body top where the foot starts
+    int32_t foot_bottom; // depth of lowest layer boundary
+
+    layer_section glyph; // ink runs of the bitmap
+
+    void body_section(float depth, layer_section &S);
+    void foot_section(float depth, layer_section &S);
+
+    public:
+        TypeSlicer();
+
+        int setup(TypeBitmap &TBM, reduced_foot foot, std::vector<nick> &nicks,
+                  float UVstretchXY, float UVstretchZ);
+
+        uint32_t getWidth();
+        uint32_t getHeight();
+        int32_t z_top();
+        int32_t z_bottom();
+
+        int section(int32_t z, layer_section &S);
+};
+
+#endif // TYPESLICER_H
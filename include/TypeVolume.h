@@ -0,0 +1,55 @@
+#ifndef TYPEVOLUME_H
+#define TYPEVOLUME_H
+
+#include <cstdint>
+#include <vector>
+#include "TypeBitmap.h"
+#include "TypeSlicer.h"
+
+// Run-length voxel model of a type sort.
+// A sort is a handful of Z-ranges (glyph, body, nick cut-outs, foot), each with
+// one cross-section. Cross-sections are stored once as row runs and every
+// layer refers to one of them, so memory follows the number of distinct
+// sections, not layers x pixels.
+class TypeVolume {
+    uint32_t w, h;
+    int32_t z_lo, z_hi; // layers z_lo+1 .. z_hi
+
+    float RS, LH;       // raster size, layer height in mm
+
+    struct z_range {
+        int32_t z0, z1;   // layers z0..z1 (inclusive) share one section
+        uint32_t section;
+    };
+
+    std::vector<layer_section> sections;
+    std::vector<z_range> ranges;
+    layer_section empty_section;
+
+    uint32_t find_or_add_section(layer_section &S);
+
+    public:
+        TypeVolume();
+
+        int build(TypeBitmap &TBM, reduced_foot foot, std::vector<nick> &nicks,
+                  float UVstretchXY, float UVstretchZ);
+        int build(TypeSlicer &slicer, float raster_mm, float layer_mm);
+        void clear();
+
+        uint32_t getWidth();
+        uint32_t getHeight();
+        int32_t z_top();
+        int32_t z_bottom();
+
+        uint32_t section_count();
+        uint32_t range_count();
+        uint32_t section_index(int32_t z); // distinct section id of layer z
+        const layer_section &section(int32_t z);
+
+        uint64_t section_area(uint32_t index); // solid pixels
+        uint64_t voxel_count();
+        float volume_mm3();
+        size_t memory_bytes();
+};
+
+#endif // TYPEVOLUME_H
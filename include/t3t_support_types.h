@@ -43,6 +43,11 @@ struct intvec3d_t {
     int32_t x, y, z;
 };
 
+// triangle of an indexed (welded) mesh, indices start at 0
+struct idx_tri_t {
+    uint32_t v1, v2, v3;
+};
+
 
 
 //struct stl_binary_triangle
@@ -1,53 +1,41 @@
 #include "AppLog.h"
 #include <streambuf>
 
-teebuf::teebuf() {}
-
-void teebuf::connect(std::streambuf * sbuf1, std::streambuf * sbuf2)
-    {
-        sb1 = sbuf1;
-        sb2 = sbuf2;
-    }
+teebuf::teebuf() : log(NULL), level(APPLOG_NONE)
+{
+    setp(chunk, chunk + sizeof(chunk));
+}
 
-void teebuf::connect(std::streambuf * sbuf1)
+void teebuf::connect(AppLog * alog, int alevel)
     {
-        sb1 = sbuf1;
-        sb2 = NULL;
+        log = alog;
+        level = alevel;
     }
 
  int teebuf::overflow(int c)
 {
-    if (c == EOF)
-    {
-        return !EOF;
-    }
-    else
-    {
-        if (sb2) {
-            int const r1 = sb1->sputc(c);
-            int const r2 = sb2->sputc(c);
-            return r1 == EOF || r2 == EOF ? EOF : c;
-        }
-        else {
-            int const r1 = sb1->sputc(c);
-            return r1 == EOF ? EOF : c;
-        }
-    }
+    record.append(pbase(), pptr() - pbase());
+    setp(chunk, chunk + sizeof(chunk));
+
+    if (c != EOF)
+        record.push_back((char)c);
+
+    return !EOF;
 }
 
-// Sync both teed buffers.
+// Hand the record to the writer thread.
  int teebuf::sync()
 {
-    if (sb2) {
-        int const r1 = sb1->pubsync();
-        int const r2 = sb2->pubsync();
-        return r1 == 0 && r2 == 0 ? 0 : -1;
-    }
-    else {
-        int const r1 = sb1->pubsync();
-        return r1;
+    if (pptr() != pbase()) {
+        record.append(pbase(), pptr() - pbase());
+        setp(chunk, chunk + sizeof(chunk));
     }
-}   
+
+    if (!record.empty() && log)
+        log->publish(level, record);
+
+    return 0;
+}
 
 
 teestream::teestream()
@@ -55,72 +43,250 @@ teestream::teestream()
 {
 }
 
-void teestream::connect(std::ostream & o1, std::ostream & o2)
+// publish what's left when the thread ends
+teestream::~teestream()
 {
-    tbuf.connect(o1.rdbuf(), o2.rdbuf());
+    tbuf.pubsync();
 }
 
-void teestream::connect(std::ostream & o1)
+void teestream::connect(AppLog * log, int level)
 {
-    tbuf.connect(o1.rdbuf());
+    tbuf.connect(log, level);
 }
 
 
 
 //AppLog::AppLog() : opened(false), stream_id(APPLOG_NONE), log_stream(NULL) {}
 
-AppLog::AppLog(std::string log_name, uint32_t printmask) : opened(false), stream_id(APPLOG_NONE) 
+AppLog::AppLog(std::string log_name, uint32_t printmask, uint32_t filemask)
+            : opened(false), console_mask(printmask), file_mask(filemask),
+              head(0), tail(0), running(true), producers(0), writer_idle(false),
+              stopped(false)
 {
     filename = log_name + ".log";
     // open stream
     log_stream.open(filename, std::ios::out);
-    if (!log_stream.is_open())
+    if (log_stream.is_open())
         opened = true;
 
-    if (printmask & LOGMASK_PRINT)
-        print.connect(std::cout, log_stream);
-    else
-        print.connect(log_stream);
+    for (uint32_t i = 0; i < RING_SIZE; i++)
+        ring[i].seq.store(i, std::memory_order_relaxed);
 
-    if (printmask & LOGMASK_INFO)
-        info.connect(std::cout, log_stream);
-    else
-        info.connect(log_stream);
+    writer = std::thread(&AppLog::write_loop, this);
+}
 
-    if (printmask & LOGMASK_WARNING)
-        warning.connect(std::cerr, log_stream);
-    else
-        warning.connect(log_stream);
+AppLog::~AppLog()
+{
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        running = false;
+    }
+    idle_cv.notify_one();
+    writer.join();
 
-    if (printmask & LOGMASK_ERROR)
-        error.connect(std::cerr, log_stream);
+    log_stream.close();
+    opened = false;
+}
+
+
+void AppLog::set_console_mask(uint32_t mask)
+{
+    console_mask = mask;
+}
+
+void AppLog::set_file_mask(uint32_t mask)
+{
+    file_mask = mask;
+}
+
+// threshold name to mask; PRINT (regular program output) is always included
+int AppLog::mask_from_level(std::string level, uint32_t &mask)
+{
+    if (level == "debug")
+        mask = LOGMASK_ALL | LOGMASK_DEBUG;
+    else if (level == "info")
+        mask = LOGMASK_ALL;
+    else if (level == "warning")
+        mask = LOGMASK_PRINT | LOGMASK_WARNING | LOGMASK_ERROR;
+    else if (level == "error")
+        mask = LOGMASK_PRINT | LOGMASK_ERROR;
     else
-        error.connect(log_stream);
+        return -1;
+    return 0;
+}
+
+
+int AppLog::set_levels(std::string console, std::string file)
+{
+    uint32_t mask;
 
+    if (!console.empty()) {
+        if (mask_from_level(console, mask) < 0)
+            return -1;
+        set_console_mask(mask);
+    }
+    if (!file.empty()) {
+        if (mask_from_level(file, mask) < 0)
+            return -1;
+        set_file_mask(mask);
+    }
+    return 0;
 }
 
-AppLog::~AppLog()
+
+void AppLog::publish(int level, std::string &text)
 {
-    log_stream.close();
+    uint32_t bit = 1u << (level - 1);
+    uint32_t routes = ((file_mask & bit) ? ROUTE_FILE : 0) | ((console_mask & bit) ? ROUTE_CONSOLE : 0);
+
+    // Announce ourselves before looking at running: the writer sets running
+    // false first and then waits for producers to reach 0, so either it sees
+    // us and drains our slot, or we see it stopping and go direct.
+    producers.fetch_add(1, std::memory_order_seq_cst);
+    if (!running.load(std::memory_order_seq_cst)) { // shutting down, write it ourselves
+        producers.fetch_sub(1, std::memory_order_seq_cst);
+        std::unique_lock<std::mutex> lock(direct_mutex);
+        stopped_cv.wait(lock, [this] { return stopped; }); // after everything in the ring
+        write_record(level, routes, text);
+        if (opened)
+            log_stream.flush();
+        std::cout.flush();
+        text.clear();
+        return;
+    }
+
+    log_slot *slot;
+    uint64_t pos = head.load(std::memory_order_relaxed);
+    for (;;) {
+        slot = &ring[pos & (RING_SIZE - 1)];
+        int64_t diff = (int64_t)slot->seq.load(std::memory_order_acquire) - (int64_t)pos;
+        if (diff == 0) {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0) { // ring full, let the writer catch up
+            idle_cv.notify_one();
+            std::this_thread::yield();
+            pos = head.load(std::memory_order_relaxed);
+        }
+        else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    slot->routes = routes;
+    slot->text.swap(text); // the slot's old (cleared) buffer comes back for reuse
+    slot->seq.store(pos + 1, std::memory_order_seq_cst);
+    producers.fetch_sub(1, std::memory_order_seq_cst);
+
+    if (writer_idle.load(std::memory_order_seq_cst)) {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        idle_cv.notify_one();
+    }
 }
 
-teestream &AppLog::PRINT()
+
+void AppLog::write_record(int level, uint32_t routes, const std::string &text)
 {
-    if (stream_id != APPLOG_PRINT) {
-        info.flush();
-        warning.flush();
-        error.flush();
+    if (opened && (routes & ROUTE_FILE))
+        log_stream << text;
+
+    if (routes & ROUTE_CONSOLE) {
+        if ((level == APPLOG_WARNING) || (level == APPLOG_ERROR))
+            std::cerr << text;
+        else
+            std::cout << text;
     }
+}
+
 
-    return print;
+// write all records published so far, in order
+bool AppLog::write_records()
+{
+    bool wrote = false;
+
+    for (;;) {
+        log_slot *slot = &ring[tail & (RING_SIZE - 1)];
+        if (slot->seq.load(std::memory_order_acquire) != tail + 1)
+            break;
+
+        write_record(slot->level, slot->routes, slot->text);
+        slot->text.clear();
+        slot->seq.store(tail + RING_SIZE, std::memory_order_release);
+        tail++;
+        wrote = true;
+    }
+
+    if (wrote) {
+        std::cout.flush();
+        if (opened)
+            log_stream.flush();
+    }
+    return wrote;
 }
-teestream &AppLog::INFO()
+
+
+// Write what is there, then sleep until a producer signals a new record.
+// On shutdown wait out the producers still filling slots, drain the ring and
+// let the late ones write directly.
+void AppLog::write_loop()
 {
-    if (stream_id != APPLOG_INFO) {
-        print.flush();
-        warning.flush();
-        error.flush();
+    for (;;) {
+        write_records();
+        if (!running.load(std::memory_order_seq_cst))
+            break;
+
+        std::unique_lock<std::mutex> lock(idle_mutex);
+        writer_idle.store(true, std::memory_order_seq_cst);
+        idle_cv.wait(lock, [this] {
+            return !running.load(std::memory_order_seq_cst) ||
+                   (ring[tail & (RING_SIZE - 1)].seq.load(std::memory_order_seq_cst) == tail + 1);
+        });
+        writer_idle.store(false, std::memory_order_relaxed);
+    }
+
+    while (producers.load(std::memory_order_seq_cst) != 0) {
+        if (!write_records()) // a producer may wait for ring space
+            std::this_thread::yield();
     }
+    write_records();
+
+    {
+        std::lock_guard<std::mutex> lock(direct_mutex);
+        stopped = true;
+    }
+    stopped_cv.notify_all();
+}
+
+
+// this thread's stream for the level; text left in the others (no endl) goes first.
+// A disabled level gets a failed stream, so operator<< skips all formatting.
+teestream &AppLog::stream(int level)
+{
+    thread_local teestream streams[APPLOG_DEBUG + 1];
+
+    for (int i = APPLOG_PRINT; i <= APPLOG_DEBUG; i++) {
+        if (i != level)
+            streams[i].flush();
+    }
+    streams[level].connect(this, level);
+    if (enabled(level))
+        streams[level].clear();
+    else
+        streams[level].setstate(std::ios::badbit);
+
+    return streams[level];
+}
+
+
+teestream &AppLog::PRINT()
+{
+    return stream(APPLOG_PRINT);
+}
+teestream &AppLog::INFO()
+{
+    teestream &info = stream(APPLOG_INFO);
 
     info << "INFO: ";
 
@@ -129,11 +295,7 @@ teestream &AppLog::INFO()
 
 teestream &AppLog::WARNING()
 {
-    if (stream_id != APPLOG_WARNING) {
-        print.flush();
-        info.flush();
-        error.flush();
-    }
+    teestream &warning = stream(APPLOG_WARNING);
 
     warning << "WARNING: ";
 
@@ -142,15 +304,18 @@ teestream &AppLog::WARNING()
 
 teestream &AppLog::ERROR()
 {
-    if (stream_id != APPLOG_ERROR) {
-        print.flush();
-        warning.flush();
-        info.flush();
-    }
+    teestream &error = stream(APPLOG_ERROR);
 
     error << "ERROR: ";
 
-    return error; 
+    return error;
 }
 
+teestream &AppLog::DEBUG()
+{
+    teestream &debug = stream(APPLOG_DEBUG);
+
+    debug << "DEBUG: ";
 
+    return debug;
+}
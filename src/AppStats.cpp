@@ -0,0 +1,396 @@
+#include "AppStats.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <cstdlib>
+#include <malloc.h>
+#include <boost/format.hpp>
+
+AppStats appstats;
+
+thread_local int stats_item = -1;
+thread_local int stats_tid = -1;
+
+static const char *pool_names[POOL_COUNT] = {"bitmap", "tag bitmap", "rects", "outsides", "vertices",
+                                             "triangles", "morphology", "PGM bitmap"};
+
+// this thread's tracked memory
+struct thread_mem {
+    int64_t live;
+    int64_t peak; // highest live since the innermost mark
+    uint64_t allocated, allocs;
+    int64_t pool_live[POOL_COUNT];
+    int64_t pool_start[POOL_COUNT]; // live when the item began
+    int64_t pool_peak[POOL_COUNT];  // highest live since the item began
+};
+thread_local thread_mem stats_mem_tl = {};
+
+
+AppStats::AppStats() : on(false), thread_count(0)
+{
+    t0_ns = 0;
+    t0_ns = now_ns();
+
+    for (int p = 0; p < POOL_COUNT; p++) {
+        pool_live[p] = 0;
+        pool_peak[p] = 0;
+        pool_allocated[p] = 0;
+        pool_allocs[p] = 0;
+    }
+}
+
+
+uint64_t AppStats::now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count() - t0_ns;
+}
+
+
+int AppStats::current_item()
+{
+    return stats_item;
+}
+
+
+// small, stable thread numbers for the trace
+int AppStats::thread_id()
+{
+    if (stats_tid < 0)
+        stats_tid = thread_count++;
+    return stats_tid;
+}
+
+
+void AppStats::begin_item(std::string name)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    items.push_back(name);
+    item_mem.push_back((stats_mem){0, 0, 0});
+    item_pool.push_back(-1);
+    stats_item = items.size() - 1;
+
+    for (int p = 0; p < POOL_COUNT; p++)
+        stats_mem_tl.pool_start[p] = stats_mem_tl.pool_peak[p] = stats_mem_tl.pool_live[p];
+}
+
+
+void AppStats::end_item(stats_mem mem)
+{
+    int pool = -1;
+    int64_t pool_peak = 0;
+
+    for (int p = 0; p < POOL_COUNT; p++) {
+        int64_t peak = stats_mem_tl.pool_peak[p] - stats_mem_tl.pool_start[p];
+        if (peak > pool_peak) {
+            pool = p;
+            pool_peak = peak;
+        }
+    }
+
+    if (stats_item >= 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        item_mem[stats_item] = mem;
+        item_pool[stats_item] = pool;
+    }
+    stats_item = -1;
+}
+
+
+void AppStats::add_time(const char *name, uint64_t start_ns, uint64_t dur_ns, stats_mem mem)
+{
+    event e = (event){name, current_item(), thread_id(), start_ns, dur_ns, mem};
+
+    std::lock_guard<std::mutex> lock(mutex);
+    events.push_back(e);
+}
+
+
+void AppStats::count(const char *name, uint64_t value)
+{
+    counter c = (counter){name, current_item(), thread_id(), now_ns(), value};
+
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.push_back(c);
+}
+
+
+void AppStats::mem_alloc(int pool, size_t bytes)
+{
+    thread_mem &tl = stats_mem_tl;
+
+    tl.live += bytes;
+    tl.peak = std::max(tl.peak, tl.live);
+    tl.allocated += bytes;
+    tl.allocs++;
+    tl.pool_live[pool] += bytes;
+    tl.pool_peak[pool] = std::max(tl.pool_peak[pool], tl.pool_live[pool]);
+
+    int64_t live = pool_live[pool].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    int64_t peak = pool_peak[pool].load(std::memory_order_relaxed);
+    while ((live > peak) && !pool_peak[pool].compare_exchange_weak(peak, live, std::memory_order_relaxed));
+    pool_allocated[pool].fetch_add(bytes, std::memory_order_relaxed);
+    pool_allocs[pool].fetch_add(1, std::memory_order_relaxed);
+}
+
+
+void AppStats::mem_free(int pool, size_t bytes)
+{
+    stats_mem_tl.live -= bytes;
+    stats_mem_tl.pool_live[pool] -= bytes;
+    pool_live[pool].fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+
+// start measuring; the returned outer peak goes back into mem_since(), so
+// marks nest (the peak field of start holds the live bytes at the mark)
+int64_t AppStats::mark_mem(stats_mem &start)
+{
+    thread_mem &tl = stats_mem_tl;
+    int64_t outer_peak = tl.peak;
+
+    start = (stats_mem){tl.allocated, tl.allocs, tl.live};
+    tl.peak = tl.live;
+    return outer_peak;
+}
+
+
+stats_mem AppStats::mem_since(stats_mem &start, int64_t outer_peak)
+{
+    thread_mem &tl = stats_mem_tl;
+    stats_mem mem = (stats_mem){tl.allocated - start.allocated, tl.allocs - start.allocs, tl.peak - start.peak};
+
+    tl.peak = std::max(outer_peak, tl.peak);
+    return mem;
+}
+
+
+// stage table per run, counters (with a rate where a stage of the same name
+// exists) and the time of every item with its slowest stage
+void AppStats::write_table(std::ostream &out)
+{
+    struct stage_sum {
+        const char *name;
+        uint64_t calls, total_ns, max_ns;
+        uint64_t allocated, allocs;
+        int64_t peak;
+    };
+    struct counter_sum {
+        const char *name;
+        uint64_t total;
+        std::vector<int> items;
+    };
+    struct item_sum {
+        uint64_t total_ns;
+        const char *slowest;
+        uint64_t slowest_ns;
+    };
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint64_t run_ns = now_ns();
+    std::vector<stage_sum> stages;
+    std::vector<counter_sum> sums;
+    std::vector<item_sum> per_item(items.size(), (item_sum){0, NULL, 0});
+
+    for (event &e : events) {
+        if (e.name == NULL) { // the item itself
+            per_item[e.item].total_ns += e.dur_ns;
+            continue;
+        }
+
+        size_t i;
+        for (i = 0; (i < stages.size()) && strcmp(stages[i].name, e.name); i++);
+        if (i == stages.size())
+            stages.push_back((stage_sum){e.name, 0, 0, 0, 0, 0, 0});
+        stages[i].calls++;
+        stages[i].total_ns += e.dur_ns;
+        stages[i].max_ns = std::max(stages[i].max_ns, e.dur_ns);
+        stages[i].allocated += e.mem.allocated;
+        stages[i].allocs += e.mem.allocs;
+        stages[i].peak = std::max(stages[i].peak, e.mem.peak);
+
+        if ((e.item >= 0) && (e.dur_ns > per_item[e.item].slowest_ns)) {
+            per_item[e.item].slowest = e.name;
+            per_item[e.item].slowest_ns = e.dur_ns;
+        }
+    }
+
+    for (counter &c : counters) {
+        size_t i;
+        for (i = 0; (i < sums.size()) && strcmp(sums[i].name, c.name); i++);
+        if (i == sums.size())
+            sums.push_back((counter_sum){c.name, 0, {}});
+        sums[i].total += c.value;
+        if ((c.item >= 0) && (std::find(sums[i].items.begin(), sums[i].items.end(), c.item) == sums[i].items.end()))
+            sums[i].items.push_back(c.item);
+    }
+
+    out << boost::format("%-32s %8s %11s %10s %10s %6s\n") % "Stage" % "calls" % "total ms" % "mean ms" % "max ms" % "run %";
+    for (stage_sum &s : stages)
+        out << boost::format("%-32s %8u %11.3f %10.3f %10.3f %6.1f\n") % s.name % s.calls
+               % (s.total_ns / 1e6) % (s.total_ns / 1e6 / s.calls) % (s.max_ns / 1e6)
+               % (100.0 * s.total_ns / run_ns);
+    out << boost::format("%-32s %8s %11.3f\n") % "run (wall)" % "" % (run_ns / 1e6);
+
+    if (!sums.empty()) {
+        out << "\n" << boost::format("%-32s %14s %14s %14s\n") % "Counter" % "total" % "per item" % "per s";
+        for (counter_sum &c : sums) {
+            std::string per_item_str = c.items.empty() ? "" : (boost::format("%.1f") % (double(c.total) / c.items.size())).str();
+            std::string rate_str;
+            for (stage_sum &s : stages)
+                if (!strcmp(s.name, c.name) && s.total_ns)
+                    rate_str = (boost::format("%.4g") % (c.total * 1e9 / s.total_ns)).str();
+            out << boost::format("%-32s %14u %14s %14s\n") % c.name % c.total % per_item_str % rate_str;
+        }
+    }
+
+    if (!items.empty()) {
+        out << "\n" << boost::format("%-32s %11s  %-32s %10s\n") % "Item" % "total ms" % "slowest stage" % "ms";
+        for (size_t i = 0; i < items.size(); i++)
+            out << boost::format("%-32s %11.3f  %-32s %10.3f\n") % items[i] % (per_item[i].total_ns / 1e6)
+                   % (per_item[i].slowest ? per_item[i].slowest : "") % (per_item[i].slowest_ns / 1e6);
+    }
+
+    uint64_t all_allocs = 0;
+    for (int p = 0; p < POOL_COUNT; p++)
+        all_allocs += pool_allocs[p];
+    if (!all_allocs)
+        return;
+
+    // peak: highest live bytes above the start of a call / item
+    out << "\n" << boost::format("%-32s %12s %10s %12s\n") % "Stage memory" % "alloc MB" % "allocs" % "peak MB";
+    for (stage_sum &s : stages)
+        if (s.allocs)
+            out << boost::format("%-32s %12.3f %10u %12.3f\n") % s.name % (s.allocated / 1048576.0) % s.allocs
+                   % (s.peak / 1048576.0);
+
+    out << "\n" << boost::format("%-32s %12s %10s %12s %12s\n") % "Pool" % "alloc MB" % "allocs" % "peak MB" % "live MB";
+    for (int p = 0; p < POOL_COUNT; p++)
+        if (pool_allocs[p])
+            out << boost::format("%-32s %12.3f %10u %12.3f %12.3f\n") % pool_names[p] % (pool_allocated[p] / 1048576.0)
+                   % pool_allocs[p] % (pool_peak[p] / 1048576.0) % (pool_live[p] / 1048576.0);
+
+    if (!items.empty()) {
+        out << "\n" << boost::format("%-32s %12s %10s %12s  %s\n") % "Item memory" % "alloc MB" % "allocs" % "peak MB" % "largest pool";
+        for (size_t i = 0; i < items.size(); i++)
+            out << boost::format("%-32s %12.3f %10u %12.3f  %s\n") % items[i] % (item_mem[i].allocated / 1048576.0)
+                   % item_mem[i].allocs % (item_mem[i].peak / 1048576.0) % ((item_pool[i] >= 0) ? pool_names[item_pool[i]] : "");
+    }
+}
+
+
+static std::string json_escape(const std::string &s)
+{
+    std::string escaped;
+
+    for (char c : s) {
+        if ((c == '"') || (c == '\\'))
+            escaped += '\\';
+        if ((unsigned char)c < 0x20)
+            escaped += (boost::format("\\u%04x") % int(c)).str();
+        else
+            escaped += c;
+    }
+    return escaped;
+}
+
+
+// Chrome trace event format: complete ("X") events for stages and items,
+// counter ("C") events for counters; timestamps in microseconds
+int AppStats::write_trace(std::string filename)
+{
+    std::ofstream trace(filename);
+    if (!trace.is_open())
+        return -1;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    trace << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (event &e : events) {
+        std::string item = (e.item >= 0) ? json_escape(items[e.item]) : "";
+        std::string name = e.name ? json_escape(e.name) : item;
+
+        trace << (first ? "" : ",\n")
+              << boost::format("{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,"
+                               "\"args\":{\"item\":\"%s\",\"alloc_bytes\":%u,\"allocs\":%u,\"peak_bytes\":%d}}")
+                 % name % (e.name ? "stage" : "item") % (e.start_ns / 1e3) % (e.dur_ns / 1e3) % e.tid % item
+                 % e.mem.allocated % e.mem.allocs % e.mem.peak;
+        first = false;
+    }
+    for (counter &c : counters) {
+        trace << (first ? "" : ",\n")
+              << boost::format("{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"value\":%u}}")
+                 % json_escape(c.name) % (c.at_ns / 1e3) % c.tid % c.value;
+        first = false;
+    }
+    trace << "\n]}\n";
+
+    trace.close();
+    return trace.fail() ? -1 : 0;
+}
+
+
+ScopedTimer::ScopedTimer(const char *stage_name) : name(stage_name), start_ns(0), outer_peak(0)
+{
+    if (appstats.enabled()) {
+        start_ns = appstats.now_ns();
+        outer_peak = appstats.mark_mem(mem_start);
+    }
+}
+
+ScopedTimer::~ScopedTimer()
+{
+    if (appstats.enabled() && name)
+        appstats.add_time(name, start_ns, appstats.now_ns() - start_ns, appstats.mem_since(mem_start, outer_peak));
+}
+
+void ScopedTimer::next(const char *stage_name)
+{
+    if (appstats.enabled()) {
+        uint64_t t = appstats.now_ns();
+        if (name)
+            appstats.add_time(name, start_ns, t - start_ns, appstats.mem_since(mem_start, outer_peak));
+        start_ns = t;
+        outer_peak = appstats.mark_mem(mem_start);
+    }
+    name = stage_name;
+}
+
+
+ScopedItem::ScopedItem(std::string item_name) : active(appstats.enabled()), name(item_name)
+{
+    if (active) {
+        appstats.begin_item(name);
+        start_ns = appstats.now_ns();
+        outer_peak = appstats.mark_mem(mem_start);
+    }
+}
+
+ScopedItem::~ScopedItem()
+{
+    if (active) {
+        stats_mem mem = appstats.mem_since(mem_start, outer_peak);
+        appstats.add_time(NULL, start_ns, appstats.now_ns() - start_ns, mem);
+        appstats.end_item(mem);
+    }
+}
+
+
+void *stats_calloc(int pool, size_t count, size_t size)
+{
+    void *ptr = calloc(count, size);
+
+    if (ptr && appstats.enabled())
+        appstats.mem_alloc(pool, malloc_usable_size(ptr));
+    return ptr;
+}
+
+void stats_free(int pool, void *ptr)
+{
+    if (ptr && appstats.enabled())
+        appstats.mem_free(pool, malloc_usable_size(ptr));
+    free(ptr);
+}
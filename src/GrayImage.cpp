@@ -0,0 +1,791 @@
+#include "GrayImage.h"
+#include "AppLog.h"
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+extern AppLog logger;
+
+
+GrayImage::GrayImage() : width(0), height(0) {}
+
+
+uint32_t GrayImage::getWidth()
+{
+    return width;
+}
+
+
+uint32_t GrayImage::getHeight()
+{
+    return height;
+}
+
+
+uint8_t* GrayImage::getAddress()
+{
+    return pixels.data();
+}
+
+
+static int read_file(std::string filename, std::vector<uint8_t> &data, size_t max_size = 0)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open())
+        return -1;
+
+    in.seekg(0, std::ios::end);
+    size_t size = in.tellg();
+    in.seekg(0, std::ios::beg);
+
+    if (max_size && (size > max_size))
+        size = max_size;
+
+    data.resize(size);
+    in.read((char*)data.data(), size);
+    return in ? 0 : -1;
+}
+
+
+static const uint8_t png_signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+
+// true if the file is a format load() can decode (checked by content, not suffix)
+bool GrayImage::is_supported(std::string filename)
+{
+    std::vector<uint8_t> head;
+
+    if (read_file(filename, head, 8) < 0)
+        return false;
+
+    if ((head.size() >= 2) && (head[0] == 'P') && (head[1] >= '1') && (head[1] <= '6'))
+        return true;
+
+    return (head.size() == 8) && (memcmp(head.data(), png_signature, 8) == 0);
+}
+
+
+int GrayImage::load(std::string filename)
+{
+    std::vector<uint8_t> file;
+
+    width = height = 0;
+    pixels.clear();
+
+    if (read_file(filename, file) < 0) {
+        logger.ERROR() << "Could not read image " << filename << std::endl;
+        return -1;
+    }
+
+    if ((file.size() >= 8) && (memcmp(file.data(), png_signature, 8) == 0))
+        return loadPNG(file);
+
+    if ((file.size() >= 2) && (file[0] == 'P') && (file[1] >= '1') && (file[1] <= '6'))
+        return loadPNM(file);
+
+    logger.ERROR() << "Unsupported image format: " << filename << std::endl;
+    return -1;
+}
+
+
+static inline uint8_t luma(uint32_t r, uint32_t g, uint32_t b)
+{
+    return (299 * r + 587 * g + 114 * b + 500) / 1000;
+}
+
+
+//
+// PNM
+//
+
+// next header token, skipping whitespace and comments
+static int pnm_token(const std::vector<uint8_t> &file, size_t &pos, uint32_t &value)
+{
+    while (pos < file.size()) {
+        if (file[pos] == '#') {
+            while ((pos < file.size()) && (file[pos] != '\n'))
+                pos++;
+        }
+        else if (isspace(file[pos]))
+            pos++;
+        else
+            break;
+    }
+
+    if ((pos >= file.size()) || !isdigit(file[pos]))
+        return -1;
+
+    value = 0;
+    while ((pos < file.size()) && isdigit(file[pos])) {
+        value = value * 10 + (file[pos] - '0');
+        pos++;
+    }
+    return 0;
+}
+
+
+int GrayImage::loadPNM(const std::vector<uint8_t> &file)
+{
+    int format = file[1] - '0';
+    size_t pos = 2;
+    uint32_t w, h, maxval = 1;
+
+    if ((pnm_token(file, pos, w) < 0) || (pnm_token(file, pos, h) < 0) || (w == 0) || (h == 0)) {
+        logger.ERROR() << "No valid PNM dimensions" << std::endl;
+        return -1;
+    }
+    if ((format != 1) && (format != 4)) {
+        if ((pnm_token(file, pos, maxval) < 0) || (maxval == 0) || (maxval > 65535)) {
+            logger.ERROR() << "No valid PNM maximum value" << std::endl;
+            return -1;
+        }
+    }
+    pos++; // single whitespace before binary raster
+
+    int channels = ((format == 3) || (format == 6)) ? 3 : 1;
+    size_t samples = (size_t)w * h * channels;
+    std::vector<uint32_t> values(samples);
+
+    if (format == 1) {
+        // P1 bits may be written without separators
+        pos--;
+        for (size_t i=0; i<samples; i++) {
+            while ((pos < file.size()) && (file[pos] != '0') && (file[pos] != '1')) {
+                if (file[pos] == '#') {
+                    while ((pos < file.size()) && (file[pos] != '\n'))
+                        pos++;
+                }
+                else
+                    pos++;
+            }
+            if (pos >= file.size()) {
+                logger.ERROR() << "Less PNM data than specified." << std::endl;
+                return -1;
+            }
+            values[i] = (file[pos++] == '1') ? 0 : 1; // 1 is black
+        }
+    }
+    else if ((format == 2) || (format == 3)) {
+        pos--;
+        for (size_t i=0; i<samples; i++) {
+            if (pnm_token(file, pos, values[i]) < 0) {
+                logger.ERROR() << "Less PNM data than specified." << std::endl;
+                return -1;
+            }
+        }
+    }
+    else if (format == 4) {
+        size_t stride = (w + 7) / 8;
+        if (pos + stride * h > file.size()) {
+            logger.ERROR() << "Less PNM data than specified." << std::endl;
+            return -1;
+        }
+        for (uint32_t y=0; y<h; y++) {
+            const uint8_t *row = file.data() + pos + y * stride;
+            for (uint32_t x=0; x<w; x++)
+                values[(size_t)y * w + x] = (row[x >> 3] & (0x80 >> (x & 7))) ? 0 : 1;
+        }
+    }
+    else {
+        int bytes = (maxval > 255) ? 2 : 1;
+        if (pos + samples * bytes > file.size()) {
+            logger.ERROR() << "Less PNM data than specified." << std::endl;
+            return -1;
+        }
+        for (size_t i=0; i<samples; i++) {
+            if (bytes == 2)
+                values[i] = (file[pos + 2*i] << 8) | file[pos + 2*i + 1];
+            else
+                values[i] = file[pos + i];
+        }
+    }
+
+    width = w;
+    height = h;
+    pixels.resize((size_t)w * h);
+
+    for (size_t i=0; i<pixels.size(); i++) {
+        if (channels == 3) {
+            uint32_t r = std::min(values[3*i], maxval) * 255 / maxval;
+            uint32_t g = std::min(values[3*i+1], maxval) * 255 / maxval;
+            uint32_t b = std::min(values[3*i+2], maxval) * 255 / maxval;
+            pixels[i] = luma(r, g, b);
+        }
+        else {
+            pixels[i] = std::min(values[i], maxval) * 255 / maxval;
+        }
+    }
+    return 0;
+}
+
+
+//
+// inflate (RFC 1951), canonical Huffman decoding as in zlib's puff.c
+//
+
+struct bit_reader {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+    uint64_t buf;
+    int cnt;
+    bool overrun;
+};
+
+static inline uint32_t get_bits(bit_reader &br, int n)
+{
+    while (br.cnt < n) {
+        uint64_t byte = 0;
+        if (br.pos < br.size)
+            byte = br.data[br.pos++];
+        else
+            br.overrun = true;
+        br.buf |= byte << br.cnt;
+        br.cnt += 8;
+    }
+    uint32_t v = br.buf & ((1ull << n) - 1);
+    br.buf >>= n;
+    br.cnt -= n;
+    return v;
+}
+
+struct huffman {
+    uint16_t count[16];   // codes per length
+    uint16_t symbol[320]; // symbols ordered by code
+};
+
+// returns < 0 for an over-subscribed code
+static int build_huffman(huffman &h, const uint8_t *lengths, int n)
+{
+    uint16_t offs[16];
+
+    memset(h.count, 0, sizeof(h.count));
+    for (int i=0; i<n; i++)
+        h.count[lengths[i]]++;
+
+    if (h.count[0] == n)
+        return 0;
+
+    int left = 1;
+    for (int len=1; len<16; len++) {
+        left <<= 1;
+        left -= h.count[len];
+        if (left < 0)
+            return -1;
+    }
+
+    offs[1] = 0;
+    for (int len=1; len<15; len++)
+        offs[len+1] = offs[len] + h.count[len];
+
+    for (int i=0; i<n; i++) {
+        if (lengths[i])
+            h.symbol[offs[lengths[i]]++] = i;
+    }
+    return left;
+}
+
+static int decode_symbol(bit_reader &br, const huffman &h)
+{
+    int code = 0, first = 0, index = 0;
+
+    for (int len=1; len<16; len++) {
+        code |= get_bits(br, 1);
+        int count = h.count[len];
+        if (code - count < first)
+            return h.symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static const uint16_t length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                         35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                         3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                       257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                       8193, 12289, 16385, 24577};
+static const uint8_t dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                       7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static int inflate_codes(bit_reader &br, std::vector<uint8_t> &out,
+                         const huffman &lencode, const huffman &distcode)
+{
+    for (;;) {
+        int sym = decode_symbol(br, lencode);
+        if ((sym < 0) || br.overrun)
+            return -1;
+
+        if (sym < 256) {
+            out.push_back(sym);
+            continue;
+        }
+        if (sym == 256)
+            return 0;
+
+        sym -= 257;
+        if (sym >= 29)
+            return -1;
+        uint32_t len = length_base[sym] + get_bits(br, length_extra[sym]);
+
+        int dsym = decode_symbol(br, distcode);
+        if ((dsym < 0) || (dsym >= 30))
+            return -1;
+        size_t dist = dist_base[dsym] + get_bits(br, dist_extra[dsym]);
+        if (dist > out.size())
+            return -1;
+
+        size_t from = out.size() - dist;
+        for (uint32_t i=0; i<len; i++) {
+            uint8_t b = out[from++];
+            out.push_back(b);
+        }
+    }
+}
+
+static int inflate_zlib(const uint8_t *data, size_t size, std::vector<uint8_t> &out)
+{
+    static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+    if ((size < 2) || ((data[0] & 0x0F) != 8) || (((data[0] << 8) | data[1]) % 31 != 0) || (data[1] & 0x20))
+        return -1;
+
+    bit_reader br = {data, size, 2, 0, 0, false};
+    huffman lencode, distcode;
+    uint8_t lengths[320];
+    int last;
+
+    do {
+        last = get_bits(br, 1);
+        int type = get_bits(br, 2);
+
+        if (type == 0) {
+            // stored: continue at byte boundary
+            get_bits(br, br.cnt & 7);
+            uint32_t len = get_bits(br, 16);
+            uint32_t nlen = get_bits(br, 16);
+            if (len != (~nlen & 0xFFFF))
+                return -1;
+            for (uint32_t i=0; i<len; i++)
+                out.push_back(get_bits(br, 8));
+        }
+        else if (type == 1) {
+            int i;
+            for (i=0; i<144; i++) lengths[i] = 8;
+            for (; i<256; i++) lengths[i] = 9;
+            for (; i<280; i++) lengths[i] = 7;
+            for (; i<288; i++) lengths[i] = 8;
+            build_huffman(lencode, lengths, 288);
+            for (i=0; i<30; i++) lengths[i] = 5;
+            build_huffman(distcode, lengths, 30);
+            if (inflate_codes(br, out, lencode, distcode) < 0)
+                return -1;
+        }
+        else if (type == 2) {
+            int nlen = get_bits(br, 5) + 257;
+            int ndist = get_bits(br, 5) + 1;
+            int ncode = get_bits(br, 4) + 4;
+            if ((nlen > 286) || (ndist > 30))
+                return -1;
+
+            memset(lengths, 0, 19);
+            for (int i=0; i<ncode; i++)
+                lengths[order[i]] = get_bits(br, 3);
+            if (build_huffman(lencode, lengths, 19) != 0)
+                return -1;
+
+            int index = 0;
+            while (index < nlen + ndist) {
+                int sym = decode_symbol(br, lencode);
+                if ((sym < 0) || br.overrun)
+                    return -1;
+                if (sym < 16) {
+                    lengths[index++] = sym;
+                    continue;
+                }
+
+                uint8_t len = 0;
+                int repeat;
+                if (sym == 16) {
+                    if (index == 0)
+                        return -1;
+                    len = lengths[index - 1];
+                    repeat = 3 + get_bits(br, 2);
+                }
+                else if (sym == 17)
+                    repeat = 3 + get_bits(br, 3);
+                else
+                    repeat = 11 + get_bits(br, 7);
+
+                if (index + repeat > nlen + ndist)
+                    return -1;
+                while (repeat--)
+                    lengths[index++] = len;
+            }
+
+            if ((lengths[256] == 0) ||
+                (build_huffman(lencode, lengths, nlen) < 0) ||
+                (build_huffman(distcode, lengths + nlen, ndist) < 0))
+                return -1;
+
+            if (inflate_codes(br, out, lencode, distcode) < 0)
+                return -1;
+        }
+        else {
+            return -1;
+        }
+
+        if (br.overrun)
+            return -1;
+    } while (!last);
+
+    return 0;
+}
+
+
+//
+// PNG
+//
+
+static inline uint32_t get_be32(const uint8_t *p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+static inline uint8_t paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if ((pa <= pb) && (pa <= pc))
+        return a;
+    if (pb <= pc)
+        return b;
+    return c;
+}
+
+// undo the scanline filters of one (sub)image in place, returns < 0 on bad filter type
+static int png_unfilter(uint8_t *data, uint32_t rows, size_t row_bytes, int bpp)
+{
+    uint8_t *prior = nullptr;
+
+    for (uint32_t y=0; y<rows; y++) {
+        uint8_t filter = data[0];
+        uint8_t *row = data + 1;
+
+        for (size_t i=0; i<row_bytes; i++) {
+            int a = (i >= bpp) ? row[i - bpp] : 0;
+            int b = prior ? prior[i] : 0;
+            int c = (prior && (i >= bpp)) ? prior[i - bpp] : 0;
+
+            switch (filter) {
+                case 0: break;
+                case 1: row[i] += a; break;
+                case 2: row[i] += b; break;
+                case 3: row[i] += (a + b) >> 1; break;
+                case 4: row[i] += paeth(a, b, c); break;
+                default: return -1;
+            }
+        }
+        prior = row;
+        data += row_bytes + 1;
+    }
+    return 0;
+}
+
+int GrayImage::loadPNG(const std::vector<uint8_t> &file)
+{
+    uint32_t w = 0, h = 0;
+    int bit_depth = 0, color_type = -1, interlace = 0;
+    std::vector<uint8_t> idat;
+    uint8_t palette[256][4];
+    int palette_size = 0;
+
+    for (int i=0; i<256; i++)
+        palette[i][0] = palette[i][1] = palette[i][2] = 0, palette[i][3] = 255;
+
+    size_t pos = 8;
+    while (pos + 12 <= file.size()) {
+        uint32_t len = get_be32(&file[pos]);
+        const uint8_t *type = &file[pos + 4];
+        const uint8_t *data = &file[pos + 8];
+        if (pos + 12 + (size_t)len > file.size())
+            break;
+
+        if (!memcmp(type, "IHDR", 4) && (len >= 13)) {
+            w = get_be32(data);
+            h = get_be32(data + 4);
+            bit_depth = data[8];
+            color_type = data[9];
+            interlace = data[12];
+        }
+        else if (!memcmp(type, "PLTE", 4)) {
+            palette_size = std::min(256u, len / 3);
+            for (int i=0; i<palette_size; i++) {
+                palette[i][0] = data[3*i];
+                palette[i][1] = data[3*i+1];
+                palette[i][2] = data[3*i+2];
+            }
+        }
+        else if (!memcmp(type, "tRNS", 4) && (color_type == 3)) {
+            for (uint32_t i=0; (i<len) && (i<256); i++)
+                palette[i][3] = data[i];
+        }
+        else if (!memcmp(type, "IDAT", 4)) {
+            idat.insert(idat.end(), data, data + len);
+        }
+        else if (!memcmp(type, "IEND", 4)) {
+            break;
+        }
+        pos += 12 + len;
+    }
+
+    int channels;
+    switch (color_type) {
+        case 0: channels = 1; break;
+        case 2: channels = 3; break;
+        case 3: channels = 1; break;
+        case 4: channels = 2; break;
+        case 6: channels = 4; break;
+        default:
+            logger.ERROR() << "Unsupported PNG color type " << color_type << std::endl;
+            return -1;
+    }
+    if ((w == 0) || (h == 0) || (idat.empty()) ||
+        ((bit_depth != 1) && (bit_depth != 2) && (bit_depth != 4) && (bit_depth != 8) && (bit_depth != 16))) {
+        logger.ERROR() << "Invalid PNG header" << std::endl;
+        return -1;
+    }
+
+    std::vector<uint8_t> raw;
+    if (inflate_zlib(idat.data(), idat.size(), raw) < 0) {
+        logger.ERROR() << "Corrupt PNG image data" << std::endl;
+        return -1;
+    }
+
+    int bits_per_pixel = channels * bit_depth;
+    int bpp = std::max(1, bits_per_pixel / 8);
+
+    width = w;
+    height = h;
+    pixels.assign((size_t)w * h, 255);
+
+    // sample c of pixel x in an unfiltered row, scaled to 8 bit
+    auto sample = [&](const uint8_t *row, uint32_t x, int c) -> uint32_t {
+        if (bit_depth == 8)
+            return row[x * channels + c];
+        if (bit_depth == 16)
+            return row[2 * (x * channels + c)];
+        uint32_t bit = x * bit_depth;
+        uint32_t v = (row[bit >> 3] >> (8 - bit_depth - (bit & 7))) & ((1 << bit_depth) - 1);
+        if (color_type == 3)
+            return v;
+        return v * 255 / ((1 << bit_depth) - 1);
+    };
+
+    auto gray = [&](const uint8_t *row, uint32_t x) -> uint8_t {
+        uint32_t g, a = 255;
+        switch (color_type) {
+            case 0: g = sample(row, x, 0); break;
+            case 2: g = luma(sample(row, x, 0), sample(row, x, 1), sample(row, x, 2)); break;
+            case 3: {
+                uint32_t index = sample(row, x, 0);
+                g = luma(palette[index][0], palette[index][1], palette[index][2]);
+                a = palette[index][3];
+                break;
+            }
+            case 4: g = sample(row, x, 0); a = sample(row, x, 1); break;
+            default: g = luma(sample(row, x, 0), sample(row, x, 1), sample(row, x, 2)); a = sample(row, x, 3); break;
+        }
+        // transparent areas are paper
+        return (g * a + 255 * (255 - a) + 127) / 255;
+    };
+
+    // Adam7 passes, or the whole image as one pass
+    static const uint32_t adam7[7][4] = {{0, 0, 8, 8}, {4, 0, 8, 8}, {0, 4, 4, 8}, {2, 0, 4, 4},
+                                         {0, 2, 2, 4}, {1, 0, 2, 2}, {0, 1, 1, 2}};
+    static const uint32_t single[1][4] = {{0, 0, 1, 1}};
+    const uint32_t (*passes)[4] = interlace ? adam7 : single;
+    int pass_count = interlace ? 7 : 1;
+
+    size_t offset = 0;
+    for (int p=0; p<pass_count; p++) {
+        uint32_t x0 = passes[p][0], y0 = passes[p][1], dx = passes[p][2], dy = passes[p][3];
+        uint32_t pw = (w > x0) ? (w - x0 + dx - 1) / dx : 0;
+        uint32_t ph = (h > y0) ? (h - y0 + dy - 1) / dy : 0;
+        if ((pw == 0) || (ph == 0))
+            continue;
+
+        size_t row_bytes = ((size_t)pw * bits_per_pixel + 7) / 8;
+        if (offset + (row_bytes + 1) * ph > raw.size()) {
+            logger.ERROR() << "Less PNG data than specified." << std::endl;
+            return -1;
+        }
+        if (png_unfilter(raw.data() + offset, ph, row_bytes, bpp) < 0) {
+            logger.ERROR() << "Invalid PNG filter type" << std::endl;
+            return -1;
+        }
+
+        for (uint32_t y=0; y<ph; y++) {
+            const uint8_t *row = raw.data() + offset + y * (row_bytes + 1) + 1;
+            uint8_t *dst = pixels.data() + (size_t)(y0 + y * dy) * w;
+            for (uint32_t x=0; x<pw; x++)
+                dst[x0 + x * dx] = gray(row, x);
+        }
+        offset += (row_bytes + 1) * ph;
+    }
+    return 0;
+}
+
+
+//
+// area-average resize
+//
+
+struct area_span {
+    uint32_t first, count;
+    uint32_t weight_index;
+};
+
+// source pixels covered by each target pixel and their coverage weights
+static void area_spans(uint32_t src, uint32_t dst, std::vector<area_span> &spans, std::vector<float> &weights)
+{
+    double scale = (double)src / dst;
+
+    spans.resize(dst);
+    weights.clear();
+
+    for (uint32_t d=0; d<dst; d++) {
+        double a = d * scale;
+        double b = (d + 1) * scale;
+        uint32_t first = std::min(uint32_t(a), src - 1);
+        uint32_t last = std::min(uint32_t(ceil(b)), src); // exclusive
+        if (last <= first)
+            last = first + 1;
+
+        spans[d].first = first;
+        spans[d].count = last - first;
+        spans[d].weight_index = weights.size();
+        for (uint32_t s=first; s<last; s++) {
+            double overlap = std::min(b, double(s + 1)) - std::max(a, double(s));
+            weights.push_back(std::max(0.0, overlap) / scale);
+        }
+    }
+}
+
+// Separable box filter: each target row first accumulates its source rows over
+// the full width (a plain multiply-add over contiguous floats, which the
+// compiler vectorises), then columns are folded the same way.
+int GrayImage::resize(uint32_t new_width, uint32_t new_height, GrayImage &target)
+{
+    if ((width == 0) || (height == 0) || (new_width == 0) || (new_height == 0))
+        return -1;
+
+    std::vector<area_span> xspans, yspans;
+    std::vector<float> xweights, yweights;
+    area_spans(width, new_width, xspans, xweights);
+    area_spans(height, new_height, yspans, yweights);
+
+    std::vector<float> acc(width);
+    std::vector<uint8_t> out((size_t)new_width * new_height);
+
+    for (uint32_t Y=0; Y<new_height; Y++) {
+        const area_span &ys = yspans[Y];
+        float *accp = acc.data();
+
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        for (uint32_t k=0; k<ys.count; k++) {
+            const uint8_t *row = pixels.data() + (size_t)(ys.first + k) * width;
+            float wk = yweights[ys.weight_index + k];
+            for (uint32_t x=0; x<width; x++)
+                accp[x] += wk * row[x];
+        }
+
+        uint8_t *dst = out.data() + (size_t)Y * new_width;
+        for (uint32_t X=0; X<new_width; X++) {
+            const area_span &xs = xspans[X];
+            const float *wx = xweights.data() + xs.weight_index;
+            const float *src = accp + xs.first;
+            float sum = 0;
+            for (uint32_t k=0; k<xs.count; k++)
+                sum += wx[k] * src[k];
+            dst[X] = uint8_t(std::clamp(sum + 0.5f, 0.0f, 255.0f));
+        }
+    }
+
+    target.width = new_width;
+    target.height = new_height;
+    target.pixels.swap(out);
+    return 0;
+}
+
+
+// keep aspect ratio
+int GrayImage::resize_to_height(uint32_t new_height, GrayImage &target)
+{
+    if (height == 0)
+        return -1;
+
+    uint32_t new_width = std::max(1u, uint32_t(round((double)width * new_height / height)));
+    return resize(new_width, new_height, target);
+}
+
+
+// Otsu's method: level that best separates dark and light pixels,
+// returned as threshold for "darker than"
+uint8_t GrayImage::otsu_threshold()
+{
+    uint64_t histogram[256] = {0};
+
+    for (size_t i=0; i<pixels.size(); i++)
+        histogram[pixels[i]]++;
+
+    double total = pixels.size();
+    double sum_all = 0;
+    for (int i=0; i<256; i++)
+        sum_all += (double)i * histogram[i];
+
+    double sum_dark = 0, weight_dark = 0, best = -1;
+    int level = 127;
+
+    for (int t=0; t<255; t++) {
+        weight_dark += histogram[t];
+        if (weight_dark == 0)
+            continue;
+        double weight_light = total - weight_dark;
+        if (weight_light == 0)
+            break;
+
+        sum_dark += (double)t * histogram[t];
+        double mean_dark = sum_dark / weight_dark;
+        double mean_light = (sum_all - sum_dark) / weight_light;
+        double between = weight_dark * weight_light * (mean_dark - mean_light) * (mean_dark - mean_light);
+        if (between > best) {
+            best = between;
+            level = t;
+        }
+    }
+    return level + 1;
+}
+
+
+int GrayImage::threshold(uint8_t thr, TypeBitmap &TBM)
+{
+    if (pixels.empty())
+        return -1;
+
+    if (TBM.newBitmap(width, height) < 0) {
+        logger.ERROR() << "Bitmap buffer allocation failed" << std::endl;
+        return -1;
+    }
+
+    uint8_t *bm = TBM.getAddress();
+    for (size_t i=0; i<pixels.size(); i++)
+        bm[i] = (pixels[i] < thr) ? 255 : 0;
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "MeshCheck.h"
+#include "TypeVolume.h"
+#include "TypeSlicer.h"
+#include "MeshSlicer.h"
+#include "AppStats.h"
+#include <cmath>
+#include <boost/format.hpp>
+
+
+int validate_mesh(TypeBitmap &TBM, reduced_foot foot, std::vector<nick> &nicks,
+                  float UVstretchXY, float UVstretchZ, float tolerance_pct, mesh_validation &result)
+{
+    STATS_TIMER("check mesh");
+    result = (mesh_validation){};
+
+    if (TBM.check_mesh(result.mesh) < 0)
+        return -1;
+
+    TypeVolume volume;
+    if (volume.build(TBM, foot, nicks, UVstretchXY, UVstretchZ) < 0)
+        return -1;
+    result.expected_voxels = volume.voxel_count();
+
+    if (result.expected_voxels)
+        result.volume_error_pct = 100.0 * (result.mesh.volume - result.expected_voxels) / result.expected_voxels;
+
+    result.watertight = (result.mesh.hole_area == 0) && (result.mesh.shared_edges == 0);
+    result.volume_ok = (result.expected_voxels > 0) && (fabs(result.volume_error_pct) <= tolerance_pct);
+
+    STATS_COUNT("check mesh", result.mesh.triangles);
+    return 0;
+}
+
+
+std::string describe_validation(mesh_validation &result)
+{
+    mesh_check &m = result.mesh;
+
+    return (boost::format("%u triangles, %u edges (%u open, hole area %.1f, %u shared, %u non-manifold), "
+                          "%u degenerate, volume %.0f of %u voxels (%+.2f%%)")
+            % m.triangles % m.edges % m.open_edges % m.hole_area % m.shared_edges % m.nonmanifold_edges % m.degenerate
+            % m.volume % result.expected_voxels % result.volume_error_pct).str();
+}
+
+
+int raster_check(TypeBitmap &TBM, reduced_foot foot, std::vector<nick> &nicks,
+                 float UVstretchXY, float UVstretchZ, uint32_t step, raster_validation &result)
+{
+    STATS_TIMER("raster check");
+    result = (raster_validation){0, 0, 0, 0, 0, -1, -1, -1};
+
+    std::vector<pos3d_t> mesh_vertices;
+    std::vector<idx_tri_t> mesh_triangles;
+    if (TBM.getMesh(mesh_vertices, mesh_triangles) < 0)
+        return -1;
+
+    TypeSlicer slicer;
+    if (slicer.setup(TBM, foot, nicks, UVstretchXY, UVstretchZ) < 0)
+        return -1;
+
+    dim_t TH, DOD, raster_size, layer_height;
+    TBM.get_type_parameters(TH, DOD, raster_size, layer_height);
+
+    MeshSlicer mesh_slicer;
+    if (mesh_slicer.setup(mesh_vertices, mesh_triangles, raster_size.as_mm(), layer_height.as_mm(),
+                          slicer.getWidth(), slicer.getHeight()) < 0)
+        return -1;
+
+    layer_section expected, sliced;
+    for (int32_t z = slicer.z_top(); z > slicer.z_bottom(); z -= std::max(step, 1u)) {
+        if ((slicer.section(z, expected) < 0) || (mesh_slicer.section(z, sliced) < 0))
+            return -1;
+
+        int32_t x, y;
+        uint64_t diff = diff_sections(expected, sliced, slicer.getHeight(), x, y);
+        result.layers++;
+        if (!diff)
+            continue;
+
+        result.bad_layers++;
+        result.mismatched += diff;
+        if (diff > result.worst_mismatched) {
+            result.worst_mismatched = diff;
+            result.worst_z = z;
+        }
+        if (result.first_z < 0) {
+            result.first_x = x;
+            result.first_y = y;
+            result.first_z = z;
+        }
+    }
+
+    STATS_COUNT("raster check", result.layers);
+    return 0;
+}
+
+
+std::string describe_raster(raster_validation &result)
+{
+    if (!result.mismatched)
+        return (boost::format("%u layers match") % result.layers).str();
+
+    return (boost::format("%u of %u layers differ, %u pixels; worst layer %d (%u pixels), first at x %d y %d layer %d")
+            % result.bad_layers % result.layers % result.mismatched % result.worst_z % result.worst_mismatched
+            % result.first_x % result.first_y % result.first_z).str();
+}
@@ -0,0 +1,152 @@
+#include "MeshPlan.h"
+#include <algorithm>
+#include <unordered_map>
+#include <boost/format.hpp>
+
+// fitted to generateMesh() output and timing, see MeshPlan.h
+static const double TRI_PER_CORNER = 4.06;
+static const double TRI_PER_EDGE = 4.15;
+static const double RECTS_PER_CORNER = 0.49;
+static const double S_PER_VERTEX2 = 1.3e-8;
+static const double S_PER_PIXEL = 2.5e-7;
+
+// vectors grow by doubling
+static uint64_t capacity(uint64_t n)
+{
+    uint64_t c = 1;
+    while (c < n)
+        c <<= 1;
+    return c;
+}
+
+
+int plan_mesh(TypeBitmap &TBM, std::string name, std::vector<std::string> &formats, mesh_plan &plan)
+{
+    plan = mesh_plan();
+    plan.name = name;
+    plan.valid = false;
+    plan.duplicate_of = -1;
+
+    if (TBM.measure(plan.stats) < 0)
+        return -1;
+    plan.hash = TBM.hash();
+
+    bitmap_stats &s = plan.stats;
+    plan.rects = uint64_t(RECTS_PER_CORNER * s.corners);
+    plan.triangles = uint64_t(TRI_PER_CORNER * s.corners + TRI_PER_EDGE * (s.row_edges + s.col_edges));
+    plan.vertices = plan.triangles / 2 + 2; // closed mesh
+
+    plan.mesh_bytes = s.pixels * (sizeof(uint8_t) + sizeof(int32_t))  // bitmap, tag bitmap
+                      + plan.rects * 7 * sizeof(int32_t)
+                      + capacity(plan.vertices) * 3 * sizeof(int32_t)
+                      + capacity(plan.triangles) * 6 * sizeof(int32_t);
+
+    plan.output_bytes = 0;
+    for (std::string &format : formats) {
+        if (format == "stl")
+            plan.output_bytes += 84 + 50 * plan.triangles;
+        else if (format == "obj")
+            plan.output_bytes += uint64_t(6.4 * plan.vertices + 23.1 * plan.triangles);
+        else if (format == "ply")
+            plan.output_bytes += 200 + 12 * plan.vertices + 13 * plan.triangles;
+        else if (format == "3mf")
+            plan.output_bytes += uint64_t(31.4 * plan.vertices + 53.1 * plan.triangles);
+    }
+
+    plan.seconds = S_PER_VERTEX2 * double(plan.vertices) * plan.vertices + S_PER_PIXEL * s.pixels;
+    plan.valid = true;
+    return 0;
+}
+
+
+void mark_duplicates(std::vector<mesh_plan> &plans, const std::vector<packed_bitmap> &bitmaps)
+{
+    std::unordered_map<uint64_t, std::vector<int>> first; // distinct bitmaps per hash
+
+    for (size_t i = 0; i < plans.size(); i++) {
+        if (!plans[i].valid) // failed loads all look alike, but are not the same bitmap
+            continue;
+
+        std::vector<int> &same_hash = first[plans[i].hash];
+        for (int j : same_hash) {
+            if (bitmaps[j] == bitmaps[i]) {
+                plans[i].duplicate_of = j;
+                break;
+            }
+        }
+        if (plans[i].duplicate_of < 0)
+            same_hash.push_back(i);
+    }
+}
+
+
+std::vector<size_t> largest_first(std::vector<mesh_plan> &plans)
+{
+    std::vector<size_t> order;
+
+    for (size_t i = 0; i < plans.size(); i++)
+        if (plans[i].valid && (plans[i].duplicate_of < 0))
+            order.push_back(i);
+
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return plans[a].seconds > plans[b].seconds; });
+    return order;
+}
+
+
+void write_plan(std::ostream &out, std::vector<mesh_plan> &plans, uint32_t jobs)
+{
+    uint64_t triangles = 0, output_bytes = 0, max_mesh_bytes = 0;
+    double seconds = 0;
+    uint32_t duplicates = 0, failed = 0;
+
+    out << boost::format("%-16s %11s %6s %8s %7s %10s %9s %10s %8s\n")
+           % "bitmap" % "pixels" % "ink %" % "corners" % "rects" % "triangles" % "mesh MB" % "output MB" % "est s";
+
+    for (mesh_plan &p : plans) {
+        std::string size = (boost::format("%u") % p.stats.pixels).str();
+        double ink_pct = p.stats.pixels ? 100.0 * p.stats.ink / p.stats.pixels : 0;
+
+        if (!p.valid) {
+            out << boost::format("%-16s   could not be loaded or measured\n") % p.name;
+            failed++;
+            continue;
+        }
+        if (p.duplicate_of >= 0) {
+            out << boost::format("%-16s %11s %6.1f   same as %s\n") % p.name % size % ink_pct % plans[p.duplicate_of].name;
+            duplicates++;
+            continue;
+        }
+
+        out << boost::format("%-16s %11s %6.1f %8u %7u %10u %9.2f %10.2f %8.2f\n")
+               % p.name % size % ink_pct % p.stats.corners % p.rects % p.triangles
+               % (p.mesh_bytes / 1048576.0) % (p.output_bytes / 1048576.0) % p.seconds;
+
+        triangles += p.triangles;
+        output_bytes += p.output_bytes;
+        max_mesh_bytes = std::max(max_mesh_bytes, p.mesh_bytes);
+        seconds += p.seconds;
+    }
+
+    // largest first onto the job that frees up first
+    std::vector<size_t> order = largest_first(plans);
+    std::vector<double> busy(std::max(jobs, 1u), 0.0);
+    for (size_t i : order)
+        *std::min_element(busy.begin(), busy.end()) += plans[i].seconds;
+    double wall = order.empty() ? 0 : *std::max_element(busy.begin(), busy.end());
+
+    uint64_t jobs_mesh_bytes = 0;
+    std::vector<uint64_t> mesh_bytes;
+    for (size_t i : order)
+        mesh_bytes.push_back(plans[i].mesh_bytes);
+    std::sort(mesh_bytes.rbegin(), mesh_bytes.rend());
+    for (size_t i = 0; (i < busy.size()) && (i < mesh_bytes.size()); i++)
+        jobs_mesh_bytes += mesh_bytes[i];
+
+    out << boost::format("\n%u bitmaps, %u to mesh (%u identical to an earlier one, %u failed)\n")
+           % plans.size() % order.size() % duplicates % failed;
+    out << boost::format("triangles %u, output %.2f MB, largest mesh %.2f MB\n")
+           % triangles % (output_bytes / 1048576.0) % (max_mesh_bytes / 1048576.0);
+    out << boost::format("meshing %.1f s; with %u job(s), largest first: %.1f s, up to %.2f MB mesh memory\n")
+           % seconds % busy.size() % wall % (jobs_mesh_bytes / 1048576.0);
+}
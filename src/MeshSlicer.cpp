@@ -0,0 +1,160 @@
+#include "MeshSlicer.h"
+#include "AppLog.h"
+#include <cmath>
+#include <algorithm>
+
+extern AppLog logger;
+
+
+MeshSlicer::MeshSlicer() : w(0), h(0), RS(0), LH(0), next(0), last_zc(0) {}
+
+
+int MeshSlicer::setup(const std::vector<pos3d_t> &vertices, const std::vector<idx_tri_t> &triangles,
+                      float raster_mm, float layer_mm, uint32_t width, uint32_t height)
+{
+    if ((raster_mm <= 0) || (layer_mm <= 0)) {
+        logger.ERROR() << "Raster size and layer height required for slicing." << std::endl;
+        return -1;
+    }
+
+    w = width;
+    h = height;
+    RS = raster_mm;
+    LH = layer_mm;
+
+    verts.resize(vertices.size());
+    for (size_t i=0; i<vertices.size(); i++)
+        verts[i] = (pos3d_t) {vertices[i].x / RS, -vertices[i].y / RS, vertices[i].z / LH};
+
+    tris = triangles;
+    by_top.resize(tris.size());
+    for (size_t i=0; i<tris.size(); i++) {
+        float z1 = verts[tris[i].v1].z, z2 = verts[tris[i].v2].z, z3 = verts[tris[i].v3].z;
+        by_top[i] = (tri_span) {std::min({z1, z2, z3}), std::max({z1, z2, z3}), uint32_t(i)};
+    }
+    std::sort(by_top.begin(), by_top.end(),
+              [](const tri_span &a, const tri_span &b) { return a.z_hi > b.z_hi; });
+
+    active.clear();
+    next = 0;
+    last_zc = INFINITY;
+
+    return 0;
+}
+
+
+int MeshSlicer::section(int32_t z, layer_section &S)
+{
+    float zc = z - 0.5f;
+
+    if (w == 0)
+        return -1;
+
+    if (zc > last_zc) { // going up: start over
+        active.clear();
+        next = 0;
+    }
+    last_zc = zc;
+
+    // triangles reaching up to the plane, then drop those entirely above it
+    while ((next < by_top.size()) && (by_top[next].z_hi > zc))
+        active.push_back(next++);
+
+    size_t kept = 0;
+    for (size_t i=0; i<active.size(); i++)
+        if (by_top[active[i]].z_lo < zc)
+            active[kept++] = active[i];
+    active.resize(kept);
+
+    // where each row's center line crosses the cut of each triangle
+    crossings.clear();
+    for (uint32_t a : active) {
+        idx_tri_t &T = tris[by_top[a].index];
+        uint32_t v[3] = {T.v1, T.v2, T.v3};
+        pos3d_t P[2];
+        int n = 0;
+
+        for (int k=0; (k<3) && (n<2); k++) {
+            // same vertex order for an edge in both its triangles: bit-identical cuts
+            uint32_t i0 = std::min(v[k], v[(k+1)%3]);
+            uint32_t i1 = std::max(v[k], v[(k+1)%3]);
+            pos3d_t &p = verts[i0];
+            pos3d_t &q = verts[i1];
+
+            if ((p.z < zc) == (q.z < zc))
+                continue;
+            float t = (zc - p.z) / (q.z - p.z);
+            P[n++] = (pos3d_t) {p.x + t*(q.x - p.x), p.y + t*(q.y - p.y), zc};
+        }
+        if (n < 2)
+            continue;
+
+        if (P[0].y > P[1].y)
+            std::swap(P[0], P[1]);
+
+        // rows with centers in [y0, y1)
+        int32_t r0 = std::max(int32_t(ceilf(P[0].y - 0.5f)), 0);
+        int32_t r1 = std::min(int32_t(ceilf(P[1].y - 0.5f)), h);
+        for (int32_t r=r0; r<r1; r++) {
+            float t = (r + 0.5f - P[0].y) / (P[1].y - P[0].y);
+            crossings.push_back((crossing) {r, P[0].x + t*(P[1].x - P[0].x)});
+        }
+    }
+
+    std::sort(crossings.begin(), crossings.end(),
+              [](const crossing &a, const crossing &b) { return (a.row < b.row) || ((a.row == b.row) && (a.x < b.x)); });
+
+    // even-odd: pixel centers between the 1st and 2nd, 3rd and 4th ... crossing
+    clear_section(S);
+    size_t c = 0;
+    for (int32_t r=0; r<h; r++) {
+        size_t c0 = c;
+        while ((c < crossings.size()) && (crossings[c].row == r))
+            c++;
+        for (size_t k=c0; k+1<c; k+=2) {
+            int32_t x0 = std::max(int32_t(ceilf(crossings[k].x - 0.5f)), 0);
+            int32_t x1 = std::min(int32_t(ceilf(crossings[k+1].x - 0.5f)), w);
+            push_run(S, x0, x1);
+        }
+        end_row(S);
+    }
+
+    return 0;
+}
+
+
+uint64_t diff_sections(const layer_section &A, const layer_section &B, uint32_t height,
+                       int32_t &first_x, int32_t &first_y)
+{
+    uint64_t diff = 0;
+    std::vector<int32_t> edges;
+
+    first_x = first_y = -1;
+
+    // membership in A xor B flips at every run boundary of either
+    for (uint32_t y=0; y<height; y++) {
+        edges.clear();
+        for (uint32_t i=A.row_start[y]; i<A.row_start[y+1]; i++) {
+            edges.push_back(A.runs[i].x0);
+            edges.push_back(A.runs[i].x1);
+        }
+        size_t mid = edges.size();
+        for (uint32_t i=B.row_start[y]; i<B.row_start[y+1]; i++) {
+            edges.push_back(B.runs[i].x0);
+            edges.push_back(B.runs[i].x1);
+        }
+        std::inplace_merge(edges.begin(), edges.begin() + mid, edges.end());
+
+        for (size_t k=0; k+1<edges.size(); k+=2) {
+            if (edges[k+1] == edges[k])
+                continue;
+            if (first_y < 0) {
+                first_x = edges[k];
+                first_y = y;
+            }
+            diff += edges[k+1] - edges[k];
+        }
+    }
+
+    return diff;
+}
@@ -0,0 +1,398 @@
+#include "MeshWriter.h"
+#include "AppLog.h"
+#include <charconv>
+#include <cstring>
+#include <cstdio>
+#include <bit>
+
+extern AppLog logger;
+
+static uint32_t crc32_update(uint32_t c, const char *data, size_t n);
+
+
+OutBuffer::OutBuffer(size_t block_size) : fill(0), total(0), crc_on(false), crc(0), crc_from(0)
+{
+    buf.resize(block_size);
+}
+
+
+OutBuffer::~OutBuffer()
+{
+    close();
+}
+
+
+int OutBuffer::open(std::string filename)
+{
+    fill = 0;
+    total = 0;
+    crc_on = false;
+    out.open(filename, std::ios::binary);
+    if (!out.is_open())
+        return -1;
+
+    return 0;
+}
+
+
+bool OutBuffer::is_open()
+{
+    return out.is_open();
+}
+
+
+int OutBuffer::close()
+{
+    if (!out.is_open())
+        return 0;
+
+    drain();
+    out.close();
+
+    return out.fail() ? -1 : 0;
+}
+
+
+void OutBuffer::drain()
+{
+    if (fill) {
+        if (crc_on) {
+            crc = crc32_update(crc, &buf[crc_from], fill - crc_from);
+            crc_from = 0;
+        }
+        out.write(buf.data(), fill);
+        total += fill;
+        fill = 0;
+    }
+}
+
+
+void OutBuffer::put(char c)
+{
+    if (fill == buf.size())
+        drain();
+    buf[fill++] = c;
+}
+
+
+void OutBuffer::put(const char *s, size_t n)
+{
+    if (fill + n > buf.size()) {
+        drain();
+        if (n > buf.size()) { // oversized block goes straight through
+            if (crc_on)
+                crc = crc32_update(crc, s, n);
+            out.write(s, n);
+            total += n;
+            return;
+        }
+    }
+    memcpy(&buf[fill], s, n);
+    fill += n;
+}
+
+
+void OutBuffer::put(const char *s)
+{
+    put(s, strlen(s));
+}
+
+
+void OutBuffer::put(const std::string &s)
+{
+    put(s.data(), s.size());
+}
+
+
+void OutBuffer::put_float(float f)
+{
+    const size_t MAX_FLOAT_CHARS = 32;
+
+    if (fill + MAX_FLOAT_CHARS > buf.size())
+        drain();
+
+    char *start = &buf[fill];
+    std::to_chars_result res = std::to_chars(start, start + MAX_FLOAT_CHARS, f);
+    fill += (res.ptr - start);
+}
+
+
+void OutBuffer::put_uint(uint32_t u)
+{
+    const size_t MAX_UINT_CHARS = 10;
+
+    if (fill + MAX_UINT_CHARS > buf.size())
+        drain();
+
+    char *start = &buf[fill];
+    std::to_chars_result res = std::to_chars(start, start + MAX_UINT_CHARS, u);
+    fill += (res.ptr - start);
+}
+
+
+uint64_t OutBuffer::bytes_written()
+{
+    return total + fill;
+}
+
+
+void OutBuffer::start_crc()
+{
+    crc_on = true;
+    crc = 0xFFFFFFFF;
+    crc_from = fill;
+}
+
+
+uint32_t OutBuffer::end_crc()
+{
+    crc = crc32_update(crc, &buf[crc_from], fill - crc_from);
+    crc_on = false;
+
+    return crc ^ 0xFFFFFFFF;
+}
+
+
+int writePLY(std::string filename, const std::vector<pos3d_t> &vertices, const std::vector<idx_tri_t> &triangles)
+{
+    static_assert(std::endian::native == std::endian::little,
+                  "PLY writer assumes a little-endian host");
+
+    OutBuffer ply_out;
+    if (ply_out.open(filename) < 0)
+        return -1;
+
+    std::string header = "ply\n"
+                         "format binary_little_endian 1.0\n"
+                         "comment exported from typegen\n"
+                         "element vertex " + std::to_string(vertices.size()) + "\n"
+                         "property float x\n"
+                         "property float y\n"
+                         "property float z\n"
+                         "element face " + std::to_string(triangles.size()) + "\n"
+                         "property list uchar uint vertex_indices\n"
+                         "end_header\n";
+    ply_out.put(header);
+
+    ply_out.put((const char*)vertices.data(), vertices.size() * sizeof(pos3d_t));
+
+    char face[13];
+    face[0] = 3; // vertex count of each face
+    for (size_t i=0; i<triangles.size(); i++) {
+        memcpy(&face[1], &triangles[i], 12);
+        ply_out.put(face, 13);
+    }
+
+    return ply_out.close();
+}
+
+
+// 3MF: OPC package as a ZIP container with stored (uncompressed) entries
+
+struct crc32_table_t {
+    uint32_t t[256];
+
+    crc32_table_t()
+    {
+        for (uint32_t n=0; n<256; n++) {
+            uint32_t c = n;
+            for (int k=0; k<8; k++)
+                c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+            t[n] = c;
+        }
+    }
+};
+
+// running CRC without the final inversion; plates are written from several threads
+static uint32_t crc32_update(uint32_t c, const char *data, size_t n)
+{
+    static const crc32_table_t table;
+
+    for (size_t i=0; i<n; i++)
+        c = table.t[(c ^ (uint8_t)data[i]) & 0xFF] ^ (c >> 8);
+
+    return c;
+}
+
+static uint32_t crc32(const std::string &data)
+{
+    return crc32_update(0xFFFFFFFF, data.data(), data.size()) ^ 0xFFFFFFFF;
+}
+
+static void put_le16(OutBuffer &out, uint16_t v)
+{
+    char b[2] = { char(v & 0xFF), char(v >> 8) };
+    out.put(b, 2);
+}
+
+static void put_le32(OutBuffer &out, uint32_t v)
+{
+    char b[4] = { char(v & 0xFF), char((v >> 8) & 0xFF), char((v >> 16) & 0xFF), char(v >> 24) };
+    out.put(b, 4);
+}
+
+// The model part is formatted straight into the output buffer: its local
+// header has the sizes and CRC zeroed and flag bit 3 set, they follow the data
+// in a data descriptor. No ZIP64, so the package must stay below 4 GiB.
+int write3MF(std::string filename, const std::vector<pos3d_t> &vertices, const std::vector<idx_tri_t> &triangles)
+{
+    struct zip_entry {
+        std::string name;
+        std::string data; // empty for the streamed model
+        uint16_t flags;
+        uint32_t crc;
+        uint64_t size;
+        uint64_t offset;
+    };
+    std::vector<zip_entry> entries(3);
+
+    entries[0].name = "[Content_Types].xml";
+    entries[0].data =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">\n"
+        " <Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>\n"
+        " <Default Extension=\"model\" ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\"/>\n"
+        "</Types>\n";
+
+    entries[1].name = "_rels/.rels";
+    entries[1].data =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">\n"
+        " <Relationship Target=\"/3D/3dmodel.model\" Id=\"rel0\" "
+        "Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\"/>\n"
+        "</Relationships>\n";
+
+    entries[2].name = "3D/3dmodel.model";
+
+    const size_t MODEL = 2;
+    const uint16_t ZIP_VERSION = 20;
+    const uint16_t DATA_DESCRIPTOR = 1 << 3;
+    const uint16_t DOS_TIME = 0;
+    const uint16_t DOS_DATE = (1 << 5) | 1; // 1980-01-01
+
+    OutBuffer zip_out;
+    if (zip_out.open(filename) < 0)
+        return -1;
+
+    // local file headers + data
+    for (size_t i=0; i<entries.size(); i++) {
+        zip_entry &e = entries[i];
+        e.flags = (i == MODEL) ? DATA_DESCRIPTOR : 0;
+        e.crc = (i == MODEL) ? 0 : crc32(e.data);
+        e.size = (i == MODEL) ? 0 : e.data.size();
+        e.offset = zip_out.bytes_written();
+
+        put_le32(zip_out, 0x04034b50);
+        put_le16(zip_out, ZIP_VERSION);
+        put_le16(zip_out, e.flags);
+        put_le16(zip_out, 0); // stored
+        put_le16(zip_out, DOS_TIME);
+        put_le16(zip_out, DOS_DATE);
+        put_le32(zip_out, e.crc);
+        put_le32(zip_out, (uint32_t)e.size); // compressed size
+        put_le32(zip_out, (uint32_t)e.size); // uncompressed size
+        put_le16(zip_out, (uint16_t)e.name.size());
+        put_le16(zip_out, 0); // extra field length
+        zip_out.put(e.name);
+
+        if (i != MODEL) {
+            zip_out.put(e.data);
+            continue;
+        }
+
+        uint64_t start = zip_out.bytes_written();
+        zip_out.start_crc();
+        zip_out.put(
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<model unit=\"millimeter\" xml:lang=\"en-US\" "
+            "xmlns=\"http://schemas.microsoft.com/3dmanufacturing/core/2015/02\">\n"
+            " <resources>\n"
+            "  <object id=\"1\" type=\"model\">\n"
+            "   <mesh>\n"
+            "    <vertices>\n");
+        for (size_t v=0; v<vertices.size(); v++) {
+            zip_out.put("     <vertex x=\"");
+            zip_out.put_float(vertices[v].x);
+            zip_out.put("\" y=\"");
+            zip_out.put_float(vertices[v].y);
+            zip_out.put("\" z=\"");
+            zip_out.put_float(vertices[v].z);
+            zip_out.put("\"/>\n");
+        }
+        zip_out.put(
+            "    </vertices>\n"
+            "    <triangles>\n");
+        for (size_t t=0; t<triangles.size(); t++) {
+            zip_out.put("     <triangle v1=\"");
+            zip_out.put_uint(triangles[t].v1);
+            zip_out.put("\" v2=\"");
+            zip_out.put_uint(triangles[t].v2);
+            zip_out.put("\" v3=\"");
+            zip_out.put_uint(triangles[t].v3);
+            zip_out.put("\"/>\n");
+        }
+        zip_out.put(
+            "    </triangles>\n"
+            "   </mesh>\n"
+            "  </object>\n"
+            " </resources>\n"
+            " <build>\n"
+            "  <item objectid=\"1\"/>\n"
+            " </build>\n"
+            "</model>\n");
+        e.crc = zip_out.end_crc();
+        e.size = zip_out.bytes_written() - start;
+
+        put_le32(zip_out, 0x08074b50); // data descriptor
+        put_le32(zip_out, e.crc);
+        put_le32(zip_out, (uint32_t)e.size);
+        put_le32(zip_out, (uint32_t)e.size);
+    }
+
+    // central directory
+    uint64_t cd_offset = zip_out.bytes_written();
+    for (size_t i=0; i<entries.size(); i++) {
+        zip_entry &e = entries[i];
+
+        put_le32(zip_out, 0x02014b50);
+        put_le16(zip_out, ZIP_VERSION); // made by
+        put_le16(zip_out, ZIP_VERSION); // needed to extract
+        put_le16(zip_out, e.flags);
+        put_le16(zip_out, 0);
+        put_le16(zip_out, DOS_TIME);
+        put_le16(zip_out, DOS_DATE);
+        put_le32(zip_out, e.crc);
+        put_le32(zip_out, (uint32_t)e.size);
+        put_le32(zip_out, (uint32_t)e.size);
+        put_le16(zip_out, (uint16_t)e.name.size());
+        put_le16(zip_out, 0); // extra field length
+        put_le16(zip_out, 0); // comment length
+        put_le16(zip_out, 0); // disk number
+        put_le16(zip_out, 0); // internal attributes
+        put_le32(zip_out, 0); // external attributes
+        put_le32(zip_out, (uint32_t)e.offset);
+        zip_out.put(e.name);
+    }
+    uint64_t cd_size = zip_out.bytes_written() - cd_offset;
+
+    // every size and offset is 32 bit; the central directory ends last
+    if (cd_offset + cd_size > UINT32_MAX) {
+        zip_out.close();
+        remove(filename.c_str());
+        logger.ERROR() << "3MF package " << filename << " would be " << cd_offset + cd_size
+                       << " bytes, over the 4 GiB ZIP limit (no ZIP64)" << std::endl;
+        return -1;
+    }
+
+    // end of central directory record
+    put_le32(zip_out, 0x06054b50);
+    put_le16(zip_out, 0);
+    put_le16(zip_out, 0);
+    put_le16(zip_out, (uint16_t)entries.size());
+    put_le16(zip_out, (uint16_t)entries.size());
+    put_le32(zip_out, (uint32_t)cd_size);
+    put_le32(zip_out, (uint32_t)cd_offset);
+    put_le16(zip_out, 0); // comment length
+
+    return zip_out.close();
+}
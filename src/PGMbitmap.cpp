@@ -1,4 +1,5 @@
 #include "PGMbitmap.h"
+#include "AppStats.h"
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -45,7 +46,7 @@ int PGMbitmap::newBitmap(uint32_t width, uint32_t height)
     bm_height = height;
     max_value = 255;
 
-    bitmap = (uint8_t*)calloc(bm_width*bm_height, sizeof(uint8_t));
+    bitmap = (uint8_t*)stats_calloc(POOL_PGM, bm_width*bm_height, sizeof(uint8_t));
 
     if (bitmap != NULL) {
         loaded = true;
@@ -155,7 +156,7 @@ int PGMbitmap::loadPBM(std::string filename)
         return -1;
     }
 
-    bitmap = (uint8_t*)calloc(size = bm_width*bm_height, sizeof(uint8_t));
+    bitmap = (uint8_t*)stats_calloc(POOL_PGM, size = bm_width*bm_height, sizeof(uint8_t));
     if (bitmap == NULL) {
         std::cerr << "ERROR: Bitmap buffer allocation failed" << std::endl;
         pbm.close();
@@ -178,7 +179,7 @@ int PGMbitmap::loadPBM(std::string filename)
                 case '1':
                     if (count == size) {
                         std::cerr << "ERROR: More data than specified." << std::endl;
-                        free(bitmap);
+                        stats_free(POOL_PGM, bitmap);
                         bitmap = NULL;
                         pbm.close();
                         return -1;
@@ -210,7 +211,7 @@ int PGMbitmap::loadPBM(std::string filename)
         while(!pbm.eof()) {
             if (count >= size) { // file should have ended
                 std::cerr << "ERROR: More data than specified." << std::endl;
-                free(bitmap);
+                stats_free(POOL_PGM, bitmap);
                 bitmap = NULL;
                 pbm.close();
                 return -1;
@@ -239,7 +240,7 @@ int PGMbitmap::loadPBM(std::string filename)
 
     if (count != size) {
         std::cerr << "Less data than specified." << std::endl;
-        free(bitmap);
+        stats_free(POOL_PGM, bitmap);
         bitmap = NULL;
         pbm.close();
         return -1;
@@ -299,7 +300,7 @@ int PGMbitmap::loadPGM(std::string filename)
 
     pgm.get(); // whitespace after height
 
-    bitmap = (uint8_t*)calloc(size = bm_width*bm_height, sizeof(uint8_t));
+    bitmap = (uint8_t*)stats_calloc(POOL_PGM, size = bm_width*bm_height, sizeof(uint8_t));
     if (bitmap == NULL) {
         std::cerr << "ERROR: Bitmap buffer allocation failed" << std::endl;
         pgm.close();
@@ -336,7 +337,7 @@ int PGMbitmap::loadPGM(std::string filename)
             if ((c>='0') && (c<='9')) {
                 if (count == size) {
                     std::cerr << "ERROR: More data than specified." << std::endl;
-                    free(bitmap);
+                    stats_free(POOL_PGM, bitmap);
                     bitmap = NULL;
                     pgm.close();
                     return -1;
@@ -373,7 +374,7 @@ int PGMbitmap::loadPGM(std::string filename)
         while(!pgm.eof()) {
             if (count >= size) { // file should have ended
                 std::cerr << "ERROR: More data than specified." << std::endl;
-                free(bitmap);
+                stats_free(POOL_PGM, bitmap);
                 bitmap = NULL;
                 pgm.close();
                 return -1;
@@ -387,7 +388,7 @@ int PGMbitmap::loadPGM(std::string filename)
 
     if (count != size) {
         std::cerr << "Less data than specified." << std::endl;
-        free(bitmap);
+        stats_free(POOL_PGM, bitmap);
         bitmap = NULL;
         pgm.close();
         return -1;
@@ -403,7 +404,7 @@ int PGMbitmap::loadPGM(std::string filename)
 void PGMbitmap::unload()
 {
     if (bitmap != NULL) {
-        free(bitmap);
+        stats_free(POOL_PGM, bitmap);
     }
     bitmap = NULL;
     loaded = false;
@@ -0,0 +1,724 @@
+#include "PlateAssembler.h"
+#include "MeshWriter.h"
+#include "AppLog.h"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cfloat>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+extern AppLog logger;
+
+
+// MaxRects bin packing, best short side fit
+// (J. Jylaenki, "A Thousand Ways to Pack the Bin")
+struct rect_t {
+    float x, y, w, h;
+};
+
+class MaxRectsBin {
+    std::vector<rect_t> free_rects;
+
+    void split(const rect_t &used);
+    void prune();
+
+    public:
+        MaxRectsBin(float W, float H);
+        bool insert(float w, float h, bool allow_rotation, rect_t &placed, bool &rotated);
+};
+
+// welded plate mesh for the indexed output formats (PLY, 3MF)
+struct vertex_key {
+    uint32_t x, y, z; // float bit patterns
+    bool operator==(const vertex_key &o) const { return (x == o.x) && (y == o.y) && (z == o.z); }
+};
+
+struct vertex_key_hash {
+    size_t operator()(const vertex_key &k) const {
+        uint64_t h = k.x * 0x9E3779B97F4A7C15ull;
+        h ^= k.y + 0x7F4A7C15ull + (h << 6) + (h >> 2);
+        h ^= k.z + 0x9E3779B9ull + (h << 6) + (h >> 2);
+        return size_t(h);
+    }
+};
+
+
+// rotate normal and vertices of one record (12 floats) by 90 degrees about Z
+static inline void rotate_record(float f[12])
+{
+    for (int i=0; i<12; i+=3) {
+        float x = f[i];
+        f[i] = -f[i+1];
+        f[i+1] = x;
+    }
+}
+
+
+MaxRectsBin::MaxRectsBin(float W, float H)
+{
+    free_rects.push_back((rect_t) {0, 0, W, H});
+}
+
+bool MaxRectsBin::insert(float w, float h, bool allow_rotation, rect_t &placed, bool &rotated)
+{
+    float best_short = FLT_MAX;
+    float best_long = FLT_MAX;
+    bool found = false;
+
+    for (int i=0; i<free_rects.size(); i++) {
+        const rect_t &F = free_rects[i];
+
+        for (int r=0; r<(allow_rotation ? 2 : 1); r++) {
+            float pw = r ? h : w;
+            float ph = r ? w : h;
+            if ((pw > F.w) || (ph > F.h))
+                continue;
+
+            float short_fit = std::min(F.w - pw, F.h - ph);
+            float long_fit = std::max(F.w - pw, F.h - ph);
+            if ((short_fit < best_short) || ((short_fit == best_short) && (long_fit < best_long))) {
+                best_short = short_fit;
+                best_long = long_fit;
+                placed = (rect_t) {F.x, F.y, pw, ph};
+                rotated = (r == 1);
+                found = true;
+            }
+        }
+    }
+
+    if (!found)
+        return false;
+
+    split(placed);
+    prune();
+    return true;
+}
+
+// replace every free rectangle the new one overlaps by its (up to four) maximal remainders
+void MaxRectsBin::split(const rect_t &used)
+{
+    std::vector<rect_t> next;
+
+    for (int i=0; i<free_rects.size(); i++) {
+        rect_t F = free_rects[i];
+
+        if ((used.x >= F.x + F.w) || (used.x + used.w <= F.x) ||
+            (used.y >= F.y + F.h) || (used.y + used.h <= F.y)) {
+            next.push_back(F);
+            continue;
+        }
+
+        if (used.x > F.x)
+            next.push_back((rect_t) {F.x, F.y, used.x - F.x, F.h});
+        if (used.x + used.w < F.x + F.w)
+            next.push_back((rect_t) {used.x + used.w, F.y, F.x + F.w - used.x - used.w, F.h});
+        if (used.y > F.y)
+            next.push_back((rect_t) {F.x, F.y, F.w, used.y - F.y});
+        if (used.y + used.h < F.y + F.h)
+            next.push_back((rect_t) {F.x, used.y + used.h, F.w, F.y + F.h - used.y - used.h});
+    }
+    free_rects.swap(next);
+}
+
+// drop free rectangles contained in another one
+void MaxRectsBin::prune()
+{
+    std::vector<bool> contained(free_rects.size(), false);
+
+    for (int i=0; i<free_rects.size(); i++) {
+        const rect_t &A = free_rects[i];
+        for (int j=0; j<free_rects.size(); j++) {
+            if ((i == j) || contained[j])
+                continue;
+            const rect_t &B = free_rects[j];
+            if ((A.x >= B.x) && (A.y >= B.y) && (A.x + A.w <= B.x + B.w) && (A.y + A.h <= B.y + B.h)) {
+                contained[i] = true;
+                break;
+            }
+        }
+    }
+
+    int n = 0;
+    for (int i=0; i<free_rects.size(); i++) {
+        if (!contained[i])
+            free_rects[n++] = free_rects[i];
+    }
+    free_rects.resize(n);
+}
+
+
+PlateAssembler::PlateAssembler()
+    : platformX(0), platformY(0), gapX(0), gapY(0), auto_mode(false), allow_rotation(true), skipped(0) {}
+
+
+void PlateAssembler::set_platform(float size_X, float size_Y, float gap_X, float gap_Y)
+{
+    platformX = size_X;
+    platformY = size_Y;
+    gapX = gap_X;
+    gapY = gap_Y;
+}
+
+
+void PlateAssembler::set_layout(bool automatic, bool rotation)
+{
+    auto_mode = automatic;
+    allow_rotation = rotation;
+}
+
+
+// Bounding box over the packed records. Keeps a running min/max per vertex
+// coordinate (9 independent lanes) so the loop has no cross-lane dependency
+// and vectorises; lanes are folded into X/Y/Z at the end.
+void PlateAssembler::get_bbox(const uint8_t *records, uint32_t tri_count, mesh_bbox &bbox)
+{
+    float lo[9], hi[9], v[9];
+
+    memcpy(lo, records + 12, 36);
+    memcpy(hi, lo, 36);
+
+    for (uint32_t m=1; m<tri_count; m++) {
+        memcpy(v, records + (size_t)m * STL_RECORD_SIZE + 12, 36);
+        for (int i=0; i<9; i++) {
+            lo[i] = v[i] < lo[i] ? v[i] : lo[i];
+            hi[i] = v[i] > hi[i] ? v[i] : hi[i];
+        }
+    }
+
+    bbox.lowX = std::min({lo[0], lo[3], lo[6]});
+    bbox.lowY = std::min({lo[1], lo[4], lo[7]});
+    bbox.lowZ = std::min({lo[2], lo[5], lo[8]});
+    bbox.highX = std::max({hi[0], hi[3], hi[6]});
+    bbox.highY = std::max({hi[1], hi[4], hi[7]});
+    bbox.highZ = std::max({hi[2], hi[5], hi[8]});
+}
+
+
+// borrow packed STL records; the bounding box is measured unless given
+int PlateAssembler::add_mesh(std::string name, const uint8_t *records, uint32_t tri_count,
+                             const mesh_bbox *bbox)
+{
+    if (!records || (tri_count == 0)) {
+        logger.ERROR() << "Empty mesh " << name << " not added to plate." << std::endl;
+        return -1;
+    }
+
+    plate_mesh M;
+    M.name = name;
+    M.records = records;
+    M.tri_count = tri_count;
+    if (bbox)
+        M.bbox = *bbox;
+    else
+        get_bbox(records, tri_count, M.bbox);
+
+    meshes.push_back(M);
+    mesh_index[name] = meshes.size() - 1;
+    return meshes.size() - 1;
+}
+
+
+// copy an indexed mesh (0-based, mm) into owned STL records
+int PlateAssembler::add_mesh(std::string name, const std::vector<pos3d_t> &vertices,
+                             const std::vector<idx_tri_t> &triangles)
+{
+    if (triangles.empty()) {
+        logger.ERROR() << "Empty mesh " << name << " not added to plate." << std::endl;
+        return -1;
+    }
+
+    meshes.push_back(plate_mesh());
+    plate_mesh &M = meshes.back();
+    M.name = name;
+    M.tri_count = triangles.size();
+    M.owned.assign((size_t)M.tri_count * STL_RECORD_SIZE, 0);
+
+    for (size_t i=0; i<triangles.size(); i++) {
+        const pos3d_t &A = vertices[triangles[i].v1];
+        const pos3d_t &B = vertices[triangles[i].v2];
+        const pos3d_t &C = vertices[triangles[i].v3];
+
+        float ux = B.x - A.x, uy = B.y - A.y, uz = B.z - A.z;
+        float vx = C.x - A.x, vy = C.y - A.y, vz = C.z - A.z;
+        float nx = uy * vz - uz * vy;
+        float ny = uz * vx - ux * vz;
+        float nz = ux * vy - uy * vx;
+        float len = sqrtf(nx * nx + ny * ny + nz * nz);
+        if (len > 0) {
+            nx /= len;
+            ny /= len;
+            nz /= len;
+        }
+
+        float f[12] = {nx, ny, nz, float(A.x), float(A.y), float(A.z),
+                       float(B.x), float(B.y), float(B.z), float(C.x), float(C.y), float(C.z)};
+        memcpy(M.owned.data() + i * STL_RECORD_SIZE, f, 48);
+    }
+
+    M.records = M.owned.data();
+    get_bbox(M.records, M.tri_count, M.bbox);
+
+    mesh_index[name] = meshes.size() - 1;
+    return meshes.size() - 1;
+}
+
+
+int PlateAssembler::find_mesh(std::string name)
+{
+    auto found = mesh_index.find(name);
+    if (found == mesh_index.end())
+        return -1;
+
+    return found->second;
+}
+
+
+void PlateAssembler::add_row(const std::vector<int> &mesh_ids)
+{
+    rows.push_back(mesh_ids);
+}
+
+
+void PlateAssembler::clear_rows()
+{
+    rows.clear();
+    instances.clear();
+    plates.clear();
+}
+
+
+// Place rows as listed, left to right, rows going -Y. Each line hangs from the
+// bottom of the one above, its sorts top-aligned. A row wraps into a new line
+// when it gets wider than the platform; a line that would reach below the
+// platform starts a new plate. Sorts larger than the platform are skipped.
+void PlateAssembler::rows_layout()
+{
+    int plate = 0;
+    float used = 0.0; // plate height taken from its top edge, with the gap below the last line
+
+    for (int i=0; i<rows.size(); i++) {
+        // wrap the row into lines first, so each line's height is known before placing it
+        std::vector<std::vector<int>> lines(1);
+        std::vector<float> line_h(1, 0.0);
+        float lineX = 0.0;
+
+        for (int k=0; k<rows[i].size(); k++) {
+            if ((rows[i][k] < 0) || (rows[i][k] >= meshes.size()))
+                continue;
+
+            const mesh_bbox &B = meshes[rows[i][k]].bbox;
+            float w = B.highX - B.lowX;
+            float h = B.highY - B.lowY;
+
+            if ((w > platformX) || (h > platformY)) {
+                logger.ERROR() << meshes[rows[i][k]].name << " (" << w << " x " << h
+                               << " mm) is larger than the platform, skipped." << std::endl;
+                skipped++;
+                continue;
+            }
+
+            if (!lines.back().empty() && (lineX + w > platformX)) {
+                lines.push_back(std::vector<int>());
+                line_h.push_back(0.0);
+                lineX = 0.0;
+            }
+            lines.back().push_back(rows[i][k]);
+            lineX += w + gapX;
+            line_h.back() = std::max(line_h.back(), h);
+        }
+
+        if (lines.back().empty()) { // empty structure row: just a gap
+            used += gapY;
+            continue;
+        }
+
+        for (int j=0; j<lines.size(); j++) {
+            if ((used > 0) && (used + line_h[j] > platformY)) {
+                plate++;
+                used = 0.0;
+            }
+
+            float posX = 0.0;
+            for (int k=0; k<lines[j].size(); k++) {
+                const mesh_bbox &B = meshes[lines[j][k]].bbox;
+
+                sort_instance S;
+                S.mesh = lines[j][k];
+                S.rotated = false;
+                S.plate = plate;
+                S.offsetX = posX - B.lowX;
+                S.offsetY = -used - B.highY; // top-aligned: the line spans [-(used + line_h), -used]
+                S.offsetZ = -(B.lowZ);
+                instances.push_back(S);
+
+                posX += (B.highX - B.lowX) + gapX;
+            }
+            used += line_h[j] + gapY;
+        }
+    }
+
+    if (!instances.empty())
+        plates.resize(plate + 1);
+}
+
+
+// Automatic layout: rows only supply the multiset of sorts. Packs all sorts
+// onto platforms, largest first, each into the first plate with room; a new
+// plate is opened when none has. Gaps are kept by growing every sort and the
+// platform by one gap. Sorts larger than an empty platform are skipped.
+void PlateAssembler::auto_layout()
+{
+    std::vector<sort_instance> sorts;
+
+    for (int i=0; i<rows.size(); i++) {
+        for (int k=0; k<rows[i].size(); k++) {
+            if ((rows[i][k] < 0) || (rows[i][k] >= meshes.size()))
+                continue;
+            sort_instance S;
+            S.mesh = rows[i][k];
+            S.rotated = false;
+            S.plate = -1;
+            S.offsetZ = -(meshes[S.mesh].bbox.lowZ);
+            sorts.push_back(S);
+        }
+    }
+
+    std::vector<int> order(sorts.size());
+    for (int i=0; i<order.size(); i++)
+        order[i] = i;
+
+    std::stable_sort(order.begin(), order.end(), [this, &sorts](int a, int b) {
+        const mesh_bbox &A = meshes[sorts[a].mesh].bbox, &B = meshes[sorts[b].mesh].bbox;
+        float wa = A.highX - A.lowX, ha = A.highY - A.lowY;
+        float wb = B.highX - B.lowX, hb = B.highY - B.lowY;
+        if (std::max(wa, ha) != std::max(wb, hb))
+            return std::max(wa, ha) > std::max(wb, hb);
+        return wa * ha > wb * hb;
+    });
+
+    std::vector<MaxRectsBin> bins;
+
+    for (int n=0; n<order.size(); n++) {
+        sort_instance &S = sorts[order[n]];
+        const mesh_bbox &B = meshes[S.mesh].bbox;
+        float w = B.highX - B.lowX;
+        float h = B.highY - B.lowY;
+        rect_t R;
+
+        int b;
+        for (b=0; b<bins.size(); b++) {
+            if (bins[b].insert(w + gapX, h + gapY, allow_rotation, R, S.rotated))
+                break;
+        }
+        if (b == bins.size()) {
+            bins.push_back(MaxRectsBin(platformX + gapX, platformY + gapY));
+            if (!bins[b].insert(w + gapX, h + gapY, allow_rotation, R, S.rotated)) {
+                logger.ERROR() << meshes[S.mesh].name << " is larger than the platform, skipped." << std::endl;
+                skipped++;
+                bins.pop_back();
+                continue;
+            }
+        }
+        S.plate = b;
+
+        if (S.rotated) {
+            S.offsetX = R.x + B.highY;
+            S.offsetY = R.y - B.lowX;
+        }
+        else {
+            S.offsetX = R.x - B.lowX;
+            S.offsetY = R.y - B.lowY;
+        }
+    }
+
+    for (int i=0; i<sorts.size(); i++) {
+        if (sorts[i].plate >= 0)
+            instances.push_back(sorts[i]);
+    }
+    plates.resize(bins.size());
+}
+
+
+// place all rows; returns the number of plates
+int PlateAssembler::layout()
+{
+    instances.clear();
+    plates.clear();
+    skipped = 0;
+
+    if (auto_mode)
+        auto_layout();
+    else
+        rows_layout();
+
+    for (int i=0; i<plates.size(); i++)
+        plates[i].used_area = 0;
+
+    for (int i=0; i<instances.size(); i++) {
+        plate_t &P = plates[instances[i].plate];
+        const mesh_bbox &B = meshes[instances[i].mesh].bbox;
+        P.sorts.push_back(i);
+        P.used_area += (B.highX - B.lowX) * (B.highY - B.lowY);
+    }
+
+    return plates.size();
+}
+
+
+uint32_t PlateAssembler::plate_count()
+{
+    return plates.size();
+}
+
+
+uint32_t PlateAssembler::skipped_count()
+{
+    return skipped;
+}
+
+
+uint32_t PlateAssembler::plate_sort_count(uint32_t plate)
+{
+    if (plate >= plates.size())
+        return 0;
+
+    return plates[plate].sorts.size();
+}
+
+
+float PlateAssembler::plate_fill(uint32_t plate)
+{
+    if ((plate >= plates.size()) || (platformX * platformY == 0))
+        return 0;
+
+    return plates[plate].used_area / (platformX * platformY);
+}
+
+
+// copy records to dst, moving all vertices to the sort's place on the plate
+void PlateAssembler::translate(const sort_instance &sort, uint8_t *dst)
+{
+    const plate_mesh &M = meshes[sort.mesh];
+    float off[9] = {sort.offsetX, sort.offsetY, sort.offsetZ,
+                    sort.offsetX, sort.offsetY, sort.offsetZ,
+                    sort.offsetX, sort.offsetY, sort.offsetZ};
+    float f[12];
+
+    memcpy(dst, M.records, (size_t)M.tri_count * STL_RECORD_SIZE);
+
+    for (uint32_t m=0; m<M.tri_count; m++) {
+        uint8_t *rec = dst + (size_t)m * STL_RECORD_SIZE;
+        memcpy(f, rec, 48);
+        if (sort.rotated)
+            rotate_record(f);
+        for (int i=0; i<9; i++)
+            f[i+3] += off[i];
+        memcpy(rec, f, 48);
+    }
+}
+
+
+// welded mesh of one plate, 0-based indices
+int PlateAssembler::get_plate_mesh(uint32_t plate, std::vector<pos3d_t> &vertices,
+                                   std::vector<idx_tri_t> &triangles)
+{
+    std::unordered_map<vertex_key, uint32_t, vertex_key_hash> vertex_index;
+
+    vertices.clear();
+    triangles.clear();
+
+    if (plate >= plates.size())
+        return -1;
+
+    auto weld_vertex = [&](float x, float y, float z) -> uint32_t {
+        vertex_key key;
+        memcpy(&key.x, &x, 4);
+        memcpy(&key.y, &y, 4);
+        memcpy(&key.z, &z, 4);
+
+        auto found = vertex_index.find(key);
+        if (found != vertex_index.end())
+            return found->second;
+
+        uint32_t index = vertices.size();
+        vertices.push_back((pos3d_t) {x, y, z});
+        vertex_index[key] = index;
+        return index;
+    };
+
+    for (int i=0; i<plates[plate].sorts.size(); i++) {
+        const sort_instance &S = instances[plates[plate].sorts[i]];
+        const plate_mesh &M = meshes[S.mesh];
+
+        for(uint32_t m=0; m<M.tri_count; m++) {
+            float f[12];
+            memcpy(f, M.records + (size_t)m * STL_RECORD_SIZE, 48);
+            if (S.rotated)
+                rotate_record(f);
+            idx_tri_t tri;
+            tri.v1 = weld_vertex(f[3] + S.offsetX, f[4] + S.offsetY, f[5] + S.offsetZ);
+            tri.v2 = weld_vertex(f[6] + S.offsetX, f[7] + S.offsetY, f[8] + S.offsetZ);
+            tri.v3 = weld_vertex(f[9] + S.offsetX, f[10] + S.offsetY, f[11] + S.offsetZ);
+            triangles.push_back(tri);
+        }
+    }
+    return 0;
+}
+
+
+int PlateAssembler::write_plate_STL(uint32_t plate, std::string filename)
+{
+    if (plate >= plates.size())
+        return -1;
+
+    size_t tri_cnt = 0;
+    for (int i=0; i<plates[plate].sorts.size(); i++)
+        tri_cnt += meshes[instances[plates[plate].sorts[i]].mesh].tri_count;
+
+    if (tri_cnt > UINT32_MAX) {
+        logger.ERROR() << "Too many triangles for one STL file." << std::endl;
+        return -1;
+    }
+
+    // translate straight from the source records into the output mapping
+    size_t out_size = STL_HEADER_SIZE + tri_cnt * STL_RECORD_SIZE;
+
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        logger.ERROR() << "Could not open STL file " << filename << " for writing." << std::endl;
+        return -1;
+    }
+    // reserve the blocks now: a full disk fails here, not as SIGBUS in the copy
+    int err = posix_fallocate(fd, 0, out_size);
+    if (err != 0) {
+        logger.ERROR() << "Could not allocate STL file " << filename << ": " << strerror(err) << std::endl;
+        close(fd);
+        return -1;
+    }
+    uint8_t *out = (uint8_t*)mmap(nullptr, out_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (out == MAP_FAILED) {
+        logger.ERROR() << "Could not map STL file " << filename << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    // 80 byte header - content anything but "solid" (would indicated ASCII encoding)
+    memset(out, 'x', 80);
+    uint32_t count = tri_cnt;
+    memcpy(out + 80, &count, 4);
+
+    uint8_t *dst = out + STL_HEADER_SIZE;
+    for (int i=0; i<plates[plate].sorts.size(); i++) {
+        const sort_instance &S = instances[plates[plate].sorts[i]];
+        translate(S, dst);
+        dst += (size_t)meshes[S.mesh].tri_count * STL_RECORD_SIZE;
+    }
+
+    // write errors only show up when the pages are flushed
+    err = 0;
+    if (msync(out, out_size, MS_SYNC) < 0)
+        err = errno;
+    if ((munmap(out, out_size) < 0) && !err)
+        err = errno;
+    if ((close(fd) < 0) && !err)
+        err = errno;
+    if (err) {
+        logger.ERROR() << "Writing STL file " << filename << " failed: " << strerror(err) << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+
+// write all requested formats of one plate, output_base is the path without suffix
+int PlateAssembler::write_plate(uint32_t plate, std::string output_base, bool stl, bool ply, bool tmf)
+{
+    if (stl && (write_plate_STL(plate, output_base + ".stl") < 0))
+        return -1;
+
+    if (!ply && !tmf)
+        return 0;
+
+    std::vector<pos3d_t> vertices;
+    std::vector<idx_tri_t> triangles;
+    if (get_plate_mesh(plate, vertices, triangles) < 0)
+        return -1;
+
+    if (ply && (::writePLY(output_base + ".ply", vertices, triangles) < 0)) {
+        logger.ERROR() << "Could not write PLY file " << output_base << ".ply" << std::endl;
+        return -1;
+    }
+
+    if (tmf && (::write3MF(output_base + ".3mf", vertices, triangles) < 0)) {
+        logger.ERROR() << "Could not write 3MF file " << output_base << ".3mf" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+
+// Plates are written by up to one thread per core. A single plate is written
+// as <output_base>.*, several as <output_base>_001.*, <output_base>_002.*, ...
+// Files of the other naming or beyond the plate count are removed.
+int PlateAssembler::write_plates(std::string output_base, bool stl, bool ply, bool tmf)
+{
+    std::vector<std::string> suffixes;
+    if (stl) suffixes.push_back(".stl");
+    if (ply) suffixes.push_back(".ply");
+    if (tmf) suffixes.push_back(".3mf");
+
+    // outputs of an earlier run with another plate count would look current
+    auto plate_name = [&](int n) {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), "_%03d", n);
+        return output_base + suffix;
+    };
+    std::error_code ec;
+    for (std::string &suffix : suffixes) {
+        std::vector<std::string> stale;
+        if (plates.size() > 1)
+            stale.push_back(output_base + suffix);
+        for (int n = (plates.size() > 1) ? plates.size() + 1 : 1; fs::exists(plate_name(n) + suffix); n++)
+            stale.push_back(plate_name(n) + suffix);
+        for (std::string &path : stale) {
+            if (fs::remove(path, ec))
+                logger.INFO() << "Removed stale " << path << std::endl;
+            else if (ec)
+                logger.WARNING() << "Could not remove stale " << path << ": " << ec.message() << std::endl;
+        }
+    }
+
+    // plates on a bounded pool of writers; a single plate keeps the plain name
+    std::vector<int> results(plates.size(), 0);
+    std::atomic<size_t> next(0);
+
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < plates.size()) {
+            std::string plate_base = (plates.size() > 1) ? plate_name(i + 1) : output_base;
+            results[i] = write_plate(i, plate_base, stl, ply, tmf);
+        }
+    };
+
+    size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+    thread_count = std::min(thread_count, plates.size());
+
+    std::vector<std::thread> pool;
+    for (size_t t=0; t<thread_count; t++)
+        pool.push_back(std::thread(worker));
+    for (std::thread &t : pool)
+        t.join();
+
+    for (int i=0; i<results.size(); i++)
+        if (results[i] < 0)
+            return -1;
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "StressBitmap.h"
+#include "AppLog.h"
+#include <cmath>
+#include <algorithm>
+
+extern AppLog logger;
+
+const char *stress_families[] = {"solid", "empty", "checker", "noise", "diagonals", "text", "logo", "blobs"};
+const int stress_family_count = sizeof(stress_families) / sizeof(stress_families[0]);
+
+
+// well mixed 32 bit hash of a position
+static inline uint32_t hash32(uint32_t c)
+{
+    c ^= c >> 16;
+    c *= 0x7feb352d;
+    c ^= c >> 15;
+    c *= 0x846ca68b;
+    c ^= c >> 16;
+    return c;
+}
+
+
+// bowl, stem, crossbar and serifs inside a glyph box with side bearings
+static bool blob_ink(float gx, float gy)
+{
+    float stroke = 0.12f;
+    float dx = (gx - 0.62f) / 0.38f, dy = (gy - 0.70f) / 0.30f;
+    float r = sqrtf(dx * dx + dy * dy);
+    bool bowl = (r < 1.0f) && (r > 1.0f - stroke / 0.3f);
+    bool stem = (gx > 0.10f) && (gx < 0.10f + stroke) && (gy > 0) && (gy < 1);
+    bool bar = (gx > 0.10f) && (gx < 0.62f) && (gy > 0.40f) && (gy < 0.40f + stroke / 1.5f);
+    bool serifs = (gx > 0.0f) && (gx < 0.32f) &&
+                  (((gy > 0.0f) && (gy < 0.04f)) || ((gy > 0.96f) && (gy < 1.0f)));
+    return bowl || stem || bar || serifs;
+}
+
+
+// letter from four hashed strokes in a box of 0.6 x-height, 1/8 stroke width
+static bool letter_ink(uint32_t x, uint32_t y, uint32_t cell, uint32_t seed)
+{
+    uint32_t gw = std::max(3u, cell * 6 / 10);
+    uint32_t pitch_x = gw + std::max(1u, cell / 5);
+    uint32_t pitch_y = cell + std::max(2u, cell * 4 / 10);
+    uint32_t gx = x % pitch_x, gy = y % pitch_y;
+
+    if ((gx >= gw) || (gy >= cell))
+        return false;
+
+    uint32_t shape = hash32((y / pitch_y) * 65521 + (x / pitch_x) + seed);
+    if ((shape & 15) == 0)
+        return false; // word space
+
+    float stroke = std::max(1.0f, cell / 8.0f);
+    float u = gx + 0.5f, v = gy + 0.5f;
+    float bx = u - gw / 2.0f, by = v - cell * 0.6f;
+    float r = sqrtf(bx * bx / (gw * gw / 4.0f) + by * by / (cell * cell * 0.16f));
+    float slope = gw / float(cell);
+
+    return ((shape & 16) && (u < stroke))                                        // stem
+           || ((shape & 32) && (r < 1.0f) && (r > 1.0f - 2 * stroke / gw))     // bowl
+           || ((shape & 64) && (fabsf(v - cell / 2.0f) < stroke / 2))          // bar
+           || ((shape & 128) && (fabsf(u - v * slope) < stroke * 0.7f));       // diagonal
+}
+
+
+int make_stress_bitmap(TypeBitmap &TBM, stress_params &params)
+{
+    const std::string &family = params.family;
+    uint32_t w = params.width, h = params.height;
+
+    if (std::find(stress_families, stress_families + stress_family_count, family) ==
+        stress_families + stress_family_count) {
+        logger.ERROR() << "Unknown stress bitmap family " << family << std::endl;
+        return -1;
+    }
+
+    if (TBM.newBitmap(w, h) < 0)
+        return -1;
+
+    uint8_t *bm = TBM.getAddress();
+    uint32_t cell = params.cell ? params.cell : std::max(1u, h / 40);
+    uint32_t threshold = uint32_t(std::clamp(params.density, 0.0f, 1.0f) * 65535);
+    float cx = w / 2.0f, cy = h / 2.0f, R = std::min(w, h) / 2.0f;
+
+    for (uint32_t y = 0; y < h; y++) {
+        for (uint32_t x = 0; x < w; x++) {
+            bool ink = false;
+
+            if (family == "solid")
+                ink = true;
+            else if (family == "checker")
+                ink = ((x / cell) + (y / cell)) & 1;
+            else if (family == "noise")
+                ink = (hash32((y / cell) * 7919 + (x / cell) + params.seed) & 65535) < threshold;
+            else if (family == "diagonals")
+                ink = (((x + y) % cell) == 0) || (((x + h - y) % cell) == 0);
+            else if (family == "text")
+                ink = letter_ink(x, y, cell, params.seed);
+            else if (family == "logo") {
+                float dx = x + 0.5f - cx, dy = y + 0.5f - cy;
+                float r = sqrtf(dx * dx + dy * dy);
+                float a = atan2f(dy, dx);
+                float rim = R * (0.95f + 0.04f * sinf(12 * a));
+                bool ring = (uint32_t(r / cell) & 1) == 0;
+                bool spoke = fabsf(sinf(12 * a)) * r < cell / 2.0f;
+                ink = (r < rim) && (ring || spoke || (r < 3 * cell));
+            }
+            else if (family == "blobs")
+                ink = blob_ink((x - 0.15f * w) / (0.7f * w), (y - 0.25f * h) / (0.5f * h));
+
+            bm[y * w + x] = ink ? 255 : 0;
+        }
+    }
+    return 0;
+}
@@ -1,10 +1,16 @@
 #include "TypeBitmap.h"
 #include "AppLog.h"
+#include "AppStats.h"
+#include "MeshWriter.h"
 #include <iostream>
 #include <fstream>
+#include <filesystem>
 #include <string>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
+#include <algorithm>
+#include <vector>
 #include <boost/format.hpp> 
 
 extern AppLog logger;
@@ -34,7 +40,7 @@ int TypeBitmap::newBitmap(uint32_t width, uint32_t height)
     bm_width = width;
     bm_height = height;
 
-    bitmap = (uint8_t*)calloc(bm_width*bm_height, sizeof(uint8_t));
+    bitmap = (uint8_t*)stats_calloc(POOL_BITMAP, bm_width*bm_height, sizeof(uint8_t));
 
     if (bitmap != NULL) {
         loaded = true;
@@ -53,6 +59,7 @@ TypeBitmap::~TypeBitmap() {
 
 int TypeBitmap::load(std::string filename)
 {
+    STATS_TIMER("PBM load");
     std::string linebuf;
     uint32_t size;
 
@@ -96,7 +103,7 @@ int TypeBitmap::load(std::string filename)
         return -1;
     }
 
-    bitmap = (uint8_t*)calloc(size = bm_width*bm_height, sizeof(uint8_t));
+    bitmap = (uint8_t*)stats_calloc(POOL_BITMAP, size = bm_width*bm_height, sizeof(uint8_t));
     if (bitmap == NULL) {
         logger.ERROR() << "Bitmap buffer allocation failed" << std::endl;
         pbm.close();
@@ -119,7 +126,7 @@ int TypeBitmap::load(std::string filename)
                 case '1':
                     if (count == size) {
                         logger.ERROR() << "More data than specified." << std::endl;
-                        free(bitmap);
+                        stats_free(POOL_BITMAP, bitmap);
                         bitmap = NULL;
                         pbm.close();
                         return -1;
@@ -151,7 +158,7 @@ int TypeBitmap::load(std::string filename)
         while(!pbm.eof()) {
             if (count >= size) { // file should have ended
                 logger.ERROR() << "More data than specified." << std::endl;
-                free(bitmap);
+                stats_free(POOL_BITMAP, bitmap);
                 bitmap = NULL;
                 pbm.close();
                 return -1;
@@ -180,7 +187,7 @@ int TypeBitmap::load(std::string filename)
 
     if (count != size) {
         logger.ERROR() << "Less data than specified." << std::endl;
-        free(bitmap);
+        stats_free(POOL_BITMAP, bitmap);
         bitmap = NULL;
         pbm.close();
         return -1;
@@ -195,12 +202,12 @@ int TypeBitmap::load(std::string filename)
 void TypeBitmap::unload()
 {
     if (tag_bitmap_i32 != NULL) {
-        free(tag_bitmap_i32);
+        stats_free(POOL_TAG_BITMAP, tag_bitmap_i32);
     }
     tag_bitmap_i32 = NULL;
 
     if (bitmap != NULL) {
-        free(bitmap);
+        stats_free(POOL_BITMAP, bitmap);
     }
     bitmap = NULL;
     loaded = false;
@@ -213,7 +220,35 @@ bool TypeBitmap::is_loaded()
 }
 
 
-int TypeBitmap::store(std::string filename)
+uint32_t TypeBitmap::getWidth()
+{
+    if (is_loaded())
+        return bm_width;
+    else
+        return 0;
+}
+
+
+uint32_t TypeBitmap::getHeight()
+{
+    if (is_loaded())
+        return bm_height;
+    else
+        return 0;
+}
+
+
+uint8_t* TypeBitmap::getAddress()
+{
+    if (is_loaded()) {
+        return bitmap;
+    }
+    else
+        return NULL;
+}
+
+
+int TypeBitmap::store(std::string filename, bool binary)
 {
     uint8_t *bm_ptr;
     uint32_t x, y;
@@ -223,7 +258,7 @@ int TypeBitmap::store(std::string filename)
         return -1;
     }
 
-    std::ofstream pbm(filename);
+    std::ofstream pbm(filename, std::ios::binary);
     if (!pbm.is_open()) {
         logger.ERROR() << "Opening " << filename <<" for writing failed." << std::endl;
         return -1;
@@ -231,6 +266,24 @@ int TypeBitmap::store(std::string filename)
 
     bm_ptr = bitmap;
 
+    if (binary) {
+        // rows padded to whole bytes, MSB first
+        std::vector<char> row((bm_width + 7) / 8);
+
+        pbm << "P4" << std::endl;
+        pbm << bm_width << " " << bm_height << std::endl;
+        for (y=0; y<bm_height; y++) {
+            std::fill(row.begin(), row.end(), 0);
+            for (x=0; x<bm_width; x++) {
+                if (*bm_ptr++)
+                    row[x >> 3] |= 0x80 >> (x & 7);
+            }
+            pbm.write(row.data(), row.size());
+        }
+        pbm.close();
+        return 0;
+    }
+
     pbm << "P1" << std::endl;
     pbm << bm_width << " " << bm_height << std::endl;
 
@@ -249,6 +302,52 @@ int TypeBitmap::store(std::string filename)
 }
 
 
+int TypeBitmap::pack(packed_bitmap &packed)
+{
+    if (!loaded) {
+        logger.ERROR() << "No bitmap to pack." << std::endl;
+        return -1;
+    }
+
+    uint32_t row_bytes = (bm_width + 7) / 8;
+    packed.width = bm_width;
+    packed.height = bm_height;
+    packed.bits.assign((size_t)row_bytes * bm_height, 0);
+
+    uint8_t *bm_ptr = bitmap;
+    for (uint32_t y=0; y<bm_height; y++) {
+        uint8_t *row = &packed.bits[(size_t)y * row_bytes];
+        for (uint32_t x=0; x<bm_width; x++) {
+            if (*bm_ptr++)
+                row[x >> 3] |= 0x80 >> (x & 7);
+        }
+    }
+    return 0;
+}
+
+
+int TypeBitmap::unpack(const packed_bitmap &packed)
+{
+    uint32_t row_bytes = (packed.width + 7) / 8;
+    if ((size_t)row_bytes * packed.height != packed.bits.size()) {
+        logger.ERROR() << "Packed bitmap size does not match its dimensions." << std::endl;
+        return -1;
+    }
+    if (newBitmap(packed.width, packed.height) < 0) {
+        logger.ERROR() << "Bitmap buffer allocation failed" << std::endl;
+        return -1;
+    }
+
+    uint8_t *bm_ptr = bitmap;
+    for (uint32_t y=0; y<bm_height; y++) {
+        const uint8_t *row = &packed.bits[(size_t)y * row_bytes];
+        for (uint32_t x=0; x<bm_width; x++)
+            *bm_ptr++ = (row[x >> 3] & (0x80 >> (x & 7))) ? 255 : 0;
+    }
+    return 0;
+}
+
+
 int TypeBitmap::pasteGlyph(uint8_t *glyph, uint32_t g_width, uint32_t g_height, uint32_t top_pos, uint32_t left_pos)
 {
     int g_x, g_y, bm_x, bm_y;
@@ -288,6 +387,7 @@ int TypeBitmap::pasteGlyph(uint8_t *glyph, uint32_t g_width, uint32_t g_height,
 
 
 void TypeBitmap::threshold(uint8_t thr) {
+    STATS_TIMER("threshold");
 
     uint32_t x, y;
     const uint32_t w = bm_width;
@@ -337,6 +437,265 @@ void TypeBitmap::mirror() {
 }
 
 
+//
+// bit-parallel morphology
+//
+// Rows are packed 64 pixels per word (bit i of word k is x = 64k+i), so one
+// word operation handles 64 pixels. Rectangles are dilated separably, each
+// direction by shift-or doubling: r pixels cost about log2(r) word passes.
+//
+
+typedef stats_vector<uint64_t, POOL_MORPH> bitrows_t; // h rows of wpr words
+
+// row |= row shifted by s pixels towards +x (s > 0) or -x (s < 0)
+static void shift_or_row(uint64_t *row, uint64_t *tmp, uint32_t wpr, int32_t s)
+{
+    uint32_t words = abs(s) >> 6;
+    uint32_t bits = abs(s) & 63;
+
+    if (words >= wpr)
+        return;
+
+    if (s > 0) {
+        for (int32_t k=wpr-1; k>=0; k--) {
+            int32_t src = k - words;
+            uint64_t v = 0;
+            if (src >= 0) {
+                v = row[src] << bits;
+                if (bits && (src > 0))
+                    v |= row[src-1] >> (64 - bits);
+            }
+            tmp[k] = v;
+        }
+    }
+    else {
+        for (uint32_t k=0; k<wpr; k++) {
+            uint32_t src = k + words;
+            uint64_t v = 0;
+            if (src < wpr) {
+                v = row[src] >> bits;
+                if (bits && (src + 1 < wpr))
+                    v |= row[src+1] << (64 - bits);
+            }
+            tmp[k] = v;
+        }
+    }
+    for (uint32_t k=0; k<wpr; k++)
+        row[k] |= tmp[k];
+}
+
+// OR each pixel with its r neighbours to both sides
+static void dilate_rows(bitrows_t &B, uint32_t wpr, uint32_t h, uint32_t r, uint64_t last_mask)
+{
+    bitrows_t left(wpr), tmp(wpr);
+
+    if (r == 0)
+        return;
+
+    for (uint32_t y=0; y<h; y++) {
+        uint64_t *row = B.data() + (size_t)y * wpr;
+        std::copy(row, row + wpr, left.begin());
+
+        // row collects [x-r, x], left collects [x, x+r]
+        for (uint32_t n=1; n<=r; ) {
+            uint32_t step = std::min(n, r + 1 - n);
+            shift_or_row(row, tmp.data(), wpr, step);
+            shift_or_row(left.data(), tmp.data(), wpr, -int32_t(step));
+            n += step;
+        }
+        for (uint32_t k=0; k<wpr; k++)
+            row[k] |= left[k];
+        row[wpr-1] &= last_mask;
+    }
+}
+
+// OR each row with its r neighbours above and below
+static void dilate_columns(bitrows_t &B, uint32_t wpr, uint32_t h, uint32_t r)
+{
+    if (r == 0)
+        return;
+
+    bitrows_t up = B;
+    for (uint32_t n=1; n<=r; ) {
+        uint32_t step = std::min(n, r + 1 - n);
+        // down: row y takes row y-step, up: row y takes row y+step
+        for (int32_t y=h-1; y>=(int32_t)step; y--) {
+            uint64_t *dst = B.data() + (size_t)y * wpr;
+            const uint64_t *src = B.data() + (size_t)(y - step) * wpr;
+            for (uint32_t k=0; k<wpr; k++)
+                dst[k] |= src[k];
+        }
+        for (uint32_t y=0; y+step<h; y++) {
+            uint64_t *dst = up.data() + (size_t)y * wpr;
+            const uint64_t *src = up.data() + (size_t)(y + step) * wpr;
+            for (uint32_t k=0; k<wpr; k++)
+                dst[k] |= src[k];
+        }
+        n += step;
+    }
+    for (size_t i=0; i<B.size(); i++)
+        B[i] |= up[i];
+}
+
+
+// Dilate ink by a disc of the given radius in pixels (fractional radii give
+// the discrete disc of all offsets within that distance). The disc is the
+// union of separable rectangles (a, b) with a^2 + b^2 <= radius^2.
+// invert: work on the background instead, i.e. erode ink. Pixels outside the
+// bitmap count as background to the operation, so ink running into the
+// bitmap edge is not eroded from there. Below one pixel the disc is the
+// pixel itself and nothing would change, so such radii are refused.
+int TypeBitmap::morph(float radius, bool invert)
+{
+    if (!loaded)
+        return -1;
+
+    if (radius == 0)
+        return 0;
+
+    if (radius < 1.0) {
+        logger.ERROR() << "Edge compensation of " << radius << " px is below one pixel;"
+                       << " the outline can only move by whole pixels." << std::endl;
+        return -1;
+    }
+
+    const uint32_t w = bm_width;
+    const uint32_t h = bm_height;
+    const uint32_t wpr = (w + 63) / 64;
+    const uint64_t last_mask = (w & 63) ? (~0ull >> (64 - (w & 63))) : ~0ull;
+
+    bitrows_t src((size_t)wpr * h, 0);
+    for (uint32_t y=0; y<h; y++) {
+        const uint8_t *in = bitmap + (size_t)y * w;
+        uint64_t *row = src.data() + (size_t)y * wpr;
+        for (uint32_t x=0; x<w; x++) {
+            if ((in[x] != 0) != invert)
+                row[x >> 6] |= 1ull << (x & 63);
+        }
+    }
+
+    bitrows_t result((size_t)wpr * h, 0);
+    bitrows_t horizontal, rect;
+    uint32_t R = uint32_t(radius);
+    int32_t last_a = -1;
+
+    for (uint32_t b=0; b<=R; b++) {
+        uint32_t a = uint32_t(sqrtf(radius * radius - float(b * b)));
+
+        // rectangles with the same width: only the tallest one matters
+        if ((b < R) && (uint32_t(sqrtf(radius * radius - float((b + 1) * (b + 1)))) == a))
+            continue;
+
+        if ((int32_t)a != last_a) {
+            horizontal = src;
+            dilate_rows(horizontal, wpr, h, a, last_mask);
+            last_a = a;
+        }
+        rect = horizontal;
+        dilate_columns(rect, wpr, h, b);
+
+        for (size_t i=0; i<result.size(); i++)
+            result[i] |= rect[i];
+    }
+
+    for (uint32_t y=0; y<h; y++) {
+        uint8_t *out = bitmap + (size_t)y * w;
+        const uint64_t *row = result.data() + (size_t)y * wpr;
+        for (uint32_t x=0; x<w; x++) {
+            bool set = (row[x >> 6] >> (x & 63)) & 1;
+            out[x] = (set != invert) ? 255 : 0;
+        }
+    }
+    return 0;
+}
+
+
+int TypeBitmap::dilate(float radius)
+{
+    return morph(radius, false);
+}
+
+
+int TypeBitmap::erode(float radius)
+{
+    return morph(radius, true);
+}
+
+
+// grow (px > 0) or thin (px < 0) the ink outline, e.g. to compensate resin shrink
+int TypeBitmap::compensate_edges(float px)
+{
+    if (px > 0)
+        return dilate(px);
+    if (px < 0)
+        return erode(-px);
+    return 0;
+}
+
+
+// 64 bit FNV-1a style hash over size and pixels, 8 pixels per step
+uint64_t TypeBitmap::hash()
+{
+    const uint64_t FNV_PRIME = 0x100000001b3ULL;
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    if (!loaded)
+        return 0;
+
+    h = (h ^ bm_width) * FNV_PRIME;
+    h = (h ^ bm_height) * FNV_PRIME;
+
+    size_t size = (size_t)bm_width * bm_height;
+    size_t i = 0;
+    uint64_t word;
+    for (; i + 8 <= size; i += 8) {
+        memcpy(&word, bitmap + i, 8);
+        h = (h ^ word) * FNV_PRIME;
+        h ^= (h >> 29);
+    }
+    for (; i < size; i++)
+        h = (h ^ bitmap[i]) * FNV_PRIME;
+
+    return h;
+}
+
+
+// one pass over the pixels, looking at each 2x2 window (including the
+// background around the bitmap) once
+int TypeBitmap::measure(bitmap_stats &stats)
+{
+    stats = (bitmap_stats){(uint64_t)bm_width * bm_height, 0, 0, 0, 0};
+
+    if (!loaded)
+        return -1;
+
+    for (int64_t y = 0; y <= (int64_t)bm_height; y++) {
+        const uint8_t *above = (y > 0) ? bitmap + (y - 1) * bm_width : NULL;
+        const uint8_t *row = (y < bm_height) ? bitmap + y * bm_width : NULL;
+        bool a_left = false, r_left = false; // pixels left of x
+
+        for (int64_t x = 0; x <= (int64_t)bm_width; x++) {
+            bool a = above && (x < bm_width) && above[x];
+            bool r = row && (x < bm_width) && row[x];
+
+            stats.ink += r;
+            stats.row_edges += (r != r_left);
+            stats.col_edges += (x < bm_width) && (r != a);
+
+            int set = a_left + a + r_left + r;
+            if ((set == 1) || (set == 3))
+                stats.corners++;
+            else if ((set == 2) && (a_left == r))
+                stats.corners += 2;
+
+            a_left = a;
+            r_left = r;
+        }
+    }
+    return 0;
+}
+
+
 int TypeBitmap::set_type_parameters(dim_t TH, dim_t DOD, dim_t RS, dim_t LH)
 {
     type_height = TH;
@@ -348,6 +707,17 @@ int TypeBitmap::set_type_parameters(dim_t TH, dim_t DOD, dim_t RS, dim_t LH)
 }
 
 
+int TypeBitmap::get_type_parameters(dim_t &TH, dim_t &DOD, dim_t &RS, dim_t &LH)
+{
+    TH = type_height;
+    DOD = depth_of_drive;
+    RS = raster_size;
+    LH = layer_height;
+
+    return 0;
+}
+
+
 void TypeBitmap::push_triangles(intvec3d_t N, intvec3d_t v1, intvec3d_t v2, intvec3d_t v3, intvec3d_t v4)
 {
     int n = 4; // quadrilateral (==2 triangles) by default
@@ -505,13 +875,16 @@ uint32_t TypeBitmap::find_or_add_vertex(intvec3d_t v)
 {
     int i;
 
+    weld_lookups++;
     for(i=1; i<vertices.size(); i++) {
         if ((vertices[i].x == v.x) &&
             (vertices[i].y == v.y) &&
             (vertices[i].z == v.z) ) {
+            weld_probes += i;
             return i;
         }
     }
+    weld_probes += i;
     // didn't find it, so make new one:
     vertices.push_back(v);
     return i; // new vertex' index
@@ -536,8 +909,94 @@ void TypeBitmap::fill_rectangle(int32_t *bm32, STLrect rect)
 }
 
 
+// tags a band of body as one large rect, connected to its neighbours later
+// like any randomly found rect
+void TypeBitmap::add_body_band(int32_t top, int32_t left, int32_t bottom, int32_t right, int32_t &tag_cnt)
+{
+    STLrect band;
+    band.top = top;
+    band.left = left;
+    band.bottom = bottom;
+    band.right = right;
+    band.width = right - left + 1;
+    band.height = bottom - top + 1;
+    band.tag = -tag_cnt;
+    tag_cnt++;
+
+    fill_rectangle(tag_bitmap_i32, band);
+    body_rects.push_back(band);
+}
+
+
+// Finds the inked bounding box and covers the body outside of it with up to
+// four bands (full width above and below, left and right of the box). Bands
+// thinner than 2 pixels can't be rects, they are left to the box instead.
+// mesh_box ends up as the region that still needs rects and single pixels.
+void TypeBitmap::find_ink_box(int32_t &tag_cnt)
+{
+    int32_t w = bm_width;
+    int32_t h = bm_height;
+    int32_t top = h, bottom = -1, left = w, right = -1;
+    int32_t x;
+
+    uint8_t *row = bitmap;
+    for (int32_t y = 0; y < h; y++) {
+        for (x = 0; (x < w) && !row[x]; x++);
+        if (x < w) {
+            if (top > y) top = y;
+            bottom = y;
+            if (left > x) left = x;
+            for (x = w - 1; !row[x]; x--);
+            if (right < x) right = x;
+        }
+        row += w;
+    }
+
+    if (bottom < 0) { // no ink, all body
+        left = 0;
+        right = w - 1;
+        bottom = h - 1;
+    }
+
+    if ((w < 2) || (top < 2))
+        top = 0;
+    else
+        add_body_band(0, 0, top - 1, w - 1, tag_cnt);
+
+    if ((w < 2) || (h - 1 - bottom < 2))
+        bottom = h - 1;
+    else
+        add_body_band(bottom + 1, 0, h - 1, w - 1, tag_cnt);
+
+    if (bottom - top + 1 >= 2) {
+        if (left < 2)
+            left = 0;
+        else
+            add_body_band(top, 0, bottom, left - 1, tag_cnt);
+
+        if (w - 1 - right < 2)
+            right = w - 1;
+        else
+            add_body_band(top, right + 1, bottom, w - 1, tag_cnt);
+    }
+    else if (bottom >= top) {
+        left = 0;
+        right = w - 1;
+    }
+
+    mesh_box.top = top;
+    mesh_box.left = left;
+    mesh_box.bottom = bottom;
+    mesh_box.right = right;
+    mesh_box.width = std::max(right - left + 1, 0);
+    mesh_box.height = std::max(bottom - top + 1, 0);
+    mesh_box.tag = 0;
+}
+
+
 int TypeBitmap::find_rectangles(void)
 {
+    STATS_TIMER("find_rectangles");
     int x, y;
     int i, j, k;
 
@@ -555,7 +1014,9 @@ int TypeBitmap::find_rectangles(void)
     glyph_rects.clear();
     body_rects.clear();
 
-    tag_bitmap_i32 = (int32_t*)calloc(w*h, sizeof(int32_t));
+    if (tag_bitmap_i32 != NULL)
+        stats_free(POOL_TAG_BITMAP, tag_bitmap_i32); // from the previous mesh
+    tag_bitmap_i32 = (int32_t*)stats_calloc(POOL_TAG_BITMAP, w*h, sizeof(int32_t));
     if (tag_bitmap_i32 == NULL) {
         logger.ERROR() << "Could not allocate tag bitmap." << std::endl;
         return -1;
@@ -572,15 +1033,26 @@ int TypeBitmap::find_rectangles(void)
     }
     buf32 = tag_bitmap_i32;
 
-    // pseudo randomized loop
-    srand(0xB747);
     int32_t tag_cnt = 2;
+
+    // body outside the ink needs no probing
+    find_ink_box(tag_cnt);
+
+    // pseudo randomized loop; own generator state (same sequence as
+    // srand()/rand()) so bitmaps can be meshed on several threads
+    char rand_state[128];
+    struct random_data rand_data;
+    int32_t rand_val;
+    memset(&rand_data, 0, sizeof(rand_data));
+    initstate_r(0xB747, rand_state, sizeof(rand_state), &rand_data);
     
-    const int ITERATIONS = 100000;
+    const int ITERATIONS = ((mesh_box.width == 0) || (mesh_box.height == 0)) ? 0 : 100000;
 
     for (i = 0; i < ITERATIONS; i++) {
-        uint32_t rand_x = rand() % w;
-        uint32_t rand_y = rand() % h;
+        random_r(&rand_data, &rand_val);
+        uint32_t rand_x = mesh_box.left + rand_val % mesh_box.width;
+        random_r(&rand_data, &rand_val);
+        uint32_t rand_y = mesh_box.top + rand_val % mesh_box.height;
 
         // check if rect'ed already
         // expand rect
@@ -717,57 +1189,234 @@ int TypeBitmap::find_rectangles(void)
         }
     }
 
+    if (appstats.enabled()) {
+        uint64_t covered = 0;
+        for (STLrect &R : glyph_rects)
+            covered += R.width * R.height;
+        for (STLrect &R : body_rects)
+            covered += R.width * R.height;
+        appstats.count("rect iterations", ITERATIONS);
+        appstats.count("rects found", glyph_rects.size() + body_rects.size());
+        appstats.count("rect pixels covered", covered);
+        appstats.count("pixels", (uint64_t)w * h);
+    }
+
+    LOG_DEBUG(logger) << "Ink box " << mesh_box.width << "x" << mesh_box.height << " of " << w << "x" << h
+                      << ", " << glyph_rects.size() << " glyph rects, " << body_rects.size() << " body rects" << std::endl;
+
     return 0;
 }
 
 
-int TypeBitmap::generateMesh(reduced_foot foot, std::vector<nick> &nicks, float UVstretchXY, float UVstretchZ)
+int TypeBitmap::get_sort_geometry(reduced_foot foot, std::vector<nick> &nicks, float UVstretchXY, float UVstretchZ,
+                                  sort_geometry &G)
 {
-    int x, y;
-    int i, j, k;
-    int w = bm_width;
-    int h = bm_height;
-
-    vertices.clear();
-    intvec3d_t vec3dbuf = (intvec3d_t) {INT32_MIN, INT32_MIN, INT32_MIN};
-    vertices.push_back(vec3dbuf); // vertex #0, as OBJ files start indexing at #1
-
-    triangles.clear();
-
+    if (!loaded) {
+        logger.ERROR() << "No Bitmap loaded." << std::endl;
+        return -1;
+    }
 
+    int32_t w = bm_width;
+    int32_t h = bm_height;
     float RS = raster_size.as_mm();
     float LH = layer_height.as_mm();
 
-    int32_t DOD = int32_t( round( (UVstretchZ*depth_of_drive.as_mm())/LH ) );
-    int32_t BH = int32_t( round( (UVstretchZ*(type_height.as_mm()-depth_of_drive.as_mm()))/LH ) );
+    G = sort_geometry();
+    G.w = w;
+    G.h = h;
 
-    int32_t FZ;
-    int32_t FXY;
+    G.DOD = int32_t( round( (UVstretchZ*depth_of_drive.as_mm())/LH ) );
+    G.BH = int32_t( round( (UVstretchZ*(type_height.as_mm()-depth_of_drive.as_mm()))/LH ) );
 
     if (foot.mode == no_foot) {
-        FZ = 0;
-        FXY = 0;
+        G.FZ = 0;
+        G.FXY = 0;
     }
     else if (foot.mode == supports) {
-        FZ = int32_t( round( (1.50 * UVstretchZ)/LH ) ); // TODO: fixed at 1.25mm for now, overriding YAML
-        FXY = 0; // none
+        G.FZ = int32_t( round( (1.50 * UVstretchZ)/LH ) ); // TODO: fixed at 1.25mm for now, overriding YAML
+        G.FXY = 0; // none
     }
     else {
-        FZ = int32_t( round( (foot.Z.as_mm() * UVstretchZ)/LH ) );
-        FXY = int32_t( round( foot.XY.as_mm()/RS  ) );
+        G.FZ = int32_t( round( (foot.Z.as_mm() * UVstretchZ)/LH ) );
+        G.FXY = int32_t( round( foot.XY.as_mm()/RS  ) );
     }
 
-    int32_t PFH = int32_t( round( (UVstretchZ*(foot.pyramid_foot_height.as_mm()))/LH ) );
+    G.PFH = int32_t( round( (UVstretchZ*(foot.pyramid_foot_height.as_mm()))/LH ) );
 
-    if (find_rectangles() <0)
+    // BODY UPPER STRIP - constant 2mm for now
+    G.US = int32_t(round(2 * UVstretchZ) / LH);
+
+    // NICK LAYERS below the upper strip
+    int32_t BLC = G.US;
+    for (int i=0; i<nicks.size(); i++) {
+        sort_geometry::nick_layer N;
+        N.type = nicks[i].type;
+        N.top = BLC;
+        N.NH = int32_t(round(nicks[i].z.as_mm() * UVstretchZ) / LH);         // nick height
+        N.TD = int32_t(round((nicks[i].z.as_mm()/2) * UVstretchXY) / RS);    // triangle depth - half of height
+        N.RD = int32_t(round(nicks[i].y.as_mm() * UVstretchXY) / RS);        // rect depth
+
+        if (N.type == circle) {
+            float Pi = 4*atan(1);
+            const int32_t circle_segs = 10;
+
+            for (int j=0; j< circle_segs; j++) {
+                // TODO make special cases for first and last to avoid rounding-error integer shift
+                float start_angle = j*(Pi/circle_segs);
+                float end_angle   = (j+1)*(Pi/circle_segs);
+
+                float start_zf = -((cos(start_angle)-1)/2) * nicks[i].z.as_mm() * UVstretchZ;  // 0.0..-1.0
+                float end_zf   = -((cos(end_angle  )-1)/2) * nicks[i].z.as_mm() * UVstretchZ;  // 0.0..-1.0
+                N.start_z.push_back(std::min(int32_t(round(start_zf/LH)), N.NH));
+                N.end_z.push_back(std::min(int32_t(round(end_zf/LH)), N.NH));
+
+                float start_yf = sin(start_angle) * (nicks[i].z.as_mm()/2) * UVstretchXY;
+                float end_yf   = sin(end_angle) * (nicks[i].z.as_mm()/2) * UVstretchXY;
+                N.start_y.push_back(int32_t(round(start_yf/RS)));
+                N.end_y.push_back(int32_t(round(end_yf/RS)));
+            }
+        }
+
+        G.nick_layers.push_back(N);
+        BLC += N.NH;
+    }
+
+    float body_size = (h * RS) / UVstretchXY;
+    float set_width_size = (w * RS) / UVstretchXY;
+
+    if (foot.mode == supports) {
+        // TODO Lots of constants - consider what should be configurable?
+
+        // Y-direction dimensions
+        const float side_support_width = 0.25; // mm
+        const float half_support_width = 0.75; // mm
+        const float min_support_intervalY = 5.0; // mm
+        const float hollow_triangle_width = 1.25;//1.00; // mm
+        // unstretched calculations
+        G.support_intervalsY = int((body_size-2*side_support_width)/min_support_intervalY); // rounded down
+        float support_interval = ((body_size-2*side_support_width)/G.support_intervalsY);
+
+        // stretch + discretize
+        int32_t SI = round((support_interval*UVstretchXY) / RS);
+        G.SSW = round((side_support_width*UVstretchXY) / RS);
+        G.HTW = round((hollow_triangle_width*UVstretchXY) / RS);
+        G.IG  = SI-2*G.HTW;
+        G.HSW = round((half_support_width*UVstretchXY) / RS);
+        G.TSG = G.HTW-G.HSW;
+
+        // Z-direction dimensions
+        const float hollow_triangle_height = 1.25;//1.00; // mm
+        const float solid_foot_height = 0.25; // mm
+        const float support_gap_height = 3.0; // mm
+        const float support_base_height = 1.0; // mm
+        // stretch + discretize
+        int32_t HTH = round((hollow_triangle_height*UVstretchZ) / LH);
+        int32_t SFH = round((solid_foot_height*UVstretchZ) / LH);
+        int32_t SGH = round((support_gap_height*UVstretchZ) / LH);
+        int32_t SBH = round((support_base_height*UVstretchZ) / LH);
+        // resulting foot heights
+        G.FH1 = -(G.BH-G.FZ);
+        G.FH2 = G.FH1-HTH;
+        G.FH3 = G.FH2-SFH;
+        G.FH4 = G.FH3-SGH;
+        G.FH5 = G.FH4-SBH;
+
+        // X-direction dimensions
+        const float x_support_gap = 1.5; // mm
+        const float min_support_intervalX = 4.5; // mm - includes gap (half on each side of gap)??
+
+        int32_t support_intervalsX = int(set_width_size/min_support_intervalX); // rounded down
+        if (support_intervalsX < 1)
+            support_intervalsX = 1;
+        float support_widthX = (set_width_size - ((support_intervalsX-1)*x_support_gap)) / support_intervalsX;
+
+        for (int i=0; i<support_intervalsX; i++) {
+            float f_x1 = i * (x_support_gap + support_widthX);
+            float f_x2 = f_x1 + support_widthX;
+            G.support_segments_x1.push_back(round((f_x1 * UVstretchXY)/ RS));
+            G.support_segments_x2.push_back(round((f_x2 * UVstretchXY)/ RS));
+        }
+        // fix rounding errors
+        G.support_segments_x1[0] = 0;
+        G.support_segments_x2[support_intervalsX-1] = w;
+    }
+
+    if (foot.mode == pyramids) {
+        int32_t pyramid_count_Y = int(round(body_size/(foot.pyramid_pitch.as_mm()))); // TODO: StretchXY?
+        float final_pyramid_pitch_Y = body_size / pyramid_count_Y; // TODO: StretchXY?
+
+        int32_t pyramid_count_X = int(round(set_width_size/(foot.pyramid_pitch.as_mm()))); // TODO: StretchXY?
+        float final_pyramid_pitch_X = set_width_size / pyramid_count_X; // TODO: StretchXY?
+
+        G.PH = int(round(
+                   (final_pyramid_pitch_Y-foot.pyramid_top_length.as_mm())
+                   * 0.5 * foot.pyramid_height_factor * UVstretchZ / LH));
+
+        G.PTCH = int(round(
+                     foot.pyramid_top_column_height.as_mm() * UVstretchZ / LH
+                     ));
+
+        LOG_DEBUG(logger) << "pyramid_count_Y: " << pyramid_count_Y << std::endl;
+        LOG_DEBUG(logger) << "final_pyramid_pitch_Y: " << final_pyramid_pitch_Y << std::endl;
+
+        LOG_DEBUG(logger) << "pyramid_count_X: " << pyramid_count_X << std::endl;
+        LOG_DEBUG(logger) << "final_pyramid_pitch_X: " << final_pyramid_pitch_X << std::endl;
+
+        for (int i=0; i<pyramid_count_Y; i++)
+            G.pyramid_base_Y_points.push_back(int(round(i*final_pyramid_pitch_Y*UVstretchXY/RS)));
+        G.pyramid_base_Y_points.push_back(h);
+
+        for (int i=0; i<pyramid_count_X; i++)
+            G.pyramid_base_X_points.push_back(int(round(i*final_pyramid_pitch_X*UVstretchXY/RS)));
+        G.pyramid_base_X_points.push_back(w);
+
+        for (int i=0; i<pyramid_count_Y; i++) {
+            float firstY = (((float)i+0.5)*final_pyramid_pitch_Y)-(foot.pyramid_top_length.as_mm()/2);
+            G.pyramid_top_Y_points.push_back(int(round((firstY)*UVstretchXY/RS)));
+            float secondY = (((float)i+0.5)*final_pyramid_pitch_Y)+(foot.pyramid_top_length.as_mm()/2);
+            G.pyramid_top_Y_points.push_back(int(round((secondY)*UVstretchXY/RS)));
+        }
+
+        for (int i=0; i<pyramid_count_X; i++) {
+            float firstX = (((float)i+0.5)*final_pyramid_pitch_X)-(foot.pyramid_top_length.as_mm()/2);
+            G.pyramid_top_X_points.push_back(int(round((firstX)*UVstretchXY/RS)));
+            float secondX = (((float)i+0.5)*final_pyramid_pitch_X)+(foot.pyramid_top_length.as_mm()/2);
+            G.pyramid_top_X_points.push_back(int(round((secondX)*UVstretchXY/RS)));
+        }
+    }
+
+    return 0;
+}
+
+
+int TypeBitmap::generateMesh(reduced_foot foot, std::vector<nick> &nicks, float UVstretchXY, float UVstretchZ)
+{
+    int x, y;
+    int i, j, k;
+    int w = bm_width;
+    int h = bm_height;
+
+    vertices.clear();
+    intvec3d_t vec3dbuf = (intvec3d_t) {INT32_MIN, INT32_MIN, INT32_MIN};
+    vertices.push_back(vec3dbuf); // vertex #0, as OBJ files start indexing at #1
+    weld_lookups = 0;
+    weld_probes = 0;
+
+    triangles.clear();
+
+
+    sort_geometry G;
+    if (get_sort_geometry(foot, nicks, UVstretchXY, UVstretchZ, G) < 0)
         return -1;
 
+    int32_t DOD = G.DOD;
+    int32_t BH = G.BH;
+    int32_t FZ = G.FZ;
+    int32_t FXY = G.FXY;
+    int32_t PFH = G.PFH;
 
-    if (!loaded)
-    {
-        logger.ERROR() << "No Bitmap loaded." << std::endl;
+    if (find_rectangles() <0)
         return -1;
-    }
 
     int32_t *buf32 = tag_bitmap_i32;
 
@@ -782,12 +1431,14 @@ int TypeBitmap::generateMesh(reduced_foot foot, std::vector<nick> &nicks, float
     intvec3d_t utl, utr, ubl, ubr, ltl, ltr, lbl, lbr;
 
 
+    ScopedTimer stage("mesh: large rects");
+
     // LARGE RECTS (min 2x2)
     // body top surface
     for (i = 0; i < body_rects.size(); i++) {
         STLrect R = body_rects[i];
 
-        std::vector<intvec2d_t> outsides;
+        stats_vector<intvec2d_t, POOL_OUTSIDES> outsides;
         int32_t last_tag, current_tag;
         bool Rneg = (R.tag < 0);
 
@@ -900,7 +1551,7 @@ int TypeBitmap::generateMesh(reduced_foot foot, std::vector<nick> &nicks, float
     for (i = 0; i < glyph_rects.size(); i++) {
         STLrect R = glyph_rects[i];
 
-        std::vector<intvec2d_t> outsides;
+        stats_vector<intvec2d_t, POOL_OUTSIDES> outsides;
         int32_t last_tag, current_tag;
         bool Rneg = (R.tag < 0);
 
@@ -1011,9 +1662,11 @@ int TypeBitmap::generateMesh(reduced_foot foot, std::vector<nick> &nicks, float
     }
 
 
-    // SINGLE PIXELS
-    for (y = 0; y < bm_height; y++) {
-        for (x = 0; x < bm_width; x++) {
+    stage.next("mesh: single pixels");
+
+    // SINGLE PIXELS - only inside the ink box, everything else is body bands
+    for (y = mesh_box.top; y <= mesh_box.bottom; y++) {
+        for (x = mesh_box.left; x <= mesh_box.right; x++) {
 
             // pixel cube corners - assuming cubes are going up from Z=0 to Z=+(depth of drive)
             utl = (intvec3d_t){x, -y, DOD};
@@ -1066,8 +1719,10 @@ int TypeBitmap::generateMesh(reduced_foot foot, std::vector<nick> &nicks, float
 
     int32_t BLC = 0; // body layer count
 
-    // BODY UPPER STRIP - constant 2mm for now
-    int32_t US = int32_t(round(2 * UVstretchZ) / LH);
+    stage.next("mesh: upper strip");
+
+    // BODY UPPER STRIP
+    int32_t US = G.US;
 
     utl = (intvec3d_t){0,  0, 0};
     utr = (intvec3d_t){w,  0, 0};
@@ -1184,19 +1839,16 @@ int TypeBitmap::generateMesh(reduced_foot foot, std::vector<nick> &nicks, float
     BLC += US;
 
 
-    // NICK LAYERS
-    for (int i = 0; i< nicks.size(); i++) {
-
-        // NICK HEIGHT
-        int32_t NH = int32_t(round(nicks[i].z.as_mm() * UVstretchZ) / LH);
+    stage.next("mesh: nicks");
 
-        // TRIANGLE DEPTH - half of height
-        int32_t TD = int32_t(round((nicks[i].z.as_mm()/2) * UVstretchXY) / RS);
-
-        // RECT DEPTH
-        int32_t RD = int32_t(round(nicks[i].y.as_mm() * UVstretchXY) / RS);
+    // NICK LAYERS
+    for (int i = 0; i< G.nick_layers.size(); i++) {
+        sort_geometry::nick_layer &N = G.nick_layers[i];
+        int32_t NH = N.NH;
+        int32_t TD = N.TD;
+        int32_t RD = N.RD;
 
-        if (nicks[i].type == rect) {
+        if (N.type == rect) {
             // RECT SEGMENT
             utl = (intvec3d_t){0,  0, -BLC};
             utr = (intvec3d_t){w,  0, -BLC};
@@ -1226,7 +1878,7 @@ int TypeBitmap::generateMesh(reduced_foot foot, std::vector<nick> &nicks, float
             push_triangles(Zn, utl, utr, ubl, ubr); // downward-looking upper face of nick
             push_triangles(Zp, ltl, ltr, lbl, lbr); // upward-looking lower face of nick
         }
-        else if (nicks[i].type == triangle) {
+        else if (N.type == triangle) {
             // TRIANGLE SEGMENT
             utl = (intvec3d_t){0,  0, -BLC};
             utr = (intvec3d_t){w,  0, -BLC};
@@ -1261,35 +1913,12 @@ int TypeBitmap::generateMesh(reduced_foot foot, std::vector<nick> &nicks, float
             push_triangles(Yp, utl, utr, ltr, ltl); // top face
             push_triangles(YnZp, ubl, lbr, ubr, lbl); // bottom face
         }
-        else if (nicks[i].type == circle) {
-
-            float twoPi = 8*atan(1);
-            float Pi = 4*atan(1);
-            float halfPi = 2*atan(1);
-
-            const int32_t circle_segs = 10;
-
-            for (int j=0; j< circle_segs; j++) {
-
-                // TODO make special cases for first and last to avoid rounding-error integer shift
-                float start_angle = j*(Pi/circle_segs);
-                float end_angle   = (j+1)*(Pi/circle_segs);
-
-                float start_zf = -((cos(start_angle)-1)/2) * nicks[i].z.as_mm() * UVstretchZ;  // 0.0..-1.0
-                float end_zf   = -((cos(end_angle  )-1)/2) * nicks[i].z.as_mm() * UVstretchZ;  // 0.0..-1.0
-                int32_t start_z = int32_t(round(start_zf/LH));
-                int32_t end_z   = int32_t(round(end_zf/LH));
-                if (j==0)
-                    start_z==0;
-                if (start_z > NH)
-                    start_z = NH;
-                if (end_z > NH)
-                    end_z = NH;
-
-                float start_yf = sin(start_angle) * (nicks[i].z.as_mm()/2) * UVstretchXY;
-                float end_yf   = sin(end_angle) * (nicks[i].z.as_mm()/2) * UVstretchXY;
-                int32_t start_y = int32_t(round(start_yf/RS));
-                int32_t end_y   = int32_t(round(end_yf/RS));
+        else if (N.type == circle) {
+            for (int j=0; j< N.start_z.size(); j++) {
+                int32_t start_z = N.start_z[j];
+                int32_t end_z   = N.end_z[j];
+                int32_t start_y = N.start_y[j];
+                int32_t end_y   = N.end_y[j];
 
                 // MAKE N
                 intvec3d_t Nang = (intvec3d_t) { 0,  -(end_z-start_z), -(end_y-start_y)};
@@ -1334,6 +1963,8 @@ int TypeBitmap::generateMesh(reduced_foot foot, std::vector<nick> &nicks, float
 
 
 
+    stage.next("mesh: lower strip + foot");
+
     if (foot.mode != pyramids) {
 
         // LOWER BODY STRIP (above reduced foot, if exists)  TODO - make different one for supports-foot
@@ -1372,81 +2003,22 @@ int TypeBitmap::generateMesh(reduced_foot foot, std::vector<nick> &nicks, float
 
 
 
-    // PREPARE SUPPORTS + FOOT + LOWER STRIP
-    // TODO Lots of constants - consider what should be configurable?
-
-        // Y-direction dimensions
-        int32_t BS = bm_height;
-        float body_size = (BS * raster_size.as_mm()) / UVstretchXY;
-        const float side_support_width = 0.25; // mm
-        const float half_support_width = 0.75; // mm
-        const float min_support_intervalY = 5.0; // mm
-        const float hollow_triangle_width = 1.25;//1.00; // mm
-        // unstretched calculations
-        int32_t support_intervalsY = int((body_size-2*side_support_width)/min_support_intervalY); // rounded down
-        float support_interval = ((body_size-2*side_support_width)/support_intervalsY);
-        float interval_gap = support_interval - (2 * hollow_triangle_width);
-        float triangle_support_gap = hollow_triangle_width - half_support_width;
-//        logger.INFO() << "#support intervals: " << support_intervalsY << std::endl
-//                  << "      #support intervals(mm): " << support_interval << std::endl
-//                  << "      #intervals gap(mm): " << interval_gap << std::endl
-//                  << "      triangle_support_gap(mm): " << triangle_support_gap << std::endl;
-
-        // stretch + discretize
-        int32_t SI  = round((support_interval*UVstretchXY) / raster_size.as_mm());
-        int32_t SSW = round((side_support_width*UVstretchXY) / raster_size.as_mm());
-        int32_t HTW = round((hollow_triangle_width*UVstretchXY) / raster_size.as_mm());
-        int32_t IG  = SI-2*HTW;//round((interval_gap*UVstretchXY) / raster_size.as_mm());
-        int32_t HSW = round((half_support_width*UVstretchXY) / raster_size.as_mm());
-        int32_t TSG = HTW-HSW;//round((triangle_support_gap*UVstretchXY) / raster_size.as_mm());
-
-
-        // Z-direction dimensions
-        const float hollow_triangle_height = 1.25;//1.00; // mm
-        const float solid_foot_height = 0.25; // mm
-        const float support_gap_height = 3.0; // mm
-        const float support_base_height = 1.0; // mm
-        // stretch + discretize
-        int32_t HTH = round((hollow_triangle_height*UVstretchZ) / layer_height.as_mm());
-        int32_t SFH = round((solid_foot_height*UVstretchZ) / layer_height.as_mm());
-        int32_t SGH = round((support_gap_height*UVstretchZ) / layer_height.as_mm());
-        int32_t SBH = round((support_base_height*UVstretchZ) / layer_height.as_mm());
-        // resulting foot heights
-        int32_t FH1 = -(BH-FZ);
-        int32_t FH2 = FH1-HTH;
-        int32_t FH3 = FH2-SFH;
-        int32_t FH4 = FH3-SGH;
-        int32_t FH5 = FH4-SBH;
-
-
-        // X-direction dimensions
-        int32_t SW = bm_width;
-        const float x_support_gap = 1.5; // mm
-        const float min_support_intervalX = 4.5; // mm - includes gap (half on each side of gap)??
-        float set_width_size = (SW * raster_size.as_mm()) / UVstretchXY;
-
-        int32_t support_intervalsX = int(set_width_size/min_support_intervalX); // rounded down
-        if (support_intervalsX < 1)
-            support_intervalsX = 1;
-        float support_widthX = (set_width_size - ((support_intervalsX-1)*x_support_gap)) / support_intervalsX;
-
-        std::vector<int32_t> support_segments_x1;
-        std::vector<int32_t> support_segments_x2;
-
-        for (int i=0; i<support_intervalsX; i++) {
-
-            float f_x1 = i * (x_support_gap + support_widthX);
-            float f_x2 = f_x1 + support_widthX;
-
-            int32_t x1 = round((f_x1 * UVstretchXY)/ raster_size.as_mm());
-            int32_t x2 = round((f_x2 * UVstretchXY)/ raster_size.as_mm());
-
-            support_segments_x1.push_back(x1);
-            support_segments_x2.push_back(x2);
-        }
-        // fix rounding errors
-        support_segments_x1[0] = 0;
-        support_segments_x2[support_intervalsX-1] = SW;
+    // SUPPORTS + FOOT + LOWER STRIP
+    int32_t BS = bm_height;
+    int32_t SSW = G.SSW;
+    int32_t HTW = G.HTW;
+    int32_t IG  = G.IG;
+    int32_t HSW = G.HSW;
+    int32_t TSG = G.TSG;
+    int32_t support_intervalsY = G.support_intervalsY;
+    int32_t FH1 = G.FH1;
+    int32_t FH2 = G.FH2;
+    int32_t FH3 = G.FH3;
+    int32_t FH4 = G.FH4;
+    int32_t FH5 = G.FH5;
+    std::vector<int32_t> &support_segments_x1 = G.support_segments_x1;
+    std::vector<int32_t> &support_segments_x2 = G.support_segments_x2;
+    int32_t support_intervalsX = support_segments_x1.size();
 
     // generate mesh connection points to support foot structure
     std::vector<int32_t> support_foot_verticesY;
@@ -1768,62 +2340,14 @@ int TypeBitmap::generateMesh(reduced_foot foot, std::vector<nick> &nicks, float
 
     if (foot.mode == pyramids) {
 
-        // PREPARE PYRAMID SUPPORTS + FOOT(?) + LOWER STRIP(?)
-            // DONE ABOVE: float body_size = (BS * raster_size.as_mm()) / UVstretchXY;
-            int32_t SW = w;
-            float set_width = (SW * raster_size.as_mm()) / UVstretchXY; // TODO: check stretch divide?
-
-            int32_t pyramid_count_Y = int(round(body_size/(foot.pyramid_pitch.as_mm()))); // TODO: StretchXY?
-            float final_pyramid_pitch_Y = body_size / pyramid_count_Y; // TODO: StretchXY?
-
-            int32_t pyramid_count_X = int(round(set_width/(foot.pyramid_pitch.as_mm()))); // TODO: StretchXY?
-            float final_pyramid_pitch_X = set_width / pyramid_count_X; // TODO: StretchXY?
-
-            int32_t PH = int(round(
-                            (final_pyramid_pitch_Y-foot.pyramid_top_length.as_mm())
-                            * 0.5 * foot.pyramid_height_factor * UVstretchZ / layer_height.as_mm()));
-
-            int32_t PTCH = int(round(
-                            foot.pyramid_top_column_height.as_mm() * UVstretchZ / layer_height.as_mm()
-                            ));
-
-            logger.INFO() << "pyramid_count_Y: " << pyramid_count_Y << std::endl;
-            logger.INFO() << "final_pyramid_pitch_Y: " << final_pyramid_pitch_Y << std::endl;
-
-            logger.INFO() << "pyramid_count_X: " << pyramid_count_X << std::endl;
-            logger.INFO() << "final_pyramid_pitch_X: " << final_pyramid_pitch_X << std::endl;
-
-        std::vector<int32_t> pyramid_base_Y_points;
-        std::vector<int32_t> pyramid_top_Y_points;
-
-        std::vector<int32_t> pyramid_base_X_points;
-        std::vector<int32_t> pyramid_top_X_points;
-
-        for (i=0; i<pyramid_count_Y; i++) {
-            int32_t stepY = int(round(i*final_pyramid_pitch_Y*UVstretchXY/raster_size.as_mm()));
-            pyramid_base_Y_points.push_back(stepY);
-        }
-        pyramid_base_Y_points.push_back(BS);
-
-        for (i=0; i<pyramid_count_X; i++) {
-            int32_t stepX = int(round(i*final_pyramid_pitch_X*UVstretchXY/raster_size.as_mm()));
-            pyramid_base_X_points.push_back(stepX);
-        }
-        pyramid_base_X_points.push_back(SW);
-
-        for (i=0; i<pyramid_count_Y; i++) {
-            float firstY = (((float)i+0.5)*final_pyramid_pitch_Y)-(foot.pyramid_top_length.as_mm()/2);
-            pyramid_top_Y_points.push_back(int(round((firstY)*UVstretchXY/raster_size.as_mm())));
-            float secondY = (((float)i+0.5)*final_pyramid_pitch_Y)+(foot.pyramid_top_length.as_mm()/2);
-            pyramid_top_Y_points.push_back(int(round((secondY)*UVstretchXY/raster_size.as_mm())));
-        }
-
-        for (i=0; i<pyramid_count_X; i++) {
-            float firstX = (((float)i+0.5)*final_pyramid_pitch_X)-(foot.pyramid_top_length.as_mm()/2);
-            pyramid_top_X_points.push_back(int(round((firstX)*UVstretchXY/raster_size.as_mm())));
-            float secondX = (((float)i+0.5)*final_pyramid_pitch_X)+(foot.pyramid_top_length.as_mm()/2);
-            pyramid_top_X_points.push_back(int(round((secondX)*UVstretchXY/raster_size.as_mm())));
-        }
+        int32_t PH = G.PH;
+        int32_t PTCH = G.PTCH;
+        std::vector<int32_t> &pyramid_base_Y_points = G.pyramid_base_Y_points;
+        std::vector<int32_t> &pyramid_top_Y_points = G.pyramid_top_Y_points;
+        std::vector<int32_t> &pyramid_base_X_points = G.pyramid_base_X_points;
+        std::vector<int32_t> &pyramid_top_X_points = G.pyramid_top_X_points;
+        int32_t pyramid_count_Y = pyramid_base_Y_points.size() - 1;
+        int32_t pyramid_count_X = pyramid_base_X_points.size() - 1;
 
         intvec3d_t XpZp = (intvec3d_t){ 1,  0,  1};  intvec3d_t XnZp = (intvec3d_t){-1,  0,  1};
         intvec3d_t YpZp = (intvec3d_t){ 0,  1,  1};  intvec3d_t YnZp = (intvec3d_t){0, -1,  1};
@@ -1923,10 +2447,10 @@ int TypeBitmap::generateMesh(reduced_foot foot, std::vector<nick> &nicks, float
                 lbl = (intvec3d_t){pyramid_top_X_points[j*2+1], -pyramid_top_Y_points[i*2], -(BH+PTCH)};
                 lbr = (intvec3d_t){pyramid_top_X_points[j*2+1], -pyramid_top_Y_points[i*2+1], -(BH+PTCH)};
 
-                push_triangles(Xn, ubl, utl, ltl, lbl); // left face
-                push_triangles(Xp, ubr, ltr, utr, lbr); // right face
-                push_triangles(Yn, utl, utr, ltr, ltl); // top face
-                push_triangles(Yp, ubl, lbr, ubr, lbl); // bottom face                /////////////////
+                push_triangles(Yp, ubl, utl, ltl, lbl); // left face
+                push_triangles(Yn, ubr, ltr, utr, lbr); // right face
+                push_triangles(Xn, utl, utr, ltr, ltl); // top face
+                push_triangles(Xp, ubl, lbr, ubr, lbl); // bottom face                /////////////////
 
                 // pyramids
                 utl = (intvec3d_t){pyramid_top_X_points[j*2], -pyramid_top_Y_points[i*2], -(BH+PTCH)};
@@ -2129,12 +2653,17 @@ int TypeBitmap::generateMesh(reduced_foot foot, std::vector<nick> &nicks, float
         push_triangles(Zn, ltr, lbl, ltl, lbr);    
     }
 
+    STATS_COUNT("vertex weld lookups", weld_lookups);
+    STATS_COUNT("vertex weld probes", weld_probes);
+    STATS_COUNT("triangles", triangles.size());
+
     return 0;
 }
 
 
-int TypeBitmap::writeOBJ(std::string filename)
+int TypeBitmap::writeOBJ(std::string filename, bool normals)
 {
+    STATS_TIMER("write OBJ");
     int i;
     int w = bm_width;
     int h = bm_height;
@@ -2148,49 +2677,103 @@ int TypeBitmap::writeOBJ(std::string filename)
         return -1;
     }
 
-    std::ofstream obj_out(filename, std::ios::binary);
-    if (!obj_out.is_open()) {
+    OutBuffer obj_out;
+    if (obj_out.open(filename) < 0) {
         logger.ERROR() << "Could not open OBJ file " << filename <<" for writing." << std::endl;
         return -1;
     }
 
-    logger.INFO() << "Triangle count is " << triangles.size() << std::endl;
+    LOG_INFO(logger) << "Triangle count is " << triangles.size() << std::endl;
 
-    obj_out << "### OBJ data exported from t3t_pbm2stl:" << std::endl;
+    obj_out.put("### OBJ data exported from t3t_pbm2stl:\n");
 
-    obj_out << std::endl << "# Vertices with coordinates in mm:" << std::endl;
+    obj_out.put("\n# Vertices with coordinates in mm:\n");
     for (i=1; i<vertices.size(); i++) {
         intvec3d_t vertex = vertices[i];
-        float x = vertex.x * RS;
-        float y = vertex.y * RS;
-        float z = vertex.z * LH;
 
-        obj_out << "v "
-                << x << " "
-                << y << " "
-                << z << " "
-                << std::endl;
+        obj_out.put("v ", 2);
+        obj_out.put_float(vertex.x * RS);
+        obj_out.put(' ');
+        obj_out.put_float(vertex.y * RS);
+        obj_out.put(' ');
+        obj_out.put_float(vertex.z * LH);
+        obj_out.put('\n');
     }
 
-    obj_out << std::endl << "# Triangles by vertex number:" << std::endl;
+    // normal palette: meshes only use a handful of distinct normals
+    std::vector<intvec3d_t> palette;
+    std::vector<uint32_t> tri_normal;
+
+    if (normals) {
+        tri_normal.resize(triangles.size());
+
+        for (i=0; i<triangles.size(); i++) {
+            intvec3d_t N = triangles[i].N;
+            uint32_t n;
+            for (n=0; n<palette.size(); n++) {
+                if ((palette[n].x == N.x) && (palette[n].y == N.y) && (palette[n].z == N.z))
+                    break;
+            }
+            if (n == palette.size())
+                palette.push_back(N);
+            tri_normal[i] = n + 1; // OBJ indices start at #1
+        }
+
+        obj_out.put("\n# Normal palette:\n");
+        for (i=0; i<palette.size(); i++) {
+            // normals are given in raster/layer units, so scale inversely
+            float nx = palette[i].x / RS;
+            float ny = palette[i].y / RS;
+            float nz = palette[i].z / LH;
+            float norm = sqrtf(nx*nx + ny*ny + nz*nz);
+            if (norm == 0)
+                norm = 1;
+
+            obj_out.put("vn ", 3);
+            obj_out.put_float(nx / norm);
+            obj_out.put(' ');
+            obj_out.put_float(ny / norm);
+            obj_out.put(' ');
+            obj_out.put_float(nz / norm);
+            obj_out.put('\n');
+        }
+    }
+
+    obj_out.put("\n# Triangles by vertex number:\n");
     for (i=0; i<triangles.size(); i++) {
         mesh_triangle triangle = triangles[i];
-        obj_out << "f "
-                << triangle.v1 << " "
-                << triangle.v2 << " "
-                << triangle.v3 << " "
-                << std::endl;
-    }
-    obj_out.close();
-
-    logger.INFO() << "Wrote binary STL data to " << filename << std::endl;
-    logger.INFO() << "---------------------" << std::endl;
-    logger.INFO() << "Exported STL metrics:" << std::endl;
-    logger.INFO() << "Type height   " << boost::format("%6.4f") % type_height.as_inch()
+
+        obj_out.put("f ", 2);
+        if (normals) {
+            uint32_t n = tri_normal[i];
+            obj_out.put_uint(triangle.v1); obj_out.put("//", 2); obj_out.put_uint(n); obj_out.put(' ');
+            obj_out.put_uint(triangle.v2); obj_out.put("//", 2); obj_out.put_uint(n); obj_out.put(' ');
+            obj_out.put_uint(triangle.v3); obj_out.put("//", 2); obj_out.put_uint(n);
+        }
+        else {
+            obj_out.put_uint(triangle.v1); obj_out.put(' ');
+            obj_out.put_uint(triangle.v2); obj_out.put(' ');
+            obj_out.put_uint(triangle.v3);
+        }
+        obj_out.put('\n');
+    }
+
+    uint64_t obj_bytes = obj_out.bytes_written();
+    if (obj_out.close() < 0) {
+        logger.ERROR() << "Writing OBJ file " << filename << " failed." << std::endl;
+        return -1;
+    }
+
+    STATS_COUNT("write OBJ", obj_bytes);
+
+    LOG_INFO(logger) << "Wrote " << obj_bytes << " bytes of OBJ data to " << filename << std::endl;
+    LOG_INFO(logger) << "---------------------" << std::endl;
+    LOG_INFO(logger) << "Exported OBJ metrics:" << std::endl;
+    LOG_INFO(logger) << "Type height   " << boost::format("%6.4f") % type_height.as_inch()
               << " inch  |  "  << boost::format("%6.3f") %  type_height.as_mm() << " mm" << std::endl;
-    logger.INFO() << "Body size     " << boost::format("%6.4f") % (h*raster_size.as_inch())
+    LOG_INFO(logger) << "Body size     " << boost::format("%6.4f") % (h*raster_size.as_inch())
               << " inch  |  "  << boost::format("%6.3f") %  (h*raster_size.as_mm()) << " mm" << std::endl;
-    logger.INFO() << "Set width     " << boost::format("%6.4f") % (w*raster_size.as_inch())
+    LOG_INFO(logger) << "Set width     " << boost::format("%6.4f") % (w*raster_size.as_inch())
               << " inch  |  "  << boost::format("%6.3f") %  (w*raster_size.as_mm()) << " mm" << std::endl;
 
     return 0;
@@ -2199,6 +2782,7 @@ int TypeBitmap::writeOBJ(std::string filename)
 
 int TypeBitmap::writeSTL(std::string filename)
 {
+    STATS_TIMER("write STL");
     int i;
     int w = bm_width;
     int h = bm_height;
@@ -2218,7 +2802,7 @@ int TypeBitmap::writeSTL(std::string filename)
         return -1;
     }
 
-    logger.INFO() << "Triangle count is " << triangles.size() << std::endl;
+    LOG_INFO(logger) << "Triangle count is " << triangles.size() << std::endl;
 
     // 80 byte header - content anything but "solid" (would indicated ASCII encoding)
     for (i = 0; i < 80; i++)
@@ -2247,16 +2831,192 @@ int TypeBitmap::writeSTL(std::string filename)
     stl_out.close();
 
 
-    logger.INFO() << "Wrote binary STL data to " << filename << std::endl;
-    logger.INFO() << "---------------------" << std::endl;
-    logger.INFO() << "Exported STL metrics:" << std::endl;
-    logger.INFO() << "Type height   " << boost::format("%6.4f") % type_height.as_inch()
+    STATS_COUNT("write STL", 84 + 50 * (uint64_t)tri_cnt);
+
+    LOG_INFO(logger) << "Wrote binary STL data to " << filename << std::endl;
+    LOG_INFO(logger) << "---------------------" << std::endl;
+    LOG_INFO(logger) << "Exported STL metrics:" << std::endl;
+    LOG_INFO(logger) << "Type height   " << boost::format("%6.4f") % type_height.as_inch()
               << " inch  |  "  << boost::format("%6.3f") %  type_height.as_mm() << " mm" << std::endl;
-    logger.INFO() << "Body size     " << boost::format("%6.4f") % (h*raster_size.as_inch())
+    LOG_INFO(logger) << "Body size     " << boost::format("%6.4f") % (h*raster_size.as_inch())
               << " inch  |  "  << boost::format("%6.3f") %  (h*raster_size.as_mm()) << " mm" << std::endl;
-    logger.INFO() << "Set width     " << boost::format("%6.4f") % (w*raster_size.as_inch())
+    LOG_INFO(logger) << "Set width     " << boost::format("%6.4f") % (w*raster_size.as_inch())
               << " inch  |  "  << boost::format("%6.3f") %  (w*raster_size.as_mm()) << " mm" << std::endl;
 
     return 0;
 }
 
+
+
+// Every half-edge (welded vertex indices, in triangle order) goes into an
+// open addressing hash table. A closed, consistently wound mesh has each
+// half-edge exactly once and its opposite as well. The volume is the sum of
+// the signed tetrahedra against the origin, exact in integer coordinates.
+// Open edges along a T-junction run back and forth on one line and span no
+// area, unlike the rim of a hole.
+int TypeBitmap::check_mesh(mesh_check &check)
+{
+    check = (mesh_check){triangles.size(), 0, 0, 0, 0, 0, 0, 0};
+
+    if (triangles.empty())
+        return -1;
+
+    size_t slots = 16;
+    while (slots < 6 * triangles.size())
+        slots <<= 1;
+    std::vector<uint64_t> keys(slots, 0); // 0: empty, vertex indices start at 1
+    std::vector<uint32_t> counts(slots, 0);
+
+    auto slot_of = [&](uint64_t key) {
+        size_t i = (key * 0x9e3779b97f4a7c15ULL) >> 32 & (slots - 1);
+        while (keys[i] && (keys[i] != key))
+            i = (i + 1) & (slots - 1);
+        return i;
+    };
+
+    __int128 volume6 = 0;
+    for (mesh_triangle &T : triangles) {
+        uint32_t v[3] = {T.v1, T.v2, T.v3};
+
+        if ((v[0] == v[1]) || (v[1] == v[2]) || (v[2] == v[0])) {
+            check.degenerate++;
+            continue;
+        }
+
+        for (int k = 0; k < 3; k++) {
+            uint64_t key = ((uint64_t)v[k] << 32) | v[(k + 1) % 3];
+            size_t i = slot_of(key);
+            keys[i] = key;
+            counts[i]++;
+        }
+
+        intvec3d_t &a = vertices[v[0]];
+        intvec3d_t &b = vertices[v[1]];
+        intvec3d_t &c = vertices[v[2]];
+        volume6 += (int64_t)a.x * ((int64_t)b.y * c.z - (int64_t)b.z * c.y)
+                 - (int64_t)a.y * ((int64_t)b.x * c.z - (int64_t)b.z * c.x)
+                 + (int64_t)a.z * ((int64_t)b.x * c.y - (int64_t)b.y * c.x);
+    }
+
+    int64_t open_area2[3] = {0, 0, 0};
+    for (size_t i = 0; i < slots; i++) {
+        if (!keys[i])
+            continue;
+
+        uint64_t reverse = (keys[i] << 32) | (keys[i] >> 32);
+        size_t r = slot_of(reverse);
+
+        if (!keys[r])
+            check.shared_edges += counts[i] - 1;
+        else if (counts[i] > counts[r])
+            check.shared_edges += counts[i] - counts[r];
+        else if ((counts[i] == counts[r]) && (counts[i] > 1) && (keys[i] < reverse))
+            check.nonmanifold_edges++;
+
+        if (!keys[r]) {
+            intvec3d_t &p = vertices[keys[i] >> 32];
+            intvec3d_t &q = vertices[keys[i] & 0xffffffff];
+            open_area2[0] += (int64_t)p.y * q.z - (int64_t)p.z * q.y;
+            open_area2[1] += (int64_t)p.z * q.x - (int64_t)p.x * q.z;
+            open_area2[2] += (int64_t)p.x * q.y - (int64_t)p.y * q.x;
+            check.open_edges++;
+        }
+        if (!keys[r] || (keys[i] < reverse))
+            check.edges++;
+    }
+    check.hole_area = 0.5 * sqrt((double)open_area2[0] * open_area2[0] + (double)open_area2[1] * open_area2[1] +
+                                 (double)open_area2[2] * open_area2[2]);
+    check.volume = (double)volume6 / 6;
+
+    return 0;
+}
+
+
+int TypeBitmap::getMesh(std::vector<pos3d_t> &mesh_vertices, std::vector<idx_tri_t> &mesh_triangles)
+{
+    int i;
+
+    float RS = raster_size.as_mm();
+    float LH = layer_height.as_mm();
+
+    mesh_vertices.clear();
+    mesh_triangles.clear();
+
+    if (triangles.empty())
+        return -1;
+
+    // skip dummy vertex #0 (OBJ indexing)
+    mesh_vertices.resize(vertices.size()-1);
+    for (i=1; i<vertices.size(); i++) {
+        mesh_vertices[i-1] = (pos3d_t) { vertices[i].x * RS, vertices[i].y * RS, vertices[i].z * LH };
+    }
+
+    mesh_triangles.resize(triangles.size());
+    for (i=0; i<triangles.size(); i++) {
+        mesh_triangles[i] = (idx_tri_t) { triangles[i].v1 - 1, triangles[i].v2 - 1, triangles[i].v3 - 1 };
+    }
+
+    return 0;
+}
+
+
+int TypeBitmap::writePLY(std::string filename)
+{
+    STATS_TIMER("write PLY");
+    std::vector<pos3d_t> mesh_vertices;
+    std::vector<idx_tri_t> mesh_triangles;
+
+    if (filename.empty())
+    {
+        logger.ERROR() << "No PLY file specified." << std::endl;
+        return -1;
+    }
+
+    if (getMesh(mesh_vertices, mesh_triangles) < 0) {
+        logger.ERROR() << "No mesh generated for PLY export." << std::endl;
+        return -1;
+    }
+
+    if (::writePLY(filename, mesh_vertices, mesh_triangles) < 0) {
+        logger.ERROR() << "Could not write PLY file " << filename << std::endl;
+        return -1;
+    }
+
+    std::error_code ec;
+    STATS_COUNT("write PLY", std::filesystem::file_size(filename, ec));
+
+    LOG_INFO(logger) << "Wrote binary PLY data (" << mesh_vertices.size() << " vertices, "
+                  << mesh_triangles.size() << " triangles) to " << filename << std::endl;
+    return 0;
+}
+
+
+int TypeBitmap::write3MF(std::string filename)
+{
+    STATS_TIMER("write 3MF");
+    std::vector<pos3d_t> mesh_vertices;
+    std::vector<idx_tri_t> mesh_triangles;
+
+    if (filename.empty())
+    {
+        logger.ERROR() << "No 3MF file specified." << std::endl;
+        return -1;
+    }
+
+    if (getMesh(mesh_vertices, mesh_triangles) < 0) {
+        logger.ERROR() << "No mesh generated for 3MF export." << std::endl;
+        return -1;
+    }
+
+    if (::write3MF(filename, mesh_vertices, mesh_triangles) < 0) {
+        logger.ERROR() << "Could not write 3MF file " << filename << std::endl;
+        return -1;
+    }
+
+    std::error_code ec;
+    STATS_COUNT("write 3MF", std::filesystem::file_size(filename, ec));
+
+    LOG_INFO(logger) << "Wrote 3MF package (" << mesh_vertices.size() << " vertices, "
+                  << mesh_triangles.size() << " triangles) to " << filename << std::endl;
+    return 0;
+}
@@ -0,0 +1,288 @@
+#include "TypeSlicer.h"
+#include "AppLog.h"
+#include <cmath>
+#include <algorithm>
+
+extern AppLog logger;
+
+
+// pixels whose centers lie inside the open interval (lo, hi)
+static inline int32_t first_center(float lo)
+{
+    return int32_t(floorf(lo + 0.5f));
+}
+
+static inline int32_t end_center(float hi)
+{
+    return int32_t(ceilf(hi - 0.5f));
+}
+
+TypeSlicer::TypeSlicer() : ready(false), w(0), h(0) {}
+
+
+int TypeSlicer::setup(TypeBitmap &TBM, reduced_foot foot, std::vector<nick> &nicks,
+                      float UVstretchXY, float UVstretchZ)
+{
+    dim_t type_height, depth_of_drive, raster_size, layer_height;
+
+    ready = false;
+
+    if (!TBM.is_loaded()) {
+        logger.ERROR() << "No Bitmap loaded." << std::endl;
+        return -1;
+    }
+
+    TBM.get_type_parameters(type_height, depth_of_drive, raster_size, layer_height);
+
+    if ((raster_size.as_mm() == 0) || (layer_height.as_mm() == 0)) {
+        logger.ERROR() << "Raster size and layer height required for slicing." << std::endl;
+        return -1;
+    }
+
+    if (TBM.get_sort_geometry(foot, nicks, UVstretchXY, UVstretchZ, G) < 0)
+        return -1;
+
+    w = G.w;
+    h = G.h;
+    foot_mode = foot.mode;
+
+    // glyph ink runs
+    uint8_t *buf8 = TBM.getAddress();
+    clear_section(glyph);
+    for (int32_t y=0; y<h; y++) {
+        int32_t x = 0;
+        while (x < w) {
+            while ((x < w) && !buf8[y*w + x])
+                x++;
+            int32_t x0 = x;
+            while ((x < w) && buf8[y*w + x])
+                x++;
+            push_run(glyph, x0, x);
+        }
+        end_row(glyph);
+    }
+
+    if ((foot.mode == no_foot) || (foot.mode == pyramids))
+        body_end = G.BH;
+    else
+        body_end = G.BH - G.FZ;
+
+    if (foot.mode == supports)
+        foot_bottom = -G.FH5;
+    else if (foot.mode == pyramids)
+        foot_bottom = G.BH + G.PFH;
+    else
+        foot_bottom = G.BH;
+
+    ready = true;
+    return 0;
+}
+
+
+uint32_t TypeSlicer::getWidth()
+{
+    return ready ? w : 0;
+}
+
+
+uint32_t TypeSlicer::getHeight()
+{
+    return ready ? h : 0;
+}
+
+
+int32_t TypeSlicer::z_top()
+{
+    return G.DOD;
+}
+
+
+int32_t TypeSlicer::z_bottom()
+{
+    return -foot_bottom;
+}
+
+
+int TypeSlicer::section(int32_t z, layer_section &S)
+{
+    if (!ready)
+        return -1;
+
+    // sample at the layer's center plane
+    float zc = z - 0.5f;
+
+    if ((z > z_top()) || (z <= z_bottom())) {
+        clear_section(S);
+        for (int32_t y=0; y<h; y++)
+            end_row(S);
+        return 0;
+    }
+
+    if (zc > 0) {
+        S = glyph;
+        return 0;
+    }
+
+    clear_section(S);
+
+    if (-zc < body_end)
+        body_section(-zc, S);
+    else
+        foot_section(-zc, S);
+
+    return 0;
+}
+
+
+void TypeSlicer::body_section(float depth, layer_section &S)
+{
+    float limit = h; // rows with centers below limit are solid
+
+    for (int i=0; i<G.nick_layers.size(); i++) {
+        sort_geometry::nick_layer &seg = G.nick_layers[i];
+        float d = depth - seg.top;
+
+        if ((d < 0) || (d >= seg.NH))
+            continue;
+
+        if (seg.type == rect) {
+            limit = h - seg.RD;
+        }
+        else if (seg.type == triangle) {
+            int32_t half = seg.NH/2;
+            if (d < half)
+                limit = h - (seg.TD * d) / half;
+            else
+                limit = h - (seg.TD * (seg.NH - d)) / (seg.NH - half);
+        }
+        else if (seg.type == circle) {
+            for (int j=0; j<seg.start_z.size(); j++) {
+                if ((d >= seg.start_z[j]) && (d < seg.end_z[j])) {
+                    float t = (d - seg.start_z[j]) / (seg.end_z[j] - seg.start_z[j]);
+                    limit = h - (seg.start_y[j] + t * (seg.end_y[j] - seg.start_y[j]));
+                    break;
+                }
+            }
+        }
+        break;
+    }
+
+    int32_t rows = std::min(end_center(limit), h);
+    for (int32_t y=0; y<h; y++) {
+        if (y < rows)
+            push_run(S, 0, w);
+        end_row(S);
+    }
+}
+
+
+void TypeSlicer::foot_section(float depth, layer_section &S)
+{
+    if ((foot_mode == step) || (foot_mode == bevel) || (foot_mode == no_foot)) {
+        float inset = G.FXY;
+        if ((foot_mode == bevel) && (G.FZ > 0))
+            inset = G.FXY * (depth - body_end) / G.FZ;
+
+        int32_t y0 = first_center(inset);
+        int32_t y1 = end_center(h - inset);
+        int32_t x0 = first_center(inset);
+        int32_t x1 = end_center(w - inset);
+
+        for (int32_t y=0; y<h; y++) {
+            if ((y >= y0) && (y < y1))
+                push_run(S, x0, x1);
+            end_row(S);
+        }
+        return;
+    }
+
+    if (foot_mode == supports) {
+        // solid Y ranges within each X segment
+        std::vector<float> ys0, ys1;
+        int32_t D1 = -G.FH1, D2 = -G.FH2, D3 = -G.FH3, D4 = -G.FH4; // depths of the layer boundaries
+
+        if ((depth < D2) || ((depth >= D3) && (depth < D4))) {
+            int32_t TBC = G.SSW;
+
+            ys0.push_back(0);
+            ys1.push_back(G.SSW);
+
+            for (int i=0; i<G.support_intervalsY; i++) {
+                if (depth < D2) { // hollow triangle layer
+                    float t = (depth - D1) / (D2 - D1);
+                    ys0.push_back(TBC + t*G.HTW);
+                    ys1.push_back(TBC + G.HTW + G.IG + G.HTW - t*G.HTW);
+                }
+                else { // support gap layer
+                    ys0.push_back(TBC);
+                    ys1.push_back(TBC + G.HSW);
+                    ys0.push_back(TBC + G.HSW + G.TSG + G.IG + G.TSG);
+                    ys1.push_back(TBC + G.HSW + G.TSG + G.IG + G.TSG + G.HSW);
+                }
+                TBC += (G.HTW + G.IG + G.HTW);
+            }
+
+            ys0.push_back(TBC);
+            ys1.push_back(h);
+        }
+        else { // solid foot layer, solid base layer
+            ys0.push_back(0);
+            ys1.push_back(h);
+        }
+
+        for (int32_t y=0; y<h; y++) {
+            float yc = y + 0.5f;
+            for (int i=0; i<ys0.size(); i++) {
+                if ((yc > ys0[i]) && (yc < ys1[i])) {
+                    for (int j=0; j<G.support_segments_x1.size(); j++)
+                        push_run(S, G.support_segments_x1[j], G.support_segments_x2[j]);
+                    break;
+                }
+            }
+            end_row(S);
+        }
+        return;
+    }
+
+    if (foot_mode == pyramids) {
+        float d = depth - G.BH;
+
+        if (d >= G.PTCH + G.PH) { // foot strip
+            for (int32_t y=0; y<h; y++) {
+                push_run(S, 0, w);
+                end_row(S);
+            }
+            return;
+        }
+
+        // columns below the body, then pyramids widening towards their base
+        float t = 0;
+        if ((d >= G.PTCH) && (G.PH > 0))
+            t = (d - G.PTCH) / G.PH;
+
+        int32_t count_Y = G.pyramid_base_Y_points.size() - 1;
+        int32_t count_X = G.pyramid_base_X_points.size() - 1;
+
+        for (int32_t y=0; y<h; y++) {
+            float yc = y + 0.5f;
+            for (int i=0; i<count_Y; i++) {
+                float ya = G.pyramid_top_Y_points[i*2]   + t * (G.pyramid_base_Y_points[i]   - G.pyramid_top_Y_points[i*2]);
+                float yb = G.pyramid_top_Y_points[i*2+1] + t * (G.pyramid_base_Y_points[i+1] - G.pyramid_top_Y_points[i*2+1]);
+                if ((yc <= ya) || (yc >= yb))
+                    continue;
+
+                for (int j=0; j<count_X; j++) {
+                    float xa = G.pyramid_top_X_points[j*2]   + t * (G.pyramid_base_X_points[j]   - G.pyramid_top_X_points[j*2]);
+                    float xb = G.pyramid_top_X_points[j*2+1] + t * (G.pyramid_base_X_points[j+1] - G.pyramid_top_X_points[j*2+1]);
+                    push_run(S, first_center(xa), end_center(xb));
+                }
+                break;
+            }
+            end_row(S);
+        }
+        return;
+    }
+
+    for (int32_t y=0; y<h; y++)
+        end_row(S);
+}
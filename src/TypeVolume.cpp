@@ -0,0 +1,199 @@
+#include "TypeVolume.h"
+#include "AppLog.h"
+#include <algorithm>
+
+extern AppLog logger;
+
+
+static bool same_section(const layer_section &A, const layer_section &B)
+{
+    if ((A.row_start != B.row_start) || (A.runs.size() != B.runs.size()))
+        return false;
+
+    for (size_t i=0; i<A.runs.size(); i++) {
+        if ((A.runs[i].x0 != B.runs[i].x0) || (A.runs[i].x1 != B.runs[i].x1))
+            return false;
+    }
+    return true;
+}
+
+
+TypeVolume::TypeVolume() : w(0), h(0), z_lo(0), z_hi(0), RS(0), LH(0) {}
+
+
+void TypeVolume::clear()
+{
+    sections.clear();
+    ranges.clear();
+    w = h = 0;
+    z_lo = z_hi = 0;
+}
+
+
+int TypeVolume::build(TypeBitmap &TBM, reduced_foot foot, std::vector<nick> &nicks,
+                      float UVstretchXY, float UVstretchZ)
+{
+    TypeSlicer slicer;
+    dim_t TH, DOD, raster_size, layer_height;
+
+    if (slicer.setup(TBM, foot, nicks, UVstretchXY, UVstretchZ) < 0)
+        return -1;
+
+    TBM.get_type_parameters(TH, DOD, raster_size, layer_height);
+
+    return build(slicer, raster_size.as_mm(), layer_height.as_mm());
+}
+
+
+int TypeVolume::build(TypeSlicer &slicer, float raster_mm, float layer_mm)
+{
+    clear();
+
+    w = slicer.getWidth();
+    h = slicer.getHeight();
+    z_lo = slicer.z_bottom();
+    z_hi = slicer.z_top();
+    RS = raster_mm;
+    LH = layer_mm;
+
+    if ((w == 0) || (h == 0)) {
+        logger.ERROR() << "Slicer not set up for volume model." << std::endl;
+        return -1;
+    }
+
+    empty_section.row_start.assign(h+1, 0);
+    empty_section.runs.clear();
+
+    layer_section S;
+    for (int32_t z=z_lo+1; z<=z_hi; z++) {
+        slicer.section(z, S);
+
+        // extend current range while the section does not change
+        if (!ranges.empty() && same_section(sections[ranges.back().section], S)) {
+            ranges.back().z1 = z;
+            continue;
+        }
+
+        z_range R;
+        R.z0 = z;
+        R.z1 = z;
+        R.section = find_or_add_section(S);
+        ranges.push_back(R);
+    }
+
+    return 0;
+}
+
+
+uint32_t TypeVolume::find_or_add_section(layer_section &S)
+{
+    // sections repeat across ranges (e.g. body above and below a nick)
+    for (uint32_t i=0; i<sections.size(); i++) {
+        if (same_section(sections[i], S))
+            return i;
+    }
+    sections.push_back(S);
+    return sections.size() - 1;
+}
+
+
+uint32_t TypeVolume::getWidth()
+{
+    return w;
+}
+
+
+uint32_t TypeVolume::getHeight()
+{
+    return h;
+}
+
+
+int32_t TypeVolume::z_top()
+{
+    return z_hi;
+}
+
+
+int32_t TypeVolume::z_bottom()
+{
+    return z_lo;
+}
+
+
+uint32_t TypeVolume::section_count()
+{
+    return sections.size();
+}
+
+
+uint32_t TypeVolume::range_count()
+{
+    return ranges.size();
+}
+
+
+uint32_t TypeVolume::section_index(int32_t z)
+{
+    if (ranges.empty() || (z <= z_lo) || (z > z_hi))
+        return UINT32_MAX;
+
+    // ranges are sorted by z
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), z,
+                               [](int32_t zv, const z_range &R) { return zv < R.z0; });
+    return (it - 1)->section;
+}
+
+
+const layer_section &TypeVolume::section(int32_t z)
+{
+    uint32_t index = section_index(z);
+    if (index == UINT32_MAX)
+        return empty_section;
+
+    return sections[index];
+}
+
+
+uint64_t TypeVolume::section_area(uint32_t index)
+{
+    uint64_t area = 0;
+
+    if (index >= sections.size())
+        return 0;
+
+    const std::vector<xrun_t> &runs = sections[index].runs;
+    for (size_t i=0; i<runs.size(); i++)
+        area += runs[i].x1 - runs[i].x0;
+
+    return area;
+}
+
+
+uint64_t TypeVolume::voxel_count()
+{
+    uint64_t voxels = 0;
+
+    for (size_t i=0; i<ranges.size(); i++)
+        voxels += section_area(ranges[i].section) * (ranges[i].z1 - ranges[i].z0 + 1);
+
+    return voxels;
+}
+
+
+float TypeVolume::volume_mm3()
+{
+    return voxel_count() * RS * RS * LH;
+}
+
+
+size_t TypeVolume::memory_bytes()
+{
+    size_t bytes = ranges.size() * sizeof(z_range);
+
+    for (size_t i=0; i<sections.size(); i++) {
+        bytes += sections[i].row_start.size() * sizeof(uint32_t);
+        bytes += sections[i].runs.size() * sizeof(xrun_t);
+    }
+    return bytes;
+}
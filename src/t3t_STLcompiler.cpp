@@ -1,26 +1,146 @@
 #include "yaml.h"
 #include "t3t_support_types.h"
+#include "PlateAssembler.h"
+#include "AppLog.h"
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <thread>
+#include <deque>
+#include <atomic>
 using namespace std;
 namespace fs = std::filesystem;
 
+// Plate compiler: lays out sort STL files from the working directory on build
+// platforms (see PlateAssembler) and writes one mesh per plate.
 
 struct STLfile {
     std::string filename;
     uint32_t tri_count;
-    stl_tri_t *triangles;
-    float highX, lowX, highY, lowY, highZ, lowZ;
+    const uint8_t *triangles; // first record inside the mapping
+    void *map;
+    size_t map_size;
+    mesh_bbox bbox;
 };
 
 std::string workdir;
 
-int main()
+AppLog logger("STLcompiler", LOGMASK_NOINFO);
+
+// parse-once cache: each sort file is mapped and measured once, keyed by name,
+// and added to the assembler; failed loads are cached as -1
+std::deque<STLfile> loaded_STLs;
+std::unordered_map<std::string, int> STL_cache;
+
+int map_STL(STLfile &stl)
+{
+    stl.map = nullptr;
+    stl.map_size = 0;
+    stl.tri_count = 0;
+
+    int fd = open(stl.filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if ((fstat(fd, &st) < 0) || (st.st_size < STL_HEADER_SIZE)) {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    stl.map = map;
+    stl.map_size = st.st_size;
+    memcpy(&stl.tri_count, (uint8_t*)map + 80, 4);
+    stl.triangles = (const uint8_t*)map + STL_HEADER_SIZE;
+
+    if ((stl.tri_count == 0) ||
+        (STL_HEADER_SIZE + (size_t)stl.tri_count * STL_RECORD_SIZE > stl.map_size)) {
+        munmap(stl.map, stl.map_size);
+        stl.map = nullptr;
+        return -1;
+    }
+    return 0;
+}
+
+void unmap_STL(STLfile &stl)
+{
+    if (stl.map)
+        munmap(stl.map, stl.map_size);
+    stl.map = nullptr;
+}
+
+// Map and measure all named sorts up front with a pool of worker threads.
+// Workers only fill their own slots; the cache is filled afterwards in name
+// order, so messages and layout do not depend on thread timing.
+void preload_STLs(const std::vector<std::string> &names, PlateAssembler &plate)
 {
+    std::vector<std::string> todo;
+    for (int i=0; i<names.size(); i++) {
+        if ((STL_cache.find(names[i]) == STL_cache.end()) &&
+            (std::find(todo.begin(), todo.end(), names[i]) == todo.end()))
+            todo.push_back(names[i]);
+    }
+    if (todo.empty())
+        return;
+
+    std::vector<STLfile> loaded(todo.size());
+    std::vector<int> status(todo.size(), -1);
+    std::atomic<size_t> next(0);
+
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < todo.size()) {
+            loaded[i].filename = workdir + "/" + todo[i] + ".stl";
+            status[i] = map_STL(loaded[i]);
+            if (status[i] == 0)
+                PlateAssembler::get_bbox(loaded[i].triangles, loaded[i].tri_count, loaded[i].bbox);
+        }
+    };
+
+    size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+    thread_count = std::min(thread_count, todo.size());
+
+    std::vector<std::thread> pool;
+    for (size_t t=0; t<thread_count; t++)
+        pool.push_back(std::thread(worker));
+    for (size_t t=0; t<pool.size(); t++)
+        pool[t].join();
+
+    for (int i=0; i<todo.size(); i++) {
+        if (status[i] < 0) {
+            logger.ERROR() << "Could not read STL file " << loaded[i].filename << std::endl;
+            STL_cache[todo[i]] = -1;
+            continue;
+        }
+        loaded_STLs.push_back(loaded[i]);
+        STL_cache[todo[i]] = plate.add_mesh(todo[i], loaded[i].triangles, loaded[i].tri_count, &loaded[i].bbox);
+    }
+}
 
+int main()
+{
     YAML::Node config = YAML::LoadFile("STLcompile.yaml");
 
+    if (config["log level"]) {
+        YAML::Node levels = config["log level"];
+        if (logger.set_levels(levels["console"] ? levels["console"].as<std::string>() : "",
+                              levels["file"] ? levels["file"].as<std::string>() : "") < 0)
+            logger.WARNING() << "log level must be debug, info, warning or error." << endl;
+    }
+
     if (config["working directory"]) {
         if (config["working directory"]["path"])
             workdir = config["working directory"]["path"].as<std::string>();
@@ -28,7 +148,7 @@ int main()
 
     if (!workdir.empty()) {
         if (!fs::exists(workdir)) {
-            cerr << "Specified work directory " << workdir << " does not exist." << endl;
+            logger.ERROR() << "Specified work directory " << workdir << " does not exist." << endl;
             exit(1);
         }
     }
@@ -42,41 +162,43 @@ int main()
     float gapX = config["gap X"].as<float>();
     float gapY = config["gap Y"].as<float>();
 
-    uint32_t type_count_X = 0;
-    uint32_t type_count_Y = 0;
-
-    float posX = 0.0;
-    float posY = 0.0;
-
-    uint32_t compiled_tri_cnt = 0;
-
-    STLfile inputSTL;
-
-    // open output file
-    std::string output_path = workdir + "/compiled.stl";
-    std::ofstream stl_out(output_path, std::ios::binary);
-    if (!stl_out.is_open()) {
-        std::cerr << "ERROR: Could not open STL file for writing." << std::endl;
-        return -1;
-    }    
-
-    // 80 byte header - content anything but "solid" (would indicated ASCII encoding)
-    for (int i = 0; i < 80; i++)
-        stl_out.put('x');
-
-    stl_out.write((const char*)&compiled_tri_cnt, 4); // space for number of triangles
-
+    // output formats: stl (default), ply, 3mf
+    std::vector<std::string> formats;
+    if (config["output formats"]) {
+        for (int i=0; i<config["output formats"].size(); i++)
+            formats.push_back(config["output formats"][i].as<std::string>());
+    }
+    else {
+        formats.push_back("stl");
+    }
+    bool write_stl = std::find(formats.begin(), formats.end(), "stl") != formats.end();
+    bool write_ply = std::find(formats.begin(), formats.end(), "ply") != formats.end();
+    bool write_3mf = std::find(formats.begin(), formats.end(), "3mf") != formats.end();
+
+    // layout: rows (as listed in structure, default) or auto (packed onto the platform)
+    bool auto_mode = false;
+    bool allow_rotation = true;
+    if (config["layout"])
+        auto_mode = (config["layout"].as<std::string>() == "auto");
+    if (config["allow rotation"])
+        allow_rotation = config["allow rotation"].as<bool>();
+
+    PlateAssembler plate;
+    plate.set_platform(platformX, platformY, gapX, gapY);
+    plate.set_layout(auto_mode, allow_rotation);
 
     std::vector<std::string> structure;
 
     for(int i=0; i<config["structure"].size(); i++)
         structure.push_back(config["structure"][i].as<std::string>());
 
-    for(int i=0; i<structure.size(); i++) {
-        cout << structure[i] << endl;
+    // split rows into sort names
+    std::vector<std::vector<std::string>> lines(structure.size());
+    std::vector<std::string> names;
 
+    for(int i=0; i<structure.size(); i++) {
         std::string entry;
-        std::vector<std::string> line;
+        std::vector<std::string> &line = lines[i];
 
         for(int j=0; j<structure[i].size(); j++) {
             char c = structure[i][j];
@@ -93,113 +215,42 @@ int main()
             line.push_back(entry);
             entry.clear();
         }
+        names.insert(names.end(), line.begin(), line.end());
+    }
 
-        uint32_t max_line_y = 0;
-
-        // line items
-        for(int k=0; k<line.size(); k++) {
+    // map inputs and get bounding boxes in parallel
+    preload_STLs(names, plate);
 
-            inputSTL.filename = workdir + "/" + line[k] + ".stl";
-            ifstream stl_in(inputSTL.filename) ;
-            if (!stl_in.is_open()) {
-                std::cerr << "ERROR: Could not open STL file " << inputSTL.filename <<
-                " for reading." << std::endl;
-                continue;
-            }
-            stl_in.seekg(80);
-            stl_in.read((char*)&inputSTL.tri_count, 4);
+    for(int i=0; i<lines.size(); i++) {
+        logger.PRINT() << structure[i] << endl;
 
-            inputSTL.triangles = (stl_tri_t*)malloc(sizeof(stl_tri_t)*inputSTL.tri_count);
-            if (inputSTL.triangles) {
-                for(int m=0; m<inputSTL.tri_count; m++) {
-                    stl_in.read((char*)&(inputSTL.triangles[m]), 50);
-                }
-                stl_in.close();
-            }
-            else {
-                stl_in.close();
-                continue;
-            }
-            inputSTL.highX = inputSTL.triangles[0].V1x; inputSTL.lowX = inputSTL.triangles[0].V1x;
-            inputSTL.highY = inputSTL.triangles[0].V1y; inputSTL.lowY = inputSTL.triangles[0].V1y;
-            inputSTL.highZ = inputSTL.triangles[0].V1z; inputSTL.lowZ = inputSTL.triangles[0].V1z;
-
-            for(int m=0; m<inputSTL.tri_count; m++) {
-//cout << "V1 " << inputSTL.triangles[m].V1x << "/" << inputSTL.triangles[m].V1y << "/" << inputSTL.triangles[m].V1z << endl;
-//cout << "V2 " << inputSTL.triangles[m].V2x << "/" << inputSTL.triangles[m].V2y << "/" << inputSTL.triangles[m].V2z << endl;
-//cout << "V3 " << inputSTL.triangles[m].V3x << "/" << inputSTL.triangles[m].V3y << "/" << inputSTL.triangles[m].V3z << endl << endl;
-
-                if (inputSTL.triangles[m].V1x > inputSTL.highX) inputSTL.highX = inputSTL.triangles[m].V1x;
-                if (inputSTL.triangles[m].V1x <  inputSTL.lowX)  inputSTL.lowX = inputSTL.triangles[m].V1x;
-                if (inputSTL.triangles[m].V2x > inputSTL.highX) inputSTL.highX = inputSTL.triangles[m].V2x;
-                if (inputSTL.triangles[m].V2x <  inputSTL.lowX)  inputSTL.lowX = inputSTL.triangles[m].V2x;
-                if (inputSTL.triangles[m].V3x > inputSTL.highX) inputSTL.highX = inputSTL.triangles[m].V3x;
-                if (inputSTL.triangles[m].V3x <  inputSTL.lowX)  inputSTL.lowX = inputSTL.triangles[m].V3x;
-
-                if (inputSTL.triangles[m].V1y > inputSTL.highY) inputSTL.highY = inputSTL.triangles[m].V1y;
-                if (inputSTL.triangles[m].V1y <  inputSTL.lowY)  inputSTL.lowY = inputSTL.triangles[m].V1y;
-                if (inputSTL.triangles[m].V2y > inputSTL.highY) inputSTL.highY = inputSTL.triangles[m].V2y;
-                if (inputSTL.triangles[m].V2y <  inputSTL.lowY)  inputSTL.lowY = inputSTL.triangles[m].V2y;
-                if (inputSTL.triangles[m].V3y > inputSTL.highY) inputSTL.highY = inputSTL.triangles[m].V3y;
-                if (inputSTL.triangles[m].V3y <  inputSTL.lowY)  inputSTL.lowY = inputSTL.triangles[m].V3y;
-
-                if (inputSTL.triangles[m].V1z > inputSTL.highZ) inputSTL.highZ = inputSTL.triangles[m].V1z;
-                if (inputSTL.triangles[m].V1z <  inputSTL.lowZ)  inputSTL.lowZ = inputSTL.triangles[m].V1z;
-                if (inputSTL.triangles[m].V2z > inputSTL.highZ) inputSTL.highZ = inputSTL.triangles[m].V2z;
-                if (inputSTL.triangles[m].V2z <  inputSTL.lowZ)  inputSTL.lowZ = inputSTL.triangles[m].V2z;
-                if (inputSTL.triangles[m].V3z > inputSTL.highZ) inputSTL.highZ = inputSTL.triangles[m].V3z;
-                if (inputSTL.triangles[m].V3z <  inputSTL.lowZ)  inputSTL.lowZ = inputSTL.triangles[m].V3z;
-            }
-            
-            /*
-            cout << "X " << inputSTL.lowX << ".." << inputSTL.highX;
-            cout << "   Y " << inputSTL.lowY << ".." << inputSTL.highY;
-            cout << "   Z " << inputSTL.lowZ << ".." << inputSTL.highZ;
-            cout << endl;
-            */
-
-            float offsetX = posX -(inputSTL.lowX);
-            float offsetY = posY -(inputSTL.lowY);
-            float offsetZ = -(inputSTL.lowZ);
-
-            for(int m=0; m<inputSTL.tri_count; m++) {
-                inputSTL.triangles[m].V1x += offsetX;
-                inputSTL.triangles[m].V2x += offsetX;
-                inputSTL.triangles[m].V3x += offsetX;
-
-                inputSTL.triangles[m].V1y += offsetY;
-                inputSTL.triangles[m].V2y += offsetY;
-                inputSTL.triangles[m].V3y += offsetY;
-
-                inputSTL.triangles[m].V1z += offsetZ;
-                inputSTL.triangles[m].V2z += offsetZ;
-                inputSTL.triangles[m].V3z += offsetZ;
-            }
-
-            for(int m=0; m<inputSTL.tri_count; m++) {
-                stl_out.write((const char*)&(inputSTL.triangles[m]), 50);
-            }
-            compiled_tri_cnt += inputSTL.tri_count;
+        std::vector<int> row;
+        for(int k=0; k<lines[i].size(); k++) {
+            int mesh = STL_cache[lines[i][k]];
+            if (mesh >= 0)
+                row.push_back(mesh);
+        }
+        plate.add_row(row);
+    }
 
-            free(inputSTL.triangles);
+    int plate_count = plate.layout();
 
-            posX += (inputSTL.highX-inputSTL.lowX);
-            posX += gapX;
-        }
+    for (int i=0; i<plate_count; i++) {
+        logger.PRINT() << "Plate " << i+1 << ": " << plate.plate_sort_count(i) << " sorts, fill " <<
+            100.0 * plate.plate_fill(i) << "%" << endl;
+    }
 
-        if ((inputSTL.highY-inputSTL.lowY) > max_line_y)
-            max_line_y = (inputSTL.highY-inputSTL.lowY);
+    // a single plate keeps the plain compiled.* names
+    int result = plate.write_plates(workdir + "/compiled", write_stl, write_ply, write_3mf);
 
-        // ADD Y- POS, set X = 0;
-        posY -= max_line_y;
-        posY -= gapY;
-        posX = 0.0;
+    if (plate.skipped_count())
+    {
+        logger.ERROR() << plate.skipped_count() << " sort(s) larger than the platform were left out." << endl;
+        result = -1;
     }
 
-    stl_out.seekp(80);
-    stl_out.write((const char*)&compiled_tri_cnt, 4);
-    stl_out.close();
-    
-    stl_out.close();
-    return 0;
-}
\ No newline at end of file
+    for (int i=0; i<loaded_STLs.size(); i++)
+        unmap_STL(loaded_STLs[i]);
+
+    return result;
+}
@@ -0,0 +1,355 @@
+#include "TypeBitmap.h"
+#include "StressBitmap.h"
+#include "AppLog.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+#include <sstream>
+
+using namespace std;
+namespace fs = std::filesystem;
+namespace bpo = boost::program_options;
+
+struct
+{
+    std::vector<uint32_t> sizes_pt;
+    std::vector<std::string> patterns;
+    std::vector<std::string> ops;
+    uint32_t reps;
+    uint32_t cell_px; // checkerboard / noise cell size, 0: scaled with the body size
+    float budget_s;   // a pattern whose mesh took longer skips the other modes and sizes, 0: no limit
+    std::string out_path;
+    std::string csv_path; // one line per measurement, for charting
+
+    dim_t type_height;
+    dim_t depth_of_drive;
+    dim_t raster_size;
+    dim_t layer_height;
+
+} opts = {.reps = 3, .cell_px = 0, .budget_s = 5};
+
+std::vector<std::string> over_budget; // patterns
+std::ofstream csv;
+
+// access to the private hot paths of TypeBitmap
+struct TypeBitmapBench
+{
+    static int find_rectangles(TypeBitmap &TBM) { return TBM.find_rectangles(); }
+
+    static void clear_mesh(TypeBitmap &TBM)
+    {
+        TBM.vertices.clear();
+        TBM.vertices.push_back((intvec3d_t){INT32_MIN, INT32_MIN, INT32_MIN});
+        TBM.triangles.clear();
+    }
+
+    static void add_vertex(TypeBitmap &TBM, intvec3d_t v) { TBM.vertices.push_back(v); }
+    static void pop_vertex(TypeBitmap &TBM) { TBM.vertices.pop_back(); }
+    static uint32_t vertex_count(TypeBitmap &TBM) { return TBM.vertices.size(); }
+    static uint32_t triangle_count(TypeBitmap &TBM) { return TBM.triangles.size(); }
+
+    static uint32_t find_or_add_vertex(TypeBitmap &TBM, intvec3d_t v) { return TBM.find_or_add_vertex(v); }
+
+    static void push_quad(TypeBitmap &TBM, int32_t x, int32_t y)
+    {
+        TBM.push_triangles((intvec3d_t){0, 0, 1},
+                           (intvec3d_t){x + 1, -y, 0}, (intvec3d_t){x, -(y + 1), 0},
+                           (intvec3d_t){x, -y, 0}, (intvec3d_t){x + 1, -(y + 1), 0});
+    }
+};
+
+AppLog logger("bench", LOGMASK_NOINFO);
+const std::string version("(v0.1)");
+
+int parse_options(int ac, char *av[]);
+bool selected(std::vector<std::string> &list, std::string name);
+int make_pattern(TypeBitmap &TBM, std::string pattern, uint32_t size_pt);
+double time_ns(std::function<int()> op, uint32_t reps);
+void report(std::string pattern, uint32_t size_pt, TypeBitmap &TBM, std::string op,
+            double ns, uint64_t triangles, uint64_t bytes);
+int bench_bitmap(std::string pattern, uint32_t size_pt);
+int bench_weld();
+
+int main(int ac, char *av[])
+{
+    logger.PRINT() << "t3t_bench " << version << std::endl;
+
+    parse_options(ac, av);
+
+    if (!fs::exists(opts.out_path) && !fs::create_directories(opts.out_path))
+    {
+        logger.ERROR() << "Creating output directory " << opts.out_path << " failed." << endl;
+        exit(1);
+    }
+
+    if (!opts.csv_path.empty())
+    {
+        csv.open(opts.csv_path);
+        if (!csv.is_open())
+        {
+            logger.ERROR() << "Could not open " << opts.csv_path << " for writing." << endl;
+            exit(1);
+        }
+        csv << "pattern,pt,width,height,op,ms,triangles,bytes" << endl;
+    }
+
+    logger.PRINT() << boost::format("%-9s %5s %11s %-16s %11s %10s %12s %12s")
+                      % "pattern" % "pt" % "pixels" % "op" % "ms" % "ns/pixel" % "tri/s" % "bytes/s" << endl;
+
+    for (uint32_t size_pt : opts.sizes_pt)
+        for (int f = 0; f < stress_family_count; f++)
+            if (selected(opts.patterns, stress_families[f]))
+                bench_bitmap(stress_families[f], size_pt);
+
+    if (selected(opts.ops, "weld"))
+        bench_weld();
+
+    return 0;
+}
+
+bool selected(std::vector<std::string> &list, std::string name)
+{
+    return list.empty() || (std::find(list.begin(), list.end(), name) != list.end());
+}
+
+// minimum over the repetitions, stops repeating once a second is spent
+double time_ns(std::function<int()> op, uint32_t reps)
+{
+    double best = -1;
+    double spent = 0;
+
+    for (uint32_t r = 0; (r < std::max(reps, 1u)) && (spent < 1e9); r++)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        if (op() < 0)
+            return -1;
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        spent += ns;
+        if ((best < 0) || (ns < best))
+            best = ns;
+    }
+    return best;
+}
+
+void report(std::string pattern, uint32_t size_pt, TypeBitmap &TBM, std::string op,
+            double ns, uint64_t triangles, uint64_t bytes)
+{
+    uint64_t pixels = (uint64_t)TBM.getWidth() * TBM.getHeight();
+    std::string tri_rate = triangles ? (boost::format("%.4g") % (triangles * 1e9 / ns)).str() : "";
+    std::string byte_rate = bytes ? (boost::format("%.4g") % (bytes * 1e9 / ns)).str() : "";
+
+    logger.PRINT() << boost::format("%-9s %5u %11s %-16s %11.3f %10.2f %12s %12s")
+                      % pattern % size_pt % (boost::format("%ux%u") % TBM.getWidth() % TBM.getHeight()).str()
+                      % op % (ns / 1e6) % (pixels ? ns / pixels : 0) % tri_rate % byte_rate << endl;
+
+    if (csv.is_open())
+        csv << pattern << "," << size_pt << "," << TBM.getWidth() << "," << TBM.getHeight() << ","
+            << op << "," << (ns / 1e6) << "," << triangles << "," << bytes << endl;
+}
+
+// Synthetic sort bitmaps: the height is the body size in raster pixels, the
+// width 0.6 of it; cells and strokes scale with the size so the structure
+// count stays comparable between sizes.
+int make_pattern(TypeBitmap &TBM, std::string pattern, uint32_t size_pt)
+{
+    stress_params params;
+    params.family = pattern;
+    params.height = uint32_t(round(dim_t(size_pt, pt).as_mm() / opts.raster_size.as_mm()));
+    params.width = uint32_t(round(params.height * 0.6));
+    params.cell = opts.cell_px;
+    params.density = 0.5;
+    params.seed = 0xB747;
+
+    return make_stress_bitmap(TBM, params);
+}
+
+int bench_bitmap(std::string pattern, uint32_t size_pt)
+{
+    TypeBitmap TBM;
+    std::vector<nick> nicks;
+    nick flat_nick;
+    flat_nick.type = flat;
+    flat_nick.z = dim_t(5.0, mm);
+    nicks.push_back(flat_nick);
+
+    TBM.set_type_parameters(opts.type_height, opts.depth_of_drive, opts.raster_size, opts.layer_height);
+    if (make_pattern(TBM, pattern, size_pt) < 0)
+    {
+        logger.ERROR() << "Could not allocate " << pattern << " bitmap." << endl;
+        return -1;
+    }
+
+    if (selected(opts.ops, "rects"))
+    {
+        double ns = time_ns([&]() { return TypeBitmapBench::find_rectangles(TBM); }, opts.reps);
+        report(pattern, size_pt, TBM, "find_rectangles", ns, 0, 0);
+    }
+
+    if (std::find(over_budget.begin(), over_budget.end(), pattern) != over_budget.end())
+    {
+        logger.PRINT() << boost::format("%-9s %5u %11s %-16s %11s")
+                          % pattern % size_pt % "" % "mesh" % "over budget" << endl;
+        return 0;
+    }
+
+    if (selected(opts.ops, "mesh") || selected(opts.ops, "write"))
+    {
+        const char *mode_names[] = {"no_foot", "bevel", "step", "supports", "pyramids"};
+        reduced_foot_mode modes[] = {no_foot, bevel, step, supports, pyramids};
+
+        for (int m = 0; m < 5; m++)
+        {
+            reduced_foot foot;
+            foot.mode = modes[m];
+            foot.XY = dim_t(0.6, mm);
+            foot.Z = dim_t(4.0, mm);
+            foot.pyramid_pitch = dim_t(1.7, mm);
+            foot.pyramid_top_length = dim_t(0.25, mm);
+            foot.pyramid_top_column_height = dim_t(0.5, mm);
+            foot.pyramid_foot_height = dim_t(3.0, mm);
+            foot.pyramid_height_factor = 1.0;
+
+            if ((m > 0) && !selected(opts.ops, "mesh"))
+                break; // writers only need one mesh
+            if ((m > 0) && (std::find(over_budget.begin(), over_budget.end(), pattern) != over_budget.end()))
+                break; // the other foot modes cost about the same
+
+            double ns = time_ns([&]() { return TBM.generateMesh(foot, nicks, 1.0, 1.0); }, opts.reps);
+            if (selected(opts.ops, "mesh"))
+                report(pattern, size_pt, TBM, std::string("mesh ") + mode_names[m], ns,
+                       TypeBitmapBench::triangle_count(TBM), 0);
+            if ((opts.budget_s > 0) && (ns > opts.budget_s * 1e9))
+                over_budget.push_back(pattern);
+
+            if ((m == 0) && selected(opts.ops, "write"))
+            {
+                std::string base = opts.out_path + "/" + pattern + "_" + std::to_string(size_pt);
+                std::error_code ec;
+
+                ns = time_ns([&]() { return TBM.writeSTL(base + ".stl"); }, opts.reps);
+                report(pattern, size_pt, TBM, "writeSTL", ns, TypeBitmapBench::triangle_count(TBM),
+                       fs::file_size(base + ".stl", ec));
+
+                ns = time_ns([&]() { return TBM.writeOBJ(base + ".obj"); }, opts.reps);
+                report(pattern, size_pt, TBM, "writeOBJ", ns, TypeBitmapBench::triangle_count(TBM),
+                       fs::file_size(base + ".obj", ec));
+            }
+        }
+    }
+    return 0;
+}
+
+// vertex welding on its own: lookups hitting and missing a vertex list of a
+// given size, and pushing quads of a grid into an empty mesh. The pixels
+// column holds the vertex / quad count, ns/pixel is per lookup / quad.
+int bench_weld()
+{
+    TypeBitmap TBM;
+    TBM.set_type_parameters(opts.type_height, opts.depth_of_drive, opts.raster_size, opts.layer_height);
+
+    for (uint32_t count : {1000u, 10000u, 100000u})
+    {
+        const uint32_t LOOKUPS = 1000;
+        uint32_t side = uint32_t(ceil(sqrt(count)));
+
+        TypeBitmapBench::clear_mesh(TBM);
+        for (uint32_t i = 0; i < count; i++)
+            TypeBitmapBench::add_vertex(TBM, (intvec3d_t){int32_t(i % side), -int32_t(i / side), 0});
+
+        double ns = time_ns([&]() {
+            uint32_t found = 0;
+            for (uint32_t i = 0; i < LOOKUPS; i++)
+            {
+                uint32_t v = (i * 7919) % count;
+                found += TypeBitmapBench::find_or_add_vertex(TBM, (intvec3d_t){int32_t(v % side), -int32_t(v / side), 0});
+            }
+            return found ? 0 : -1;
+        }, opts.reps);
+        logger.PRINT() << boost::format("%-9s %5s %11u %-16s %11.3f %10.2f")
+                          % "weld" % "" % count % "vertex hit" % (ns / 1e6) % (ns / LOOKUPS) << endl;
+
+        ns = time_ns([&]() {
+            for (uint32_t i = 0; i < LOOKUPS; i++)
+            {
+                TypeBitmapBench::find_or_add_vertex(TBM, (intvec3d_t){int32_t(i), 1, 1});
+                TypeBitmapBench::pop_vertex(TBM);
+            }
+            return 0;
+        }, opts.reps);
+        logger.PRINT() << boost::format("%-9s %5s %11u %-16s %11.3f %10.2f")
+                          % "weld" % "" % count % "vertex miss" % (ns / 1e6) % (ns / LOOKUPS) << endl;
+    }
+
+    for (uint32_t quads : {1000u, 10000u})
+    {
+        uint32_t side = uint32_t(ceil(sqrt(quads)));
+
+        double ns = time_ns([&]() {
+            TypeBitmapBench::clear_mesh(TBM);
+            for (uint32_t i = 0; i < quads; i++)
+                TypeBitmapBench::push_quad(TBM, i % side, i / side);
+            return 0;
+        }, opts.reps);
+        logger.PRINT() << boost::format("%-9s %5s %11u %-16s %11.3f %10.2f %12.4g")
+                          % "weld" % "" % quads % "push_triangles" % (ns / 1e6) % (ns / quads)
+                          % (TypeBitmapBench::triangle_count(TBM) * 1e9 / ns) << endl;
+    }
+    return 0;
+}
+
+int parse_options(int ac, char *av[])
+{
+    std::string sizes_arg = "24,48,72,144";
+    std::string patterns_arg;
+    std::string ops_arg;
+
+    opts.out_path = (fs::temp_directory_path() / "t3t_bench").string();
+    opts.type_height = dim_t(0.918, inch);
+    opts.depth_of_drive = dim_t(2.0, mm);
+    opts.raster_size = dim_t(0.0285, mm);
+    opts.layer_height = dim_t(0.05, mm);
+
+    try
+    {
+        bpo::options_description desc("t3t_bench: Command-line options and arguments");
+        desc.add_options()("help", "produce this help message")("sizes,s", bpo::value<std::string>(&sizes_arg), "body sizes in pt, comma separated (default 24,48,72,144)")("patterns,p", bpo::value<std::string>(&patterns_arg), "solid, empty, checker, noise, diagonals, text, logo, blobs (default all)")("ops,o", bpo::value<std::string>(&ops_arg), "rects, mesh, write, weld (default all)")("reps,r", bpo::value<uint32_t>(&opts.reps), "repetitions, best is reported (default 3)")("cell,c", bpo::value<uint32_t>(&opts.cell_px), "structure size in pixels: checker/noise cell, line pitch, x-height, ring width (default 1/40 of the body)")("budget,b", bpo::value<float>(&opts.budget_s), "seconds per mesh before a pattern skips the other foot modes and larger sizes (default 5, 0: no limit)")("out", bpo::value<std::string>(&opts.out_path), "directory for written STL/OBJ files")("csv", bpo::value<std::string>(&opts.csv_path), "also write all measurements to this CSV file");
+        bpo::variables_map vm;
+        bpo::store(bpo::command_line_parser(ac, av).options(desc).run(), vm);
+        bpo::notify(vm);
+
+        if (vm.count("help"))
+        {
+            logger.PRINT() << desc << "\n";
+            exit(0);
+        }
+    }
+    catch (exception &e)
+    {
+        logger.ERROR() << e.what() << "\n";
+        exit(1);
+    }
+
+    std::string item;
+    std::stringstream sizes(sizes_arg);
+    while (getline(sizes, item, ','))
+        if (atoi(item.c_str()) > 0)
+            opts.sizes_pt.push_back(atoi(item.c_str()));
+
+    std::stringstream patterns(patterns_arg);
+    while (getline(patterns, item, ','))
+        if (!item.empty())
+            opts.patterns.push_back(item);
+
+    std::stringstream ops(ops_arg);
+    while (getline(ops, item, ','))
+        if (!item.empty())
+            opts.ops.push_back(item);
+
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include "yaml.h"
 #include "TypeBitmap.h"
+#include "GrayImage.h"
 #include "AppLog.h"
 #include <iostream>
 #include <fstream>
@@ -12,6 +13,9 @@
 #include <stdexcept>
 #include <string>
 #include <array>
+#include <thread>
+#include <algorithm>
+#include <atomic>
 
 using namespace std;
 namespace fs = std::filesystem;
@@ -29,14 +33,25 @@ struct {
     std::string work_path;
         bool create_work_path;
 
+    std::string threshold; // percent or "otsu"
+    bool use_convert;
+
+    std::vector<std::string> images; // batch mode: characters: images: list
+    uint32_t jobs;
+    bool force;
+
     float XYshrink_pct;
 
-} opts = { .create_work_path = false, .XYshrink_pct = 0 };
+} opts = { .create_work_path = false, .threshold = "50", .use_convert = false, .jobs = 0, .force = false, .XYshrink_pct = 0 };
 
 
 std::string make_ASCII_Unicode_string(uint32_t unicode);
 int parse_options(int ac, char* av[]);
 int get_yaml_dim_node(YAML::Node &parent, std::string name, dim_t &target);
+int convert_native(std::string image_path, std::string pbm_path, uint32_t body_size);
+int convert_imagemagick(std::string image_path, std::string pbm_path, uint32_t body_size);
+int convert_batch(uint32_t body_size);
+std::string find_source_image(std::string base_path);
 
 
 
@@ -71,14 +86,6 @@ int main(int ac, char* av[])
 
     parse_options(ac, av);
 
-    std::string shell_output;
-
-    if (shellcall("which convert", shell_output) != 0) {
-        logger.ERROR() << "'convert' tool not found." << std::endl
-                << "       Please install ImageMagick package before using t3t_image2pbm" << std::endl;
-        exit(1);
-    }
-
     if (!opts.work_path.empty()) {
         if (!fs::exists(opts.work_path)) {
             if (opts.create_work_path) {
@@ -105,17 +112,191 @@ int main(int ac, char* av[])
 
     uint32_t body_size = uint32_t(round(opts.body_size.as_inch() * dpi));
 
+    if ((opts.threshold != "otsu") &&
+        ((atof(opts.threshold.c_str()) <= 0) || (atof(opts.threshold.c_str()) > 100))) {
+        logger.ERROR() << "Threshold must be a percentage (0..100] or 'otsu'." << std::endl;
+        exit(1);
+    }
+
+    // built-in decoder for PNM/PNG, ImageMagick for everything else
+    int result;
+    if (opts.image_path.empty() && !opts.images.empty())
+        result = convert_batch(body_size);
+    else if (opts.image_path.empty()) {
+        logger.ERROR() << "No image specified (--image or characters: images: list)." << std::endl;
+        result = 1;
+    }
+    else if (!opts.use_convert && GrayImage::is_supported(opts.image_path))
+        result = convert_native(opts.image_path, opts.image_path + ".pbm", body_size);
+    else
+        result = convert_imagemagick(opts.image_path, opts.image_path + ".pbm", body_size);
+
+    if (result != 0)
+        exit(result);
+
+    return 0;
+}
+
+
+// Batch mode: converts every entry of the images list, <work path>/<name>.<ext>
+// to <work path>/<name>.pbm as t3t_pbm2stl expects it, on a pool of workers.
+// Up-to-date bitmaps (newer than their source) are skipped unless forced.
+int convert_batch(uint32_t body_size)
+{
+    std::vector<std::string> sources(opts.images.size());
+    std::vector<std::string> targets(opts.images.size());
+    std::vector<int> results(opts.images.size(), 0);
+    std::vector<int> todo;
+    uint32_t skipped = 0;
+
+    for (int i=0; i<opts.images.size(); i++) {
+        std::string base_path = opts.work_path + "/" + opts.images[i];
+        targets[i] = base_path + ".pbm";
+        sources[i] = find_source_image(base_path);
+
+        if (sources[i].empty()) {
+            if (!fs::exists(targets[i])) {
+                logger.ERROR() << "No source image found for " << opts.images[i] << std::endl;
+                results[i] = 1;
+            }
+            continue; // bitmap only, nothing to convert
+        }
+
+        if (!opts.force && fs::exists(targets[i]) &&
+            (fs::last_write_time(targets[i]) > fs::last_write_time(sources[i]))) {
+            logger.INFO() << targets[i] << " is up to date." << std::endl;
+            skipped++;
+            continue;
+        }
+        todo.push_back(i);
+    }
+
+    // largest sources first, so no big image starts when the others are done
+    std::vector<uintmax_t> source_bytes(opts.images.size(), 0);
+    for (int i : todo) {
+        std::error_code ec;
+        source_bytes[i] = fs::file_size(sources[i], ec);
+    }
+    std::stable_sort(todo.begin(), todo.end(), [&](int a, int b) { return source_bytes[a] > source_bytes[b]; });
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t n;
+        while ((n = next++) < todo.size()) {
+            int i = todo[n];
+            if (!opts.use_convert && GrayImage::is_supported(sources[i]))
+                results[i] = convert_native(sources[i], targets[i], body_size);
+            else
+                results[i] = convert_imagemagick(sources[i], targets[i], body_size);
+        }
+    };
+
+    uint32_t thread_count = opts.jobs ? opts.jobs : std::max(1u, std::thread::hardware_concurrency());
+    thread_count = std::min(thread_count, (uint32_t)todo.size());
+
+    std::vector<std::thread> pool;
+    for (uint32_t t=0; t<thread_count; t++)
+        pool.push_back(std::thread(worker));
+    for (uint32_t t=0; t<pool.size(); t++)
+        pool[t].join();
+
+    int failed = 0;
+    for (int i=0; i<results.size(); i++) {
+        if (results[i] != 0)
+            failed++;
+    }
+    int converted = 0;
+    for (int n=0; n<todo.size(); n++) {
+        if (results[todo[n]] == 0)
+            converted++;
+    }
+
+    logger.PRINT() << "Converted " << converted << " of " << opts.images.size()
+                   << " images (" << skipped << " up to date, " << failed << " failed)" << std::endl;
+
+    return failed ? 1 : 0;
+}
+
+
+// source image for a batch entry: the name itself if it has a suffix,
+// else the first existing <name>.<ext> of the usual image formats
+std::string find_source_image(std::string base_path)
+{
+    static const char *extensions[] = {"png", "pgm", "ppm", "pnm", "tif", "tiff", "jpg", "jpeg",
+                                       "gif", "bmp", "PNG", "TIF", "TIFF", "JPG", "JPEG"};
+
+    if (fs::path(base_path).has_extension() && (fs::path(base_path).extension() != ".pbm") &&
+        fs::exists(base_path))
+        return base_path;
+
+    for (const char *ext : extensions) {
+        std::string path = base_path + "." + ext;
+        if (fs::exists(path))
+            return path;
+    }
+    return "";
+}
+
+
+// decode, resize to body size by area averaging, then threshold
+int convert_native(std::string image_path, std::string pbm_path, uint32_t body_size)
+{
+    GrayImage image, resized;
+    TypeBitmap TBM;
+
+    if (image.load(image_path) < 0)
+        return 1;
+
+    if (image.resize_to_height(body_size, resized) < 0) {
+        logger.ERROR() << "Resizing " << image_path << " failed." << std::endl;
+        return 1;
+    }
+
+    uint8_t thr;
+    if (opts.threshold == "otsu")
+        thr = resized.otsu_threshold();
+    else
+        thr = uint8_t(round(atof(opts.threshold.c_str()) * 255 / 100));
+
+    if (resized.threshold(thr, TBM) < 0)
+        return 1;
+
+    if (TBM.store(pbm_path) < 0)
+        return 1;
+
+    logger.PRINT() << "Converted " << image_path << " (" << image.getWidth() << "x" << image.getHeight()
+                   << ") to " << TBM.getWidth() << "x" << TBM.getHeight() << " PBM, threshold "
+                   << int(thr) << std::endl;
+    return 0;
+}
+
+
+int convert_imagemagick(std::string image_path, std::string pbm_path, uint32_t body_size)
+{
+    std::string shell_output;
+
+    if (shellcall("which convert", shell_output) != 0) {
+        logger.ERROR() << "'convert' tool not found." << std::endl
+                << "       Please install ImageMagick package to convert formats other than PNM and PNG" << std::endl;
+        return 1;
+    }
+
+    // resize first, so the threshold sees the averaged edges
     std::stringstream convert_call;
-    convert_call << "convert" << " " << opts.image_path << " -threshold 50% -resize x" << body_size << " " << opts.image_path << ".pbm";
+    convert_call << "convert" << " " << image_path << " -resize x" << body_size;
+    if (opts.threshold == "otsu")
+        convert_call << " -auto-threshold otsu";
+    else
+        convert_call << " -threshold " << opts.threshold << "%";
+    convert_call << " " << pbm_path;
     logger.PRINT() << convert_call.str() << std::endl;
 
     int shell_call_code;
     shell_call_code = shellcall(convert_call.str(), shell_output);
     if (shell_call_code != 0) {
-       logger.ERROR() << "Converting " << opts.image_path << "to PBM failed with error code " << shell_call_code << std::endl;
-        exit(shell_call_code);
+       logger.ERROR() << "Converting " << image_path << "to PBM failed with error code " << shell_call_code << std::endl;
+        return shell_call_code;
     }
-
     return 0;
 }
 
@@ -157,6 +338,10 @@ int parse_options(int ac, char* av[])
         desc.add_options()
             ("help", "produce this help message")
             ("image,i", bpo::value<std::string>(&opts.image_path), "specify input image path")
+            ("threshold,t", bpo::value<std::string>(&opts.threshold), "threshold in percent (default 50) or 'otsu'")
+            ("convert", bpo::bool_switch(&opts.use_convert), "use ImageMagick convert instead of the built-in decoder")
+            ("jobs,j", bpo::value<uint32_t>(&opts.jobs), "number of parallel conversions in batch mode (default: all cores)")
+            ("force,f", bpo::bool_switch(&opts.force), "convert images even if their PBM is up to date")
             ("yaml,y", bpo::value< vector<string> >(&yaml_paths), "specify YAML configuration file(s)")
         ;
 
@@ -201,6 +386,14 @@ int parse_options(int ac, char* av[])
         get_yaml_dim_node(config, "raster size", opts.raster_size);
         get_yaml_dim_node(config, "body size", opts.body_size);
 
+        // log levels (debug, info, warning, error) for console and log file
+        if (config["log level"]) {
+            YAML::Node levels = config["log level"];
+            if (logger.set_levels(levels["console"] ? levels["console"].as<std::string>() : "",
+                                  levels["file"] ? levels["file"].as<std::string>() : "") < 0)
+                logger.WARNING() << "log level must be debug, info, warning or error." << endl;
+        }
+
         if (config["working directory"]) {
             if (config["working directory"]["path"])
                 opts.work_path = config["working directory"]["path"].as<std::string>();
@@ -213,6 +406,20 @@ int parse_options(int ac, char* av[])
             opts.XYshrink_pct = config["XYshrink_pct"].as<float>();
         }
 
+        if (config["image threshold"] && !vm.count("threshold"))
+            opts.threshold = config["image threshold"].as<std::string>();
+
+        // same list t3t_pbm2stl reads, converted in batch mode when no --image is given
+        if (config["characters"] && config["characters"]["images"]) {
+            YAML::Node images = config["characters"]["images"];
+            for (int i=0; i<images.size(); i++) {
+                std::string image = images[i].as<std::string>();
+                if (image.ends_with(".pbm"))
+                    image.erase(image.length() - 4);
+                opts.images.push_back(image);
+            }
+        }
+
     }
     catch(exception& e) {
         logger.ERROR() << e.what() << "\n";
@@ -0,0 +1,647 @@
+#include "yaml.h"
+#include "TypeBitmap.h"
+#include "TypeVolume.h"
+#include "MeshWriter.h"
+#include "AppLog.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+#include <sstream>
+#include <cstring>
+#include <memory>
+
+using namespace std;
+namespace fs = std::filesystem;
+namespace bpo = boost::program_options;
+
+// Direct MSLA layer-stack output: slices a whole platform of sorts straight
+// from their bitmaps and body/foot/nick parameters, no STL in between.
+// Platform layout follows t3t_STLcompiler (rows of sorts, gaps in mm).
+// Each sort is held as a run-length volume (TypeVolume), so a layer only has to
+// be rendered when one of the sorts changes its cross-section.
+
+struct
+{
+    dim_t type_height;
+    dim_t depth_of_drive;
+
+    dim_t raster_size;
+    dim_t layer_height;
+
+    reduced_foot foot;
+
+    std::vector<nick> nicks;
+
+    std::string work_path;
+    std::string platform_path;
+    std::string slice_dir;
+    bool rle;
+
+    float platformX, platformY; // mm
+    float gapX, gapY;           // mm
+    std::vector<std::string> structure;
+
+    float XYshrink_pct;
+    float UVstretchXY;
+
+    float Zshrink_pct;
+    float UVstretchZ;
+
+    float edge_px; // outline growth (> 0) or thinning (< 0) in pixels
+
+} opts = {.platform_path = "STLcompile.yaml", .slice_dir = "slices", .rle = false,
+          .platformX = 0, .platformY = 0, .gapX = 0, .gapY = 0, .XYshrink_pct = 0, .Zshrink_pct = 0, .edge_px = 0};
+
+struct placed_sort {
+    std::string name;
+    std::unique_ptr<TypeVolume> volume;
+    uint32_t last_section;
+    int32_t posX, posY; // top left corner on platform, in pixels
+};
+
+int parse_options(int ac, char *av[]);
+int parse_platform(std::string filename);
+int get_yaml_dim_node(YAML::Node &parent, std::string name, dim_t &target);
+void render_section(const layer_section &S, uint8_t *plane, uint32_t stride, int32_t posX, int32_t posY);
+int write_layer_PBM(std::string filename, uint8_t *plane, uint32_t width, uint32_t height, uint32_t layer);
+void write_layer_RLE(OutBuffer &rle_out, uint8_t *plane, uint32_t width, uint32_t height);
+
+AppLog logger("pbm2slices", LOGMASK_NOINFO);
+const std::string version("(v0.1)");
+
+int main(int ac, char *av[])
+{
+    logger.PRINT() << "t3t_pbm2slices " << version << std::endl;
+
+    parse_options(ac, av);
+
+    opts.UVstretchZ = (float)100 / ((float)100 + opts.Zshrink_pct);
+    opts.UVstretchXY = (float)100 / ((float)100 + opts.XYshrink_pct);
+
+    if (opts.work_path.empty())
+        opts.work_path = "./";
+
+    if (!fs::exists(opts.work_path))
+    {
+        logger.ERROR() << "Specified work directory " << opts.work_path << " does not exist." << endl;
+        exit(1);
+    }
+
+    if (parse_platform(opts.platform_path) < 0)
+        exit(1);
+
+    float RS = opts.raster_size.as_mm();
+    float LH = opts.layer_height.as_mm();
+    if ((RS == 0) || (LH == 0))
+    {
+        logger.ERROR() << "Raster size and layer height required." << endl;
+        exit(1);
+    }
+
+    uint32_t plate_w = uint32_t(opts.platformX / RS);
+    uint32_t plate_h = uint32_t(opts.platformY / RS);
+    int32_t gapX_px = int32_t(round(opts.gapX / RS));
+    int32_t gapY_px = int32_t(round(opts.gapY / RS));
+
+    // place sorts row by row
+    std::vector<placed_sort> sorts;
+    TypeBitmap TBM;
+    TBM.set_type_parameters(opts.type_height, opts.depth_of_drive, opts.raster_size, opts.layer_height);
+
+    int32_t posY = 0;
+    uint32_t skipped = 0; // sorts left off the plate; there is no second plate to spill to
+    for (int i = 0; i < opts.structure.size(); i++)
+    {
+        std::stringstream row(opts.structure[i]);
+        std::string entry;
+        int32_t posX = 0;
+        int32_t max_line_h = 0;
+
+        while (row >> entry)
+        {
+            std::string pbm_path = opts.work_path + "/" + entry + ".pbm";
+            if (TBM.load(pbm_path) < 0)
+            {
+                logger.ERROR() << "Could not load " << pbm_path << std::endl;
+                skipped++;
+                continue;
+            }
+            if ((opts.edge_px != 0) && (TBM.compensate_edges(opts.edge_px) < 0))
+            {
+                skipped++;
+                continue;
+            }
+
+            placed_sort sort;
+            sort.name = entry;
+            sort.volume = std::make_unique<TypeVolume>();
+            if (sort.volume->build(TBM, opts.foot, opts.nicks, opts.UVstretchXY, opts.UVstretchZ) < 0)
+            {
+                skipped++;
+                continue;
+            }
+            sort.last_section = UINT32_MAX;
+
+            int32_t sw = sort.volume->getWidth();
+            int32_t sh = sort.volume->getHeight();
+
+            if ((posX + sw > plate_w) || (posY + sh > plate_h))
+            {
+                logger.ERROR() << "Sort " << entry << " in row " << i + 1
+                               << " does not fit on the platform, skipped." << std::endl;
+                skipped++;
+                continue;
+            }
+
+            sort.posX = posX;
+            sort.posY = posY;
+            sorts.push_back(std::move(sort));
+
+            posX += sw + gapX_px;
+            if (sh > max_line_h)
+                max_line_h = sh;
+        }
+        posY += max_line_h + gapY_px;
+    }
+
+    if (sorts.empty())
+    {
+        logger.ERROR() << "No sorts to slice." << std::endl;
+        exit(1);
+    }
+
+    // all sorts stand on the build plate: layer 0 is the lowest layer of every sort
+    int32_t layer_count = 0;
+    for (int i = 0; i < sorts.size(); i++)
+        layer_count = std::max(layer_count, sorts[i].volume->z_top() - sorts[i].volume->z_bottom());
+
+    std::string slice_path = opts.work_path + "/" + opts.slice_dir + "/";
+    if (!fs::exists(slice_path) && !fs::create_directory(slice_path))
+    {
+        logger.ERROR() << "Creating slice directory " << slice_path << " failed." << endl;
+        exit(1);
+    }
+
+    uint32_t stride = (plate_w + 7) / 8;
+    std::vector<uint8_t> plane(stride * plate_h);
+    std::vector<uint8_t> last_plane;
+    std::vector<std::string> layer_files;
+
+    OutBuffer rle_out;
+    if (opts.rle)
+    {
+        if (rle_out.open(slice_path + "layers.rle") < 0)
+        {
+            logger.ERROR() << "Could not open " << slice_path << "layers.rle for writing." << endl;
+            exit(1);
+        }
+        std::string header = "T3TRLE 1\n" + std::to_string(plate_w) + " " + std::to_string(plate_h) +
+                             " " + std::to_string(layer_count) + "\n";
+        rle_out.put(header);
+    }
+
+    uint32_t image_count = 0;
+    for (int32_t layer = 0; layer < layer_count; layer++)
+    {
+        // no sort changes its cross-section: same image as the layer below
+        bool changed = false;
+        for (int i = 0; i < sorts.size(); i++)
+        {
+            uint32_t index = sorts[i].volume->section_index(sorts[i].volume->z_bottom() + layer + 1);
+            if (index != sorts[i].last_section)
+                changed = true;
+            sorts[i].last_section = index;
+        }
+
+        if (changed)
+        {
+            std::fill(plane.begin(), plane.end(), 0);
+
+            for (int i = 0; i < sorts.size(); i++)
+            {
+                int32_t z = sorts[i].volume->z_bottom() + layer + 1;
+                render_section(sorts[i].volume->section(z), plane.data(), stride, sorts[i].posX, sorts[i].posY);
+            }
+        }
+
+        // identical consecutive layers share one image
+        if (!layer_files.empty() &&
+            (!changed || (memcmp(plane.data(), last_plane.data(), plane.size()) == 0)))
+        {
+            layer_files.push_back(layer_files.back());
+            if (opts.rle)
+                rle_out.put(char(0)); // repeat previous layer
+            continue;
+        }
+
+        std::string filename = (boost::format("layer_%05d.pbm") % layer).str();
+        if (write_layer_PBM(slice_path + filename, plane.data(), plate_w, plate_h, layer) < 0)
+        {
+            logger.ERROR() << "Could not write layer image " << slice_path + filename << std::endl;
+            exit(1);
+        }
+        layer_files.push_back(filename);
+        image_count++;
+
+        if (opts.rle)
+        {
+            rle_out.put(char(1)); // new layer data follows
+            write_layer_RLE(rle_out, plane.data(), plate_w, plate_h);
+        }
+
+        last_plane = plane;
+    }
+
+    if (opts.rle && (rle_out.close() < 0))
+    {
+        logger.ERROR() << "Writing " << slice_path << "layers.rle failed." << endl;
+        exit(1);
+    }
+
+    // manifest
+    YAML::Emitter manifest;
+    manifest.SetFloatPrecision(6);
+    manifest << YAML::BeginMap;
+    manifest << YAML::Key << "raster size" << YAML::Value
+             << YAML::BeginMap << YAML::Key << "value" << YAML::Value << RS
+             << YAML::Key << "unit" << YAML::Value << "mm" << YAML::EndMap;
+    manifest << YAML::Key << "layer height" << YAML::Value
+             << YAML::BeginMap << YAML::Key << "value" << YAML::Value << LH
+             << YAML::Key << "unit" << YAML::Value << "mm" << YAML::EndMap;
+    manifest << YAML::Key << "resolution X" << YAML::Value << plate_w;
+    manifest << YAML::Key << "resolution Y" << YAML::Value << plate_h;
+    manifest << YAML::Key << "solid pixel" << YAML::Value << 1;
+    manifest << YAML::Key << "layer count" << YAML::Value << layer_count;
+    if (opts.rle)
+        manifest << YAML::Key << "rle file" << YAML::Value << "layers.rle";
+    manifest << YAML::Key << "sorts" << YAML::Value << YAML::BeginSeq;
+    for (int i = 0; i < sorts.size(); i++)
+    {
+        manifest << YAML::Flow << YAML::BeginMap
+                 << YAML::Key << "name" << YAML::Value << sorts[i].name
+                 << YAML::Key << "x" << YAML::Value << sorts[i].posX
+                 << YAML::Key << "y" << YAML::Value << sorts[i].posY
+                 << YAML::Key << "width" << YAML::Value << sorts[i].volume->getWidth()
+                 << YAML::Key << "height" << YAML::Value << sorts[i].volume->getHeight()
+                 << YAML::Key << "volume mm3" << YAML::Value << sorts[i].volume->volume_mm3()
+                 << YAML::EndMap;
+    }
+    manifest << YAML::EndSeq;
+    manifest << YAML::Key << "layers" << YAML::Value << YAML::BeginSeq;
+    for (int i = 0; i < layer_files.size(); i++)
+        manifest << layer_files[i];
+    manifest << YAML::EndSeq;
+    manifest << YAML::EndMap;
+
+    std::ofstream manifest_out(slice_path + "slices.yaml");
+    if (!manifest_out.is_open())
+    {
+        logger.ERROR() << "Could not write " << slice_path << "slices.yaml" << endl;
+        exit(1);
+    }
+    manifest_out << manifest.c_str() << std::endl;
+    manifest_out.close();
+
+    logger.PRINT() << "Sliced " << sorts.size() << " sorts into " << layer_count << " layers ("
+                   << image_count << " distinct images) at " << plate_w << "x" << plate_h
+                   << " px in " << slice_path << std::endl;
+
+    if (skipped)
+    {
+        logger.ERROR() << skipped << " sort(s) could not be sliced or did not fit, the slices are incomplete." << endl;
+        return 1;
+    }
+    return 0;
+}
+
+void render_section(const layer_section &S, uint8_t *plane, uint32_t stride, int32_t posX, int32_t posY)
+{
+    int32_t rows = S.row_start.size() - 1;
+
+    for (int32_t y = 0; y < rows; y++)
+    {
+        uint8_t *line = plane + (posY + y) * stride;
+
+        for (uint32_t r = S.row_start[y]; r < S.row_start[y + 1]; r++)
+        {
+            int32_t x0 = posX + S.runs[r].x0;
+            int32_t x1 = posX + S.runs[r].x1; // exclusive
+
+            // PBM bit order: MSB is leftmost pixel
+            int32_t b0 = x0 >> 3;
+            int32_t b1 = (x1 - 1) >> 3;
+            uint8_t m0 = 0xFF >> (x0 & 7);
+            uint8_t m1 = 0xFF << (7 - ((x1 - 1) & 7));
+
+            if (b0 == b1)
+            {
+                line[b0] |= (m0 & m1);
+            }
+            else
+            {
+                line[b0] |= m0;
+                if (b1 > b0 + 1)
+                    memset(line + b0 + 1, 0xFF, b1 - b0 - 1);
+                line[b1] |= m1;
+            }
+        }
+    }
+}
+
+int write_layer_PBM(std::string filename, uint8_t *plane, uint32_t width, uint32_t height, uint32_t layer)
+{
+    OutBuffer pbm_out;
+    if (pbm_out.open(filename) < 0)
+        return -1;
+
+    std::string header = "P4\n# t3t layer " + std::to_string(layer) + "\n" +
+                         std::to_string(width) + " " + std::to_string(height) + "\n";
+    pbm_out.put(header);
+    pbm_out.put((const char *)plane, ((width + 7) / 8) * height);
+
+    return pbm_out.close();
+}
+
+static void put_varint(OutBuffer &out, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        out.put(char((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.put(char(v));
+}
+
+// per row: run count, then (gap to previous run end, run length) pairs, all LEB128
+void write_layer_RLE(OutBuffer &rle_out, uint8_t *plane, uint32_t width, uint32_t height)
+{
+    uint32_t stride = (width + 7) / 8;
+    std::vector<uint32_t> runs;
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        uint8_t *line = plane + y * stride;
+        runs.clear();
+
+        uint32_t x = 0;
+        while (x < width)
+        {
+            // skip empty bytes quickly
+            if (((x & 7) == 0) && (line[x >> 3] == 0))
+            {
+                x += 8;
+                continue;
+            }
+            if (!(line[x >> 3] & (0x80 >> (x & 7))))
+            {
+                x++;
+                continue;
+            }
+            uint32_t x0 = x;
+            while ((x < width) && (line[x >> 3] & (0x80 >> (x & 7))))
+                x++;
+            runs.push_back(x0);
+            runs.push_back(x);
+        }
+
+        put_varint(rle_out, runs.size() / 2);
+        uint32_t last_end = 0;
+        for (int i = 0; i < runs.size(); i += 2)
+        {
+            put_varint(rle_out, runs[i] - last_end);
+            put_varint(rle_out, runs[i + 1] - runs[i]);
+            last_end = runs[i + 1];
+        }
+    }
+}
+
+int get_yaml_dim_node(YAML::Node &parent, std::string name, dim_t &target)
+{
+    if (parent[name]["value"] && parent[name]["unit"])
+        target = dim_t(parent[name]["value"].as<float>(),
+                       parent[name]["unit"].as<std::string>());
+    else
+        return -1;
+
+    return 0;
+}
+
+int parse_platform(std::string filename)
+{
+    if (!fs::exists(filename))
+    {
+        logger.ERROR() << "Platform file " << filename << " does not exist." << std::endl;
+        return -1;
+    }
+
+    try
+    {
+        YAML::Node config = YAML::LoadFile(filename);
+
+        if (!config["platform size X"] || !config["platform size Y"])
+        {
+            logger.ERROR() << "No platform size in " << filename << std::endl;
+            return -1;
+        }
+        opts.platformX = config["platform size X"].as<float>();
+        opts.platformY = config["platform size Y"].as<float>();
+        if (config["gap X"])
+            opts.gapX = config["gap X"].as<float>();
+        if (config["gap Y"])
+            opts.gapY = config["gap Y"].as<float>();
+
+        if (config["structure"])
+        {
+            for (int i = 0; i < config["structure"].size(); i++)
+                opts.structure.push_back(config["structure"][i].as<std::string>());
+        }
+    }
+    catch (exception &e)
+    {
+        logger.ERROR() << e.what() << "\n";
+        return -1;
+    }
+    return 0;
+}
+
+int parse_options(int ac, char *av[])
+{
+    std::vector<std::string> yaml_paths;
+
+    try
+    {
+        bpo::options_description desc("t3t_pbm2slices: Command-line options and arguments");
+        desc.add_options()("help", "produce this help message")("platform,P", bpo::value<std::string>(&opts.platform_path), "specify platform layout YAML (default STLcompile.yaml)")("slices,d", bpo::value<std::string>(&opts.slice_dir), "specify slice output directory inside working directory")("rle", bpo::bool_switch(&opts.rle), "additionally write run-length encoded layers (layers.rle)")("yaml,y", bpo::value<vector<string>>(&yaml_paths), "specify YAML configuration file(s)");
+        bpo::variables_map vm;
+
+        bpo::positional_options_description posopt;
+        posopt.add("yaml", -1);
+        bpo::store(bpo::command_line_parser(ac, av).options(desc).positional(posopt).run(), vm);
+        bpo::notify(vm);
+
+        if (vm.count("help"))
+        {
+            logger.PRINT() << desc << "\n";
+            exit(0);
+        }
+
+        for (string &s : yaml_paths)
+        {
+            if (!s.empty() && !s.ends_with(".yaml"))
+                s.append(".yaml");
+        }
+
+        if (!opts.platform_path.empty() && !opts.platform_path.ends_with(".yaml"))
+            opts.platform_path.append(".yaml");
+
+        if (yaml_paths.empty() && fs::exists("config.yaml"))
+            yaml_paths.push_back("config.yaml");
+
+        string yaml_config;
+
+        for (string &s : yaml_paths)
+        {
+            if (fs::exists(s))
+            {
+                ifstream yfile(s);
+                while (!yfile.eof())
+                {
+                    string buf;
+                    getline(yfile, buf);
+                    yaml_config += buf;
+                    yaml_config += "\n";
+                }
+                yaml_config += "\n";
+            }
+        }
+
+        YAML::Node config = YAML::Load(yaml_config);
+
+        get_yaml_dim_node(config, "type height", opts.type_height);
+        get_yaml_dim_node(config, "depth of drive", opts.depth_of_drive);
+        get_yaml_dim_node(config, "raster size", opts.raster_size);
+        get_yaml_dim_node(config, "layer height", opts.layer_height);
+        get_yaml_dim_node(config, "reduced foot XY", opts.foot.XY);
+        get_yaml_dim_node(config, "reduced foot Z", opts.foot.Z);
+
+        // NICKS
+        if (config["nicks"] && config["nicks"]["scale"])
+        {
+            dim_t nick_scale;
+            YAML::Node nicks = config["nicks"];
+            get_yaml_dim_node(nicks, "scale", nick_scale);
+            if (nicks["segments"])
+            {
+                YAML::Node nicksegs = nicks["segments"];
+                for (int i = 0; i < nicksegs.size(); i++)
+                {
+                    std::string nick_type;
+                    nick current_nick;
+
+                    if (nicksegs[i]["type"])
+                        nick_type = nicksegs[i]["type"].as<std::string>();
+                    if (nick_type == "flat")
+                        current_nick.type = flat;
+                    if (nick_type == "triangle")
+                        current_nick.type = triangle;
+                    if (nick_type == "rect")
+                        current_nick.type = rect;
+                    if (nick_type == "circle")
+                        current_nick.type = circle;
+
+                    if (current_nick.type == nick_undefined)
+                    {
+                        logger.WARNING() << "No valid nick type specified" << std::endl;
+                        continue;
+                    }
+
+                    if (nicksegs[i]["z"])
+                        current_nick.z = dim_t(nicksegs[i]["z"].as<float>() * nick_scale.as_mm(), mm);
+                    if (current_nick.z.as_mm() == 0)
+                    {
+                        logger.WARNING() << "Nick with no height specified" << std::endl;
+                        continue;
+                    }
+
+                    if (nicksegs[i]["y"])
+                        current_nick.y = dim_t(nicksegs[i]["y"].as<float>() * nick_scale.as_mm(), mm);
+                    if ((current_nick.type == rect) && (current_nick.y.as_mm() == 0))
+                    {
+                        logger.WARNING() << "Rectangular nick with no depth specified" << std::endl;
+                        continue;
+                    }
+
+                    opts.nicks.push_back(current_nick);
+                }
+            }
+        }
+
+        // REDUCED FOOT PARAMETERS
+        if (config["reduced foot mode"])
+        {
+            string foot_mode_str = config["reduced foot mode"].as<std::string>();
+            if (foot_mode_str == "bevel")
+                opts.foot.mode = bevel;
+            else if (foot_mode_str == "step")
+                opts.foot.mode = step;
+            else if (foot_mode_str == "supports")
+                opts.foot.mode = supports;
+            else if (foot_mode_str == "pyramids")
+                opts.foot.mode = pyramids;
+            else
+                opts.foot.mode = no_foot;
+        }
+
+        if (opts.foot.mode == pyramids)
+        {
+            get_yaml_dim_node(config, "pyramid pitch", opts.foot.pyramid_pitch);
+            get_yaml_dim_node(config, "pyramid top length", opts.foot.pyramid_top_length);
+            get_yaml_dim_node(config, "pyramid top column height", opts.foot.pyramid_top_column_height);
+            get_yaml_dim_node(config, "pyramid foot height", opts.foot.pyramid_foot_height);
+
+            if (config["pyramid height factor"])
+                opts.foot.pyramid_height_factor = config["pyramid height factor"].as<float>();
+            else
+                opts.foot.pyramid_height_factor = 1.0;
+        }
+
+        // LOG LEVELS (debug, info, warning, error) for console and log file
+        if (config["log level"])
+        {
+            YAML::Node levels = config["log level"];
+            if (logger.set_levels(levels["console"] ? levels["console"].as<std::string>() : "",
+                                  levels["file"] ? levels["file"].as<std::string>() : "") < 0)
+                logger.WARNING() << "log level must be debug, info, warning or error." << endl;
+        }
+
+        // WORKING DIRECTORY
+        if (config["working directory"])
+        {
+            if (config["working directory"]["path"])
+                opts.work_path = config["working directory"]["path"].as<std::string>();
+        }
+
+        // SHRINKAGE OBSERVED AND TO BE COMPENSATED FOR
+        if (config["XYshrink_pct"])
+            opts.XYshrink_pct = config["XYshrink_pct"].as<float>();
+        if (config["Zshrink_pct"])
+            opts.Zshrink_pct = config["Zshrink_pct"].as<float>();
+        if (config["edge compensation px"])
+        {
+            opts.edge_px = config["edge compensation px"].as<float>();
+            if ((opts.edge_px != 0) && (fabsf(opts.edge_px) < 1.0f))
+            {
+                logger.ERROR() << "edge compensation px must be 0 or at least 1 pixel either way, not " << opts.edge_px << endl;
+                exit(1);
+            }
+        }
+    }
+    catch (exception &e)
+    {
+        logger.ERROR() << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,12 +1,20 @@
 #include "yaml.h"
 #include "TypeBitmap.h"
 #include "AppLog.h"
+#include "AppStats.h"
+#include "MeshPlan.h"
+#include "MeshCheck.h"
 #include <iostream>
 #include <fstream>
 #include <filesystem>
 #include <boost/format.hpp>
 #include <boost/program_options.hpp>
 #include <sstream>
+#include <algorithm>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <atomic>
 
 using namespace std;
 namespace fs = std::filesystem;
@@ -27,6 +35,10 @@ struct
     std::string pbm_path;
     std::string stl_path;
     std::string obj_path;
+    bool obj_normals;
+    std::string ply_path;
+    std::string tmf_path;
+    std::vector<std::string> formats; // output formats for derived paths
     std::string work_path;
     bool create_work_path;
 
@@ -42,10 +54,48 @@ struct
     float Zshrink_pct;
     float UVstretchZ;
 
-} opts = {.create_work_path = false, .unicode = 0, .XYshrink_pct = 0, .Zshrink_pct = 0};
+    float edge_px; // outline growth (> 0) or thinning (< 0) in pixels
+
+    std::string duplicates; // identical bitmaps: "link" their files, "copy" them or "mesh" again
+
+    bool stats;             // print per-stage timing table at the end
+    std::string trace_path; // Chrome trace JSON output
+
+    bool plan;     // estimate only, mesh nothing
+    uint32_t jobs; // parallel meshing, 0: all cores
+
+    bool check_meshes;         // watertightness and volume of every mesh
+    float check_tolerance_pct; // allowed volume difference to the voxel model
+    uint32_t raster_step;      // slice meshes back into bitmaps every n layers, 0: off
+
+} opts = {.obj_normals = false, .create_work_path = false, .unicode = 0, .XYshrink_pct = 0, .Zshrink_pct = 0, .edge_px = 0,
+          .duplicates = "link", .stats = false, .plan = false, .jobs = 1,
+          .check_meshes = true, .check_tolerance_pct = 0.5, .raster_step = 0};
+
+// one bitmap and its output files
+struct mesh_job
+{
+    std::string pbm_path, stl_path, obj_path, ply_path, tmf_path;
+};
+
+// output files of each bitmap meshed in this run, by bitmap hash; the
+// bitmap itself is kept to tell hash collisions from identical bitmaps
+struct mesh_files
+{
+    packed_bitmap bitmap;
+    std::string stl_path, obj_path, ply_path, tmf_path;
+};
+std::unordered_map<uint64_t, std::vector<mesh_files>> meshed;
+std::mutex meshed_mutex;
 
 std::string make_ASCII_Unicode_string(uint32_t);
-int generate_3D_files(TypeBitmap &TBM, std::string pbm_path, std::string stl_path, std::string obj_path);
+int generate_3D_files(TypeBitmap &TBM, std::string pbm_path, std::string stl_path, std::string obj_path,
+                      std::string ply_path = "", std::string tmf_path = "", const packed_bitmap *prepared = NULL);
+bool output_format(std::string format);
+int prepare_bitmap(TypeBitmap &TBM, std::string pbm_path);
+int plan_jobs(std::vector<mesh_job> &work, std::vector<mesh_plan> &plans, std::vector<packed_bitmap> &kept);
+int mesh_parallel(std::vector<mesh_job> &work, std::vector<mesh_plan> &plans, std::vector<packed_bitmap> &kept);
+int reuse_mesh_file(std::string src_path, std::string dst_path);
 int parse_options(int ac, char *av[]);
 int get_yaml_dim_node(YAML::Node &parent, std::string name, dim_t &target);
 
@@ -62,6 +112,9 @@ int main(int ac, char *av[])
     logger.INFO() << "Z stretch to compensate UV shrinking: " << opts.UVstretchZ << endl;
     opts.UVstretchXY = (float)100 / ((float)100 + opts.XYshrink_pct);
 
+    if (opts.stats || !opts.trace_path.empty())
+        appstats.enable();
+
     if (!opts.work_path.empty())
     {
         if (!fs::exists(opts.work_path))
@@ -86,7 +139,7 @@ int main(int ac, char *av[])
         opts.work_path = "./";
     }
 
-    std::string pbm_path, stl_path, obj_path;
+    std::string pbm_path, stl_path, obj_path, ply_path, tmf_path;
     bool clPBM = false;
     bool clworkpathPBM = false;
 
@@ -141,22 +194,50 @@ int main(int ac, char *av[])
             }
         }
 
-        if (opts.stl_path.empty() && opts.obj_path.empty())
+        if (clPBM && !opts.ply_path.empty())
         {
-            stl_path = pbm_path.substr(0, pbm_path.size() - 4) + ".stl";
-            obj_path = pbm_path.substr(0, pbm_path.size() - 4) + ".obj";
+            if (!clworkpathPBM)
+            {
+                ply_path = opts.ply_path;
+            }
+            else
+            {
+                ply_path = opts.work_path + opts.ply_path;
+            }
+        }
+
+        if (clPBM && !opts.tmf_path.empty())
+        {
+            if (!clworkpathPBM)
+            {
+                tmf_path = opts.tmf_path;
+            }
+            else
+            {
+                tmf_path = opts.work_path + opts.tmf_path;
+            }
+        }
+
+        if (opts.stl_path.empty() && opts.obj_path.empty() &&
+            opts.ply_path.empty() && opts.tmf_path.empty())
+        {
+            std::string base_path = pbm_path.substr(0, pbm_path.size() - 4);
+            if (output_format("stl"))
+                stl_path = base_path + ".stl";
+            if (output_format("obj"))
+                obj_path = base_path + ".obj";
+            if (output_format("ply"))
+                ply_path = base_path + ".ply";
+            if (output_format("3mf"))
+                tmf_path = base_path + ".3mf";
         }
     }
 
-    TypeBitmap TBM;
-    TBM.set_type_parameters(opts.type_height,
-                            opts.depth_of_drive,
-                            opts.raster_size,
-                            opts.layer_height);
+    std::vector<mesh_job> work;
 
     if (clPBM)
     {
-        generate_3D_files(TBM, pbm_path, stl_path, obj_path);
+        work.push_back((mesh_job){pbm_path, stl_path, obj_path, ply_path, tmf_path});
     }
     else
     {
@@ -167,22 +248,72 @@ int main(int ac, char *av[])
 
             std::string AU_string = make_ASCII_Unicode_string(current_char);
 
-            pbm_path = opts.work_path + AU_string + ".pbm";
-            stl_path = opts.work_path + AU_string + ".stl";
-            obj_path = opts.work_path + AU_string + ".obj";
+            std::string base_path = opts.work_path + AU_string;
+
+            pbm_path = base_path + ".pbm";
+            stl_path = output_format("stl") ? base_path + ".stl" : "";
+            obj_path = output_format("obj") ? base_path + ".obj" : "";
+            ply_path = output_format("ply") ? base_path + ".ply" : "";
+            tmf_path = output_format("3mf") ? base_path + ".3mf" : "";
 
-            generate_3D_files(TBM, pbm_path, stl_path, obj_path);
+            work.push_back((mesh_job){pbm_path, stl_path, obj_path, ply_path, tmf_path});
         }
         for (int i = 0; i < opts.images.size(); i++)
         {
 
-            pbm_path = opts.work_path + opts.images[i] + ".pbm";
-            stl_path = opts.work_path + opts.images[i] + ".stl";
-            obj_path = opts.work_path + opts.images[i] + ".obj";
+            std::string base_path = opts.work_path + opts.images[i];
 
-            generate_3D_files(TBM, pbm_path, stl_path, obj_path);
+            pbm_path = base_path + ".pbm";
+            stl_path = output_format("stl") ? base_path + ".stl" : "";
+            obj_path = output_format("obj") ? base_path + ".obj" : "";
+            ply_path = output_format("ply") ? base_path + ".ply" : "";
+            tmf_path = output_format("3mf") ? base_path + ".3mf" : "";
+
+            work.push_back((mesh_job){pbm_path, stl_path, obj_path, ply_path, tmf_path});
         }
     }
+
+    if (opts.jobs == 0)
+        opts.jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    if (opts.plan || (opts.jobs > 1))
+    {
+        std::vector<mesh_plan> plans;
+        std::vector<packed_bitmap> kept; // prepared bitmaps, so meshing need not load them again
+
+        plan_jobs(work, plans, kept);
+        if (opts.plan)
+        {
+            std::stringstream table;
+            write_plan(table, plans, opts.jobs);
+            logger.PRINT() << table.str();
+            logger.PRINT().flush();
+            return 0;
+        }
+        mesh_parallel(work, plans, kept);
+    }
+    else
+    {
+        TypeBitmap TBM;
+        TBM.set_type_parameters(opts.type_height,
+                                opts.depth_of_drive,
+                                opts.raster_size,
+                                opts.layer_height);
+
+        for (mesh_job &job : work)
+            generate_3D_files(TBM, job.pbm_path, job.stl_path, job.obj_path, job.ply_path, job.tmf_path);
+    }
+
+    if (opts.stats)
+    {
+        std::stringstream table;
+        appstats.write_table(table);
+        logger.PRINT() << table.str();
+        logger.PRINT().flush();
+    }
+    if (!opts.trace_path.empty() && (appstats.write_trace(opts.trace_path) < 0))
+        logger.ERROR() << "Could not write trace file " << opts.trace_path << endl;
+
     return 0;
 }
 
@@ -202,22 +333,258 @@ std::string make_ASCII_Unicode_string(uint32_t unicode)
     }
 }
 
-int generate_3D_files(TypeBitmap &TBM, std::string pbm_path, std::string stl_path, std::string obj_path)
+bool output_format(std::string format)
+{
+    if (opts.formats.empty()) // default: STL + OBJ
+        return (format == "stl") || (format == "obj");
+
+    return std::find(opts.formats.begin(), opts.formats.end(), format) != opts.formats.end();
+}
+
+// load and edge compensate
+int prepare_bitmap(TypeBitmap &TBM, std::string pbm_path)
 {
     if (TBM.load(pbm_path) < 0)
         return -1;
 
+    if ((opts.edge_px != 0) && (TBM.compensate_edges(opts.edge_px) < 0))
+        return -1;
+
+    return 0;
+}
+
+// prepared: the bitmap as kept by plan_jobs(), instead of loading pbm_path again
+int generate_3D_files(TypeBitmap &TBM, std::string pbm_path, std::string stl_path, std::string obj_path,
+                      std::string ply_path, std::string tmf_path, const packed_bitmap *prepared)
+{
+    ScopedItem item(fs::path(pbm_path).stem().string());
+
+    if (prepared ? (TBM.unpack(*prepared) < 0) : (prepare_bitmap(TBM, pbm_path) < 0))
+        return -1;
+
+    // same glyph under another code point or space of the same width: reuse its files
+    mesh_files current;
+    if (prepared)
+        current.bitmap = *prepared;
+    else if (TBM.pack(current.bitmap) < 0)
+        return -1;
+
+    uint64_t key = TBM.hash();
+    std::unique_lock<std::mutex> lock(meshed_mutex);
+    const mesh_files *seen = NULL;
+    if (opts.duplicates != "mesh")
+    {
+        for (const mesh_files &files : meshed[key])
+            if (files.bitmap == current.bitmap)
+                seen = &files;
+    }
+    if (seen)
+    {
+        mesh_files files = *seen;
+        lock.unlock();
+        logger.INFO() << pbm_path << " is identical to an earlier bitmap, reusing its mesh." << endl;
+        if ((reuse_mesh_file(files.stl_path, stl_path) < 0) ||
+            (reuse_mesh_file(files.obj_path, obj_path) < 0) ||
+            (reuse_mesh_file(files.ply_path, ply_path) < 0) ||
+            (reuse_mesh_file(files.tmf_path, tmf_path) < 0))
+            return -1;
+        return 0;
+    }
+    lock.unlock();
+
+    // never write through a hardlink left by an earlier run
+    std::error_code ec;
+    for (std::string path : {stl_path, obj_path, ply_path, tmf_path})
+        if (!path.empty())
+            fs::remove(path, ec);
+
     if (TBM.generateMesh(opts.foot, opts.nicks, opts.UVstretchXY, opts.UVstretchZ) < 0)
         return -1;
 
+    if (opts.check_meshes)
+    {
+        mesh_validation check;
+        if (validate_mesh(TBM, opts.foot, opts.nicks, opts.UVstretchXY, opts.UVstretchZ,
+                          opts.check_tolerance_pct, check) < 0)
+            return -1;
+        if (!check.watertight || !check.volume_ok)
+            logger.WARNING() << pbm_path << " mesh check failed: " << describe_validation(check) << endl;
+        else
+            LOG_INFO(logger) << pbm_path << " mesh check: " << describe_validation(check) << endl;
+    }
+
+    if (opts.raster_step)
+    {
+        raster_validation raster;
+        if (raster_check(TBM, opts.foot, opts.nicks, opts.UVstretchXY, opts.UVstretchZ, opts.raster_step, raster) < 0)
+            return -1;
+        if (raster.mismatched)
+            logger.WARNING() << pbm_path << " raster check: " << describe_raster(raster) << endl;
+        else
+            LOG_INFO(logger) << pbm_path << " raster check: " << describe_raster(raster) << endl;
+    }
+
     if (!stl_path.empty())
         if (TBM.writeSTL(stl_path) < 0)
             return -1;
 
     if (!obj_path.empty())
-        if (TBM.writeOBJ(obj_path) < 0)
+        if (TBM.writeOBJ(obj_path, opts.obj_normals) < 0)
             return -1;
 
+    if (!ply_path.empty())
+        if (TBM.writePLY(ply_path) < 0)
+            return -1;
+
+    if (!tmf_path.empty())
+        if (TBM.write3MF(tmf_path) < 0)
+            return -1;
+
+    lock.lock();
+    current.stl_path = stl_path;
+    current.obj_path = obj_path;
+    current.ply_path = ply_path;
+    current.tmf_path = tmf_path;
+    meshed[key].push_back(std::move(current));
+
+    return 0;
+}
+
+// Cost estimate of every bitmap (loaded and edge compensated as for meshing),
+// on opts.jobs workers. The prepared bitmaps are kept at 1 bit per pixel, to
+// find duplicates and for mesh_parallel().
+int plan_jobs(std::vector<mesh_job> &work, std::vector<mesh_plan> &plans, std::vector<packed_bitmap> &kept)
+{
+    std::atomic<size_t> next(0);
+    std::atomic<int> failed(0);
+
+    plans.resize(work.size());
+    kept.resize(work.size());
+
+    auto worker = [&]()
+    {
+        TypeBitmap TBM;
+
+        size_t i;
+        while ((i = next++) < work.size())
+        {
+            mesh_job &job = work[i];
+            std::vector<std::string> formats;
+            if (!job.stl_path.empty())
+                formats.push_back("stl");
+            if (!job.obj_path.empty())
+                formats.push_back("obj");
+            if (!job.ply_path.empty())
+                formats.push_back("ply");
+            if (!job.tmf_path.empty())
+                formats.push_back("3mf");
+
+            std::string name = fs::path(job.pbm_path).stem().string();
+            if ((prepare_bitmap(TBM, job.pbm_path) < 0) ||
+                (plan_mesh(TBM, name, formats, plans[i]) < 0) ||
+                (TBM.pack(kept[i]) < 0))
+            {
+                plans[i] = mesh_plan();
+                plans[i].name = name;
+                plans[i].valid = false;
+                plans[i].duplicate_of = -1;
+                failed++;
+            }
+        }
+    };
+
+    uint32_t thread_count = std::max(1u, std::min(opts.jobs, (uint32_t)work.size()));
+    std::vector<std::thread> pool;
+    for (uint32_t t = 0; t < thread_count; t++)
+        pool.push_back(std::thread(worker));
+    for (uint32_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+
+    if (opts.duplicates != "mesh")
+        mark_duplicates(plans, kept);
+
+    return failed ? -1 : 0;
+}
+
+// Mesh on opts.jobs workers, the most expensive bitmaps first so no long
+// one starts last; bitmaps identical to an earlier one follow afterwards
+// and reuse its files. Bitmaps that failed in planning are not retried.
+int mesh_parallel(std::vector<mesh_job> &work, std::vector<mesh_plan> &plans, std::vector<packed_bitmap> &kept)
+{
+    std::vector<size_t> order = largest_first(plans);
+    std::atomic<size_t> next(0);
+    std::atomic<int> failed(0);
+
+    auto worker = [&]()
+    {
+        TypeBitmap TBM;
+        TBM.set_type_parameters(opts.type_height, opts.depth_of_drive, opts.raster_size, opts.layer_height);
+
+        size_t n;
+        while ((n = next++) < order.size())
+        {
+            size_t i = order[n];
+            mesh_job &job = work[i];
+            if (generate_3D_files(TBM, job.pbm_path, job.stl_path, job.obj_path, job.ply_path, job.tmf_path, &kept[i]) < 0)
+                failed++;
+            std::vector<uint8_t>().swap(kept[i].bits);
+        }
+    };
+
+    uint32_t thread_count = std::min(opts.jobs, (uint32_t)order.size());
+    std::vector<std::thread> pool;
+    for (uint32_t t = 0; t < thread_count; t++)
+        pool.push_back(std::thread(worker));
+    for (uint32_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+
+    TypeBitmap TBM;
+    TBM.set_type_parameters(opts.type_height, opts.depth_of_drive, opts.raster_size, opts.layer_height);
+    for (size_t i = 0; i < plans.size(); i++)
+    {
+        if (!plans[i].valid)
+        {
+            failed++;
+            continue;
+        }
+        if (plans[i].duplicate_of < 0)
+            continue;
+        if (generate_3D_files(TBM, work[i].pbm_path, work[i].stl_path, work[i].obj_path, work[i].ply_path, work[i].tmf_path, &kept[i]) < 0)
+            failed++;
+        std::vector<uint8_t>().swap(kept[i].bits);
+    }
+
+    return failed ? -1 : 0;
+}
+
+// hardlink (or copy) an already written output file to a new name
+int reuse_mesh_file(std::string src_path, std::string dst_path)
+{
+    std::error_code ec;
+
+    if (dst_path.empty() || (dst_path == src_path))
+        return 0;
+    if (src_path.empty())
+    {
+        logger.ERROR() << "No earlier output to reuse for " << dst_path << endl;
+        return -1;
+    }
+
+    fs::remove(dst_path, ec);
+    if (opts.duplicates == "link")
+    {
+        fs::create_hard_link(src_path, dst_path, ec);
+        if (!ec)
+            return 0;
+        logger.INFO() << "Hardlinking " << dst_path << " failed (" << ec.message() << "), copying instead." << endl;
+    }
+
+    fs::copy_file(src_path, dst_path, fs::copy_options::overwrite_existing, ec);
+    if (ec)
+    {
+        logger.ERROR() << "Could not copy " << src_path << " to " << dst_path << ": " << ec.message() << endl;
+        return -1;
+    }
     return 0;
 }
 
@@ -241,7 +608,7 @@ int parse_options(int ac, char *av[])
     {
 
         bpo::options_description desc("t3t_pbm2stl: Command-line options and arguments");
-        desc.add_options()("help", "produce this help message")("unicode,u", bpo::value<std::string>(&unicode_arg), "specify input unicode (overrides other input args)")("ascii,a", bpo::value<std::string>(&opts.ASCII), "specify input ASCII character (overrides input PBM)")("pbm,p", bpo::value<std::string>(&opts.pbm_path), "specify input PBM path (overrides YAML)")("stl,s", bpo::value<std::string>(&opts.stl_path), "specify output STL path (only useful if input specified here)")("obj,o", bpo::value<std::string>(&opts.obj_path), "specify output OBJ path (only useful if input specified here)")("yaml,y", bpo::value<vector<string>>(&yaml_paths), "specify YAML configuration file(s)");
+        desc.add_options()("help", "produce this help message")("unicode,u", bpo::value<std::string>(&unicode_arg), "specify input unicode (overrides other input args)")("ascii,a", bpo::value<std::string>(&opts.ASCII), "specify input ASCII character (overrides input PBM)")("pbm,p", bpo::value<std::string>(&opts.pbm_path), "specify input PBM path (overrides YAML)")("stl,s", bpo::value<std::string>(&opts.stl_path), "specify output STL path (only useful if input specified here)")("obj,o", bpo::value<std::string>(&opts.obj_path), "specify output OBJ path (only useful if input specified here)")("obj-normals", bpo::bool_switch(&opts.obj_normals), "add vertex normals (vn) to OBJ output")("ply", bpo::value<std::string>(&opts.ply_path), "specify output binary PLY path (only useful if input specified here)")("3mf", bpo::value<std::string>(&opts.tmf_path), "specify output 3MF path (only useful if input specified here)")("stats", bpo::bool_switch(&opts.stats), "print a per-stage timing and counter table")("trace", bpo::value<std::string>(&opts.trace_path), "write Chrome trace JSON of all stages to this file")("plan", bpo::bool_switch(&opts.plan), "estimate triangles, memory, output size and time per bitmap, mesh nothing")("jobs,j", bpo::value<uint32_t>(&opts.jobs), "number of parallel meshing jobs, largest first (default 1, 0: all cores)")("raster-check", bpo::value<uint32_t>(&opts.raster_step), "slice each mesh back into bitmaps at the glyph surface and every n-th layer below, compare with the bitmap and analytic sections")("yaml,y", bpo::value<vector<string>>(&yaml_paths), "specify YAML configuration file(s)");
         bpo::variables_map vm;
 
         bpo::positional_options_description posopt;
@@ -273,6 +640,12 @@ int parse_options(int ac, char *av[])
         if (!opts.obj_path.empty() && !opts.obj_path.ends_with(".obj"))
             opts.obj_path.append(".obj");
 
+        if (!opts.ply_path.empty() && !opts.ply_path.ends_with(".ply"))
+            opts.ply_path.append(".ply");
+
+        if (!opts.tmf_path.empty() && !opts.tmf_path.ends_with(".3mf"))
+            opts.tmf_path.append(".3mf");
+
         string yaml_config;
 
         for (string &s : yaml_paths)
@@ -431,6 +804,15 @@ int parse_options(int ac, char *av[])
             exit(1);
         }
 
+        // LOG LEVELS (debug, info, warning, error) for console and log file
+        if (config["log level"])
+        {
+            YAML::Node levels = config["log level"];
+            if (logger.set_levels(levels["console"] ? levels["console"].as<std::string>() : "",
+                                  levels["file"] ? levels["file"].as<std::string>() : "") < 0)
+                logger.WARNING() << "log level must be debug, info, warning or error." << endl;
+        }
+
         // WORKING DIRECTORY
         if (config["working directory"])
         {
@@ -470,6 +852,40 @@ int parse_options(int ac, char *av[])
             }
         }
 
+        // OUTPUT FORMATS (stl, obj, ply, 3mf)
+        if (config["output formats"])
+        {
+            for (int i = 0; i < config["output formats"].size(); i++)
+                opts.formats.push_back(config["output formats"][i].as<std::string>());
+        }
+
+        // IDENTICAL BITMAPS (link, copy, mesh)
+        if (config["duplicate meshes"])
+        {
+            opts.duplicates = config["duplicate meshes"].as<std::string>();
+            if ((opts.duplicates != "link") && (opts.duplicates != "copy") && (opts.duplicates != "mesh"))
+            {
+                logger.ERROR() << "duplicate meshes must be link, copy or mesh, not " << opts.duplicates << endl;
+                exit(1);
+            }
+        }
+
+        // MESH CHECK (watertight, volume within tolerance_pct of the voxel model)
+        if (config["check meshes"])
+        {
+            opts.check_meshes = config["check meshes"].as<bool>();
+        }
+        if (config["check volume tolerance pct"])
+        {
+            opts.check_tolerance_pct = config["check volume tolerance pct"].as<float>();
+        }
+
+        // OBJ OUTPUT OPTIONS
+        if (config["OBJ normals"])
+        {
+            opts.obj_normals = opts.obj_normals || config["OBJ normals"].as<bool>();
+        }
+
         // SHRINKAGE OBSERVED AND TO BE COMPENSATED FOR
         if (config["XYshrink_pct"])
         {
@@ -479,6 +895,15 @@ int parse_options(int ac, char *av[])
         {
             opts.Zshrink_pct = config["Zshrink_pct"].as<float>();
         }
+        if (config["edge compensation px"])
+        {
+            opts.edge_px = config["edge compensation px"].as<float>();
+            if ((opts.edge_px != 0) && (fabsf(opts.edge_px) < 1.0f))
+            {
+                logger.ERROR() << "edge compensation px must be 0 or at least 1 pixel either way, not " << opts.edge_px << endl;
+                exit(1);
+            }
+        }
     }
     catch (exception &e)
     {
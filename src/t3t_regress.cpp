@@ -0,0 +1,637 @@
+#include "yaml.h"
+#include "AppLog.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+#include <ctime>
+#include <set>
+#include <algorithm>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+using namespace std;
+namespace fs = std::filesystem;
+namespace bpo = boost::program_options;
+
+struct
+{
+    std::string config_path;
+    std::string bin_path;     // directory of the t3t tools
+    std::string font_path;    // replaces the font of every job
+    std::string characters;   // replaces the character list of every job (ASCII)
+    std::vector<std::string> yamls; // shared configs after the job YAML (config, printer)
+    std::string compile_path; // STLcompile.yaml the plate settings are taken from
+    std::vector<std::string> jobs;
+    std::string work_path;
+    std::string history_path;
+    std::string baseline_path;
+    bool save_baseline;
+    uint32_t reps;
+    float time_tolerance_pct; // wall time and peak RSS above the baseline by more are regressions
+    float rss_tolerance_pct;
+
+} opts = {.save_baseline = false, .reps = 1, .time_tolerance_pct = 15, .rss_tolerance_pct = 10};
+
+// one tool run
+struct stage_result
+{
+    std::string name;
+    int status;
+    double wall_ms, user_ms, sys_ms;
+    uint64_t peak_rss_kb;
+    uint64_t bytes; // written to the output directory
+};
+
+struct job_result
+{
+    std::string name;
+    int status;
+    double wall_ms;
+    uint64_t peak_rss_kb;
+    uint64_t glyphs, triangles, bytes;
+    std::vector<stage_result> stages;
+    std::vector<std::pair<std::string, double>> mesh_stages; // ms per pbm2stl stage, from its trace
+};
+
+AppLog logger("regress", LOGMASK_NOINFO);
+const std::string version("(v0.1)");
+
+int parse_options(int ac, char *av[]);
+int run_tool(std::string job_dir, std::string tool, std::vector<std::string> args, stage_result &result);
+uint64_t output_bytes(std::string dir);
+int count_meshes(std::string dir, uint64_t &glyphs, uint64_t &triangles, std::vector<std::string> &names);
+int read_trace(std::string filename, std::vector<std::pair<std::string, double>> &mesh_stages);
+int write_compile_yaml(std::string job_dir, std::vector<std::string> &names);
+int run_job(std::string job_yaml, job_result &result);
+std::string json_escape(const std::string &s);
+std::string run_json(std::vector<job_result> &results);
+int compare_baseline(std::vector<job_result> &results);
+
+int main(int ac, char *av[])
+{
+    logger.PRINT() << "t3t_regress " << version << std::endl;
+
+    parse_options(ac, av);
+
+    if (!fs::exists(opts.work_path) && !fs::create_directories(opts.work_path))
+    {
+        logger.ERROR() << "Creating work directory " << opts.work_path << " failed." << endl;
+        exit(1);
+    }
+
+    std::vector<job_result> results;
+    for (std::string &job : opts.jobs)
+    {
+        job_result best;
+        for (uint32_t rep = 0; rep < opts.reps; rep++)
+        {
+            job_result result;
+            run_job(job, result);
+            if ((rep == 0) || (result.status < best.status) ||
+                ((result.status == best.status) && (result.wall_ms < best.wall_ms)))
+                best = result;
+        }
+        results.push_back(best);
+
+        logger.PRINT() << boost::format("%-24s %s %10.1f ms %8.1f MB RSS %5u glyphs %10u triangles %12u bytes")
+                          % best.name % (best.status ? "FAILED" : "ok    ") % best.wall_ms % (best.peak_rss_kb / 1024.0)
+                          % best.glyphs % best.triangles % best.bytes << endl;
+    }
+
+    std::string run = run_json(results);
+
+    std::ofstream history(opts.history_path, std::ios::app);
+    if (history.is_open())
+        history << run << "\n";
+    else
+        logger.ERROR() << "Could not append to history file " << opts.history_path << endl;
+
+    int regressions = 0;
+    if (opts.save_baseline)
+    {
+        std::ofstream baseline(opts.baseline_path);
+        if (baseline.is_open())
+        {
+            baseline << run << "\n";
+            logger.PRINT() << "Baseline saved to " << opts.baseline_path << endl;
+        }
+        else
+            logger.ERROR() << "Could not write baseline file " << opts.baseline_path << endl;
+    }
+    else if (fs::exists(opts.baseline_path))
+        regressions = compare_baseline(results);
+    else
+        logger.PRINT() << "No baseline at " << opts.baseline_path << " (create one with --save-baseline)" << endl;
+
+    bool failed = std::any_of(results.begin(), results.end(), [](job_result &r) { return r.status != 0; });
+    return (failed || (regressions > 0)) ? 1 : 0;
+}
+
+// Run one tool in the job directory with its console output going to
+// <tool>.out there; wall time from the parent, CPU times and peak RSS from
+// the child's rusage.
+int run_tool(std::string job_dir, std::string tool, std::vector<std::string> args, stage_result &result)
+{
+    std::string exe = (fs::path(opts.bin_path) / tool).string();
+    std::string out_file = (fs::path(job_dir) / (tool + ".out")).string();
+
+    std::vector<char *> argv;
+    argv.push_back((char *)exe.c_str());
+    for (std::string &arg : args)
+        argv.push_back((char *)arg.c_str());
+    argv.push_back(NULL);
+
+    result = (stage_result){tool, -1, 0, 0, 0, 0, 0};
+    uint64_t bytes_before = output_bytes((fs::path(job_dir) / "out").string());
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        logger.ERROR() << "fork failed for " << tool << endl;
+        return -1;
+    }
+    if (pid == 0)
+    {
+        int fd = open(out_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if ((fd < 0) || (chdir(job_dir.c_str()) < 0))
+            _exit(127);
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+        execv(exe.c_str(), argv.data());
+        _exit(127);
+    }
+
+    int wstatus;
+    struct rusage usage;
+    if (wait4(pid, &wstatus, 0, &usage) < 0)
+    {
+        logger.ERROR() << "wait4 failed for " << tool << endl;
+        return -1;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    result.status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+    result.wall_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    result.user_ms = usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3;
+    result.sys_ms = usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3;
+    result.peak_rss_kb = usage.ru_maxrss;
+    result.bytes = output_bytes((fs::path(job_dir) / "out").string()) - bytes_before;
+
+    if (result.status != 0)
+    {
+        logger.ERROR() << tool << " exited with status " << result.status << ", see " << out_file << endl;
+        return -1;
+    }
+    return 0;
+}
+
+// bytes in the directory tree, hardlinked files (shared meshes) counted once
+uint64_t output_bytes(std::string dir)
+{
+    std::set<std::pair<dev_t, ino_t>> seen;
+    uint64_t bytes = 0;
+    std::error_code ec;
+
+    if (!fs::exists(dir))
+        return 0;
+
+    for (const fs::directory_entry &entry : fs::recursive_directory_iterator(dir, ec))
+    {
+        struct stat st;
+        if (!entry.is_regular_file() || (stat(entry.path().c_str(), &st) < 0))
+            continue;
+        if (seen.insert(std::make_pair(st.st_dev, st.st_ino)).second)
+            bytes += st.st_size;
+    }
+    return bytes;
+}
+
+// glyph STLs (everything but the compiled plates) and their triangle counts
+// from the binary STL headers
+int count_meshes(std::string dir, uint64_t &glyphs, uint64_t &triangles, std::vector<std::string> &names)
+{
+    glyphs = 0;
+    triangles = 0;
+    names.clear();
+
+    if (!fs::exists(dir))
+        return -1;
+
+    for (const fs::directory_entry &entry : fs::directory_iterator(dir))
+    {
+        std::string stem = entry.path().stem().string();
+        if ((entry.path().extension() != ".stl") || stem.starts_with("compiled"))
+            continue;
+
+        std::ifstream stl(entry.path(), std::ios::binary);
+        uint32_t count = 0;
+        stl.seekg(80);
+        stl.read((char *)&count, sizeof(count));
+        if (!stl)
+        {
+            logger.WARNING() << "Could not read triangle count of " << entry.path().string() << endl;
+            continue;
+        }
+
+        glyphs++;
+        triangles += count;
+        if (stem.find(' ') == std::string::npos)
+            names.push_back(stem);
+    }
+    std::sort(names.begin(), names.end());
+    return 0;
+}
+
+// per stage totals of a pbm2stl Chrome trace (JSON is read as YAML)
+int read_trace(std::string filename, std::vector<std::pair<std::string, double>> &mesh_stages)
+{
+    mesh_stages.clear();
+
+    try
+    {
+        YAML::Node events = YAML::LoadFile(filename)["traceEvents"];
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            if ((events[i]["ph"].as<std::string>() != "X") || (events[i]["cat"].as<std::string>() != "stage"))
+                continue;
+
+            std::string name = events[i]["name"].as<std::string>();
+            double ms = events[i]["dur"].as<double>() / 1e3;
+            auto stage = std::find_if(mesh_stages.begin(), mesh_stages.end(),
+                                      [&](std::pair<std::string, double> &s) { return s.first == name; });
+            if (stage == mesh_stages.end())
+                mesh_stages.push_back(std::make_pair(name, ms));
+            else
+                stage->second += ms;
+        }
+    }
+    catch (exception &e)
+    {
+        logger.WARNING() << "Could not read trace " << filename << ": " << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
+
+// STLcompiler reads STLcompile.yaml from its working directory: the plate
+// settings of the shared one, with all glyphs of the job as one (wrapped) row
+int write_compile_yaml(std::string job_dir, std::vector<std::string> &names)
+{
+    YAML::Node config;
+    try
+    {
+        config = YAML::LoadFile(opts.compile_path);
+    }
+    catch (exception &e)
+    {
+        logger.ERROR() << "Could not read " << opts.compile_path << ": " << e.what() << endl;
+        return -1;
+    }
+
+    std::string row;
+    for (std::string &name : names)
+        row += (row.empty() ? "" : " ") + name;
+
+    config["working directory"] = YAML::Node();
+    config["working directory"]["path"] = "./out/";
+    config["structure"] = YAML::Node(YAML::NodeType::Sequence);
+    config["structure"].push_back(row);
+
+    std::ofstream out((fs::path(job_dir) / "STLcompile.yaml").string());
+    out << config << "\n";
+    return out.good() ? 0 : -1;
+}
+
+// ttf -> pbm -> stl -> compiled plate for one job config, with the bundled
+// font and character list put in front so they win over the job's own
+int run_job(std::string job_yaml, job_result &result)
+{
+    std::string name = fs::path(job_yaml).stem().string();
+    std::string job_dir = (fs::absolute(opts.work_path) / name).string();
+
+    result = (job_result){name, -1, 0, 0, 0, 0, 0};
+
+    std::error_code ec;
+    fs::remove_all(job_dir, ec);
+    if (!fs::create_directories(job_dir))
+    {
+        logger.ERROR() << "Creating job directory " << job_dir << " failed." << endl;
+        return -1;
+    }
+
+    std::ofstream override_yaml((fs::path(job_dir) / "regress_override.yaml").string());
+    override_yaml << "font file: " << fs::absolute(opts.font_path).string() << "\n"
+                  << "working directory:\n  path: ./out/\n  create: true\n";
+    if (!opts.characters.empty())
+        override_yaml << "characters:\n  ASCII: \"" << opts.characters << "\"\n";
+    override_yaml.close();
+
+    std::vector<std::string> yamls = {"regress_override.yaml", fs::absolute(job_yaml).string()};
+    for (std::string &y : opts.yamls)
+        yamls.push_back(fs::absolute(y).string());
+
+    std::vector<std::string> mesh_args = yamls;
+    mesh_args.push_back("--trace");
+    mesh_args.push_back("pbm2stl_trace.json");
+
+    stage_result stage;
+    int status = run_tool(job_dir, "t3t_ttf2pbm", yamls, stage);
+    result.stages.push_back(stage);
+
+    if (status == 0)
+    {
+        status = run_tool(job_dir, "t3t_pbm2stl", mesh_args, stage);
+        result.stages.push_back(stage);
+        read_trace((fs::path(job_dir) / "pbm2stl_trace.json").string(), result.mesh_stages);
+    }
+
+    std::vector<std::string> names;
+    count_meshes((fs::path(job_dir) / "out").string(), result.glyphs, result.triangles, names);
+
+    if ((status == 0) && !names.empty())
+    {
+        status = write_compile_yaml(job_dir, names);
+        if (status == 0)
+        {
+            status = run_tool(job_dir, "t3t_STLcompiler", {}, stage);
+            result.stages.push_back(stage);
+        }
+    }
+    else if (status == 0)
+    {
+        logger.ERROR() << name << ": no meshes generated." << endl;
+        status = -1;
+    }
+
+    for (stage_result &s : result.stages)
+    {
+        result.wall_ms += s.wall_ms;
+        result.peak_rss_kb = std::max(result.peak_rss_kb, s.peak_rss_kb);
+        result.bytes += s.bytes;
+    }
+    result.status = (status == 0) ? 0 : 1;
+    return status;
+}
+
+std::string json_escape(const std::string &s)
+{
+    std::string escaped;
+
+    for (char c : s)
+    {
+        if ((c == '"') || (c == '\\'))
+            escaped += '\\';
+        if ((unsigned char)c < 0x20)
+            escaped += (boost::format("\\u%04x") % int(c)).str();
+        else
+            escaped += c;
+    }
+    return escaped;
+}
+
+// one run as a single JSON line
+std::string run_json(std::vector<job_result> &results)
+{
+    char stamp[32];
+    time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    std::string commit;
+    FILE *git = popen("git rev-parse --short HEAD 2>/dev/null", "r");
+    if (git)
+    {
+        char buf[64];
+        if (fgets(buf, sizeof(buf), git))
+            commit = buf;
+        pclose(git);
+        commit.erase(std::remove(commit.begin(), commit.end(), '\n'), commit.end());
+    }
+
+    std::string json = (boost::format("{\"time\":\"%s\",\"commit\":\"%s\",\"font\":\"%s\",\"characters\":\"%s\",\"jobs\":[")
+                        % stamp % json_escape(commit) % json_escape(fs::path(opts.font_path).filename().string())
+                        % json_escape(opts.characters)).str();
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        job_result &r = results[i];
+        json += (boost::format("%s{\"name\":\"%s\",\"status\":%d,\"wall_ms\":%.3f,\"peak_rss_kb\":%u,"
+                               "\"glyphs\":%u,\"triangles\":%u,\"bytes\":%u,\"stages\":[")
+                 % (i ? "," : "") % json_escape(r.name) % r.status % r.wall_ms % r.peak_rss_kb
+                 % r.glyphs % r.triangles % r.bytes).str();
+
+        for (size_t j = 0; j < r.stages.size(); j++)
+        {
+            stage_result &s = r.stages[j];
+            json += (boost::format("%s{\"name\":\"%s\",\"status\":%d,\"wall_ms\":%.3f,\"user_ms\":%.3f,\"sys_ms\":%.3f,"
+                                   "\"peak_rss_kb\":%u,\"bytes\":%u}")
+                     % (j ? "," : "") % s.name % s.status % s.wall_ms % s.user_ms % s.sys_ms % s.peak_rss_kb % s.bytes).str();
+        }
+
+        json += "],\"mesh_stages\":{";
+        for (size_t j = 0; j < r.mesh_stages.size(); j++)
+            json += (boost::format("%s\"%s\":%.3f") % (j ? "," : "") % json_escape(r.mesh_stages[j].first)
+                     % r.mesh_stages[j].second).str();
+        json += "}}";
+    }
+    json += "]}";
+
+    return json;
+}
+
+// Jobs slower or bigger than the baseline beyond the tolerances, or with
+// more triangles or output bytes, are regressions; fewer triangles or bytes
+// are reported as changes. Returns the number of regressions.
+int compare_baseline(std::vector<job_result> &results)
+{
+    YAML::Node baseline;
+    try
+    {
+        baseline = YAML::LoadFile(opts.baseline_path);
+    }
+    catch (exception &e)
+    {
+        logger.ERROR() << "Could not read baseline " << opts.baseline_path << ": " << e.what() << endl;
+        return 1;
+    }
+
+    logger.PRINT() << "\nAgainst baseline " << opts.baseline_path << " (" << baseline["time"].as<std::string>("?")
+                   << ", " << baseline["commit"].as<std::string>("?") << ")" << endl;
+    logger.PRINT() << boost::format("%-24s %10s %8s %8s %8s %10s %12s  %s")
+                      % "job" % "wall ms" % "wall %" % "RSS MB" % "RSS %" % "triangles" % "bytes" % "verdict" << endl;
+
+    int regressions = 0;
+    for (job_result &r : results)
+    {
+        YAML::Node base;
+        for (size_t i = 0; i < baseline["jobs"].size(); i++)
+            if (baseline["jobs"][i]["name"].as<std::string>() == r.name)
+                base = baseline["jobs"][i];
+
+        if (!base)
+        {
+            logger.PRINT() << boost::format("%-24s %10.1f %8s %8.1f %8s %10u %12u  %s")
+                              % r.name % r.wall_ms % "" % (r.peak_rss_kb / 1024.0) % "" % r.triangles % r.bytes
+                              % "not in baseline" << endl;
+            continue;
+        }
+
+        double base_wall = base["wall_ms"].as<double>();
+        double base_rss = base["peak_rss_kb"].as<double>();
+        int64_t d_triangles = (int64_t)r.triangles - base["triangles"].as<int64_t>();
+        int64_t d_bytes = (int64_t)r.bytes - base["bytes"].as<int64_t>();
+        double wall_pct = base_wall > 0 ? 100.0 * (r.wall_ms - base_wall) / base_wall : 0;
+        double rss_pct = base_rss > 0 ? 100.0 * (r.peak_rss_kb - base_rss) / base_rss : 0;
+
+        std::vector<std::string> flags;
+        bool regressed = false;
+        if (r.status != 0)
+        {
+            flags.push_back("FAILED");
+            regressed = true;
+        }
+        if (wall_pct > opts.time_tolerance_pct)
+        {
+            flags.push_back("SLOWER");
+            regressed = true;
+        }
+        if (rss_pct > opts.rss_tolerance_pct)
+        {
+            flags.push_back("MORE MEMORY");
+            regressed = true;
+        }
+        if (d_triangles != 0)
+        {
+            flags.push_back((boost::format("triangles %+d") % d_triangles).str());
+            regressed = regressed || (d_triangles > 0);
+        }
+        if (d_bytes != 0)
+        {
+            flags.push_back((boost::format("bytes %+d") % d_bytes).str());
+            regressed = regressed || (d_bytes > 0);
+        }
+
+        std::string verdict = regressed ? "REGRESSION:" : (flags.empty() ? "ok" : "changed:");
+        for (std::string &f : flags)
+            verdict += " " + f;
+        if (regressed)
+            regressions++;
+
+        logger.PRINT() << boost::format("%-24s %10.1f %+7.1f%% %8.1f %+7.1f%% %10u %12u  %s")
+                          % r.name % r.wall_ms % wall_pct % (r.peak_rss_kb / 1024.0) % rss_pct
+                          % r.triangles % r.bytes % verdict << endl;
+    }
+
+    if (regressions)
+        logger.WARNING() << regressions << " job(s) regressed against the baseline." << endl;
+    return regressions;
+}
+
+int parse_options(int ac, char *av[])
+{
+    std::string jobs_arg;
+    std::vector<std::string> config_paths;
+
+    try
+    {
+        bpo::options_description desc("t3t_regress: Command-line options and arguments");
+        desc.add_options()("help", "produce this help message")("jobs,j", bpo::value<std::string>(&jobs_arg), "job YAMLs to run, comma separated (overrides the config's list)")("bin", bpo::value<std::string>(&opts.bin_path), "directory of the t3t tools (default: next to t3t_regress)")("reps,r", bpo::value<uint32_t>(&opts.reps), "runs per job, the fastest is recorded (default 1)")("save-baseline", bpo::bool_switch(&opts.save_baseline), "store this run as the baseline instead of comparing")("yaml,y", bpo::value<vector<string>>(&config_paths), "regression config YAML (default regress.yaml)");
+        bpo::variables_map vm;
+
+        bpo::positional_options_description posopt;
+        posopt.add("yaml", -1);
+        bpo::store(bpo::command_line_parser(ac, av).options(desc).positional(posopt).run(), vm);
+        bpo::notify(vm);
+
+        if (vm.count("help"))
+        {
+            logger.PRINT() << desc << "\n";
+            exit(0);
+        }
+    }
+    catch (exception &e)
+    {
+        logger.ERROR() << e.what() << "\n";
+        exit(1);
+    }
+
+    opts.config_path = config_paths.empty() ? "regress.yaml" : config_paths[0];
+    if (!opts.config_path.ends_with(".yaml"))
+        opts.config_path.append(".yaml");
+
+    if (opts.bin_path.empty())
+        opts.bin_path = fs::read_symlink("/proc/self/exe").parent_path().string();
+
+    try
+    {
+        YAML::Node config = YAML::LoadFile(opts.config_path);
+
+        if (config["font file"])
+            opts.font_path = config["font file"].as<std::string>();
+        if (config["characters"])
+            opts.characters = config["characters"].as<std::string>();
+        if (config["shared configs"])
+            for (size_t i = 0; i < config["shared configs"].size(); i++)
+                opts.yamls.push_back(config["shared configs"][i].as<std::string>());
+        opts.compile_path = config["compile config"] ? config["compile config"].as<std::string>() : "STLcompile.yaml";
+        if (config["jobs"])
+            for (size_t i = 0; i < config["jobs"].size(); i++)
+                opts.jobs.push_back(config["jobs"][i].as<std::string>());
+
+        opts.work_path = config["work path"] ? config["work path"].as<std::string>() : "./regress/";
+        opts.history_path = config["history"] ? config["history"].as<std::string>()
+                                              : (fs::path(opts.work_path) / "history.json").string();
+        opts.baseline_path = config["baseline"] ? config["baseline"].as<std::string>()
+                                                : (fs::path(opts.work_path) / "baseline.json").string();
+        if (config["time tolerance pct"])
+            opts.time_tolerance_pct = config["time tolerance pct"].as<float>();
+        if (config["memory tolerance pct"])
+            opts.rss_tolerance_pct = config["memory tolerance pct"].as<float>();
+
+        if (config["log level"])
+        {
+            YAML::Node levels = config["log level"];
+            if (logger.set_levels(levels["console"] ? levels["console"].as<std::string>() : "",
+                                  levels["file"] ? levels["file"].as<std::string>() : "") < 0)
+                logger.WARNING() << "log level must be debug, info, warning or error." << endl;
+        }
+    }
+    catch (exception &e)
+    {
+        logger.ERROR() << "Could not read " << opts.config_path << ": " << e.what() << endl;
+        exit(1);
+    }
+
+    if (!jobs_arg.empty())
+    {
+        opts.jobs.clear();
+        std::string item;
+        std::stringstream jobs(jobs_arg);
+        while (getline(jobs, item, ','))
+            if (!item.empty())
+                opts.jobs.push_back(item.ends_with(".yaml") ? item : item + ".yaml");
+    }
+
+    if (opts.font_path.empty() || !fs::exists(opts.font_path))
+    {
+        logger.ERROR() << "Font file " << opts.font_path << " not found." << endl;
+        exit(1);
+    }
+    if (opts.jobs.empty())
+    {
+        logger.ERROR() << "No jobs to run." << endl;
+        exit(1);
+    }
+    if (opts.reps < 1)
+        opts.reps = 1;
+
+    return 0;
+}
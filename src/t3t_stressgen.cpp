@@ -0,0 +1,198 @@
+#include "TypeBitmap.h"
+#include "StressBitmap.h"
+#include "MeshCheck.h"
+#include "AppLog.h"
+#include <iostream>
+#include <filesystem>
+#include <random>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+#include <sstream>
+
+using namespace std;
+namespace fs = std::filesystem;
+namespace bpo = boost::program_options;
+
+struct
+{
+    std::vector<std::string> families;
+    uint32_t width, height;
+    uint32_t cell;  // 0: height / 40
+    float density;
+    uint32_t seed;
+    std::string out_path;
+
+    uint32_t fuzz;        // random bitmaps to mesh and check, 0: generate only
+    uint32_t fuzz_min_px; // fuzz bitmap sides, the smallest sort bodies have about 150 px
+    uint32_t fuzz_max_px;
+
+    dim_t type_height;
+    dim_t depth_of_drive;
+    dim_t raster_size;
+    dim_t layer_height;
+
+} opts = {.width = 600, .height = 1000, .cell = 0, .density = 0.5, .seed = 1, .fuzz = 0, .fuzz_min_px = 128, .fuzz_max_px = 192};
+
+AppLog logger("stressgen", LOGMASK_NOINFO);
+const std::string version("(v0.1)");
+
+int parse_options(int ac, char *av[]);
+int generate();
+int fuzz();
+
+int main(int ac, char *av[])
+{
+    logger.PRINT() << "t3t_stressgen " << version << std::endl;
+
+    parse_options(ac, av);
+
+    if (!fs::exists(opts.out_path) && !fs::create_directories(opts.out_path))
+    {
+        logger.ERROR() << "Creating output directory " << opts.out_path << " failed." << endl;
+        exit(1);
+    }
+
+    if (opts.fuzz)
+        return fuzz();
+    return generate();
+}
+
+// one P4 file per family: <family>_<width>x<height>.pbm
+int generate()
+{
+    TypeBitmap TBM;
+
+    for (std::string &family : opts.families)
+    {
+        stress_params params = {family, opts.width, opts.height, opts.cell, opts.density, opts.seed};
+        std::string path = (boost::format("%s/%s_%ux%u.pbm") % opts.out_path % family % opts.width % opts.height).str();
+
+        if ((make_stress_bitmap(TBM, params) < 0) || (TBM.store(path, true) < 0))
+            return 1;
+        logger.PRINT() << "Wrote " << path << endl;
+    }
+    return 0;
+}
+
+// Random family, size, cell and foot mode per round; the mesh has to pass
+// validate_mesh() and reproduce the bitmap and the analytic sections in
+// raster_check(). Failing bitmaps are kept as fuzz_<round>.pbm.
+int fuzz()
+{
+    std::mt19937 rng(opts.seed);
+    uint32_t failed = 0;
+    const char *mode_names[] = {"no_foot", "bevel", "step", "supports", "pyramids"};
+    reduced_foot_mode modes[] = {no_foot, bevel, step, supports, pyramids};
+    std::vector<nick> nicks;
+
+    for (uint32_t round = 0; round < opts.fuzz; round++)
+    {
+        stress_params params;
+        params.family = opts.families[rng() % opts.families.size()];
+        params.width = opts.fuzz_min_px + rng() % (opts.fuzz_max_px - opts.fuzz_min_px + 1);
+        params.height = opts.fuzz_min_px + rng() % (opts.fuzz_max_px - opts.fuzz_min_px + 1);
+        params.cell = 1 + rng() % std::max(1u, std::max(params.width, params.height) / 8);
+        params.density = (rng() % 101) / 100.0f;
+        params.seed = rng();
+
+        reduced_foot foot;
+        int m = rng() % 5;
+        foot.mode = modes[m];
+        foot.XY = dim_t(0.6, mm);
+        foot.Z = dim_t(4.0, mm);
+        foot.pyramid_pitch = dim_t(1.7, mm);
+        foot.pyramid_top_length = dim_t(0.25, mm);
+        foot.pyramid_top_column_height = dim_t(0.5, mm);
+        foot.pyramid_foot_height = dim_t(3.0, mm);
+        foot.pyramid_height_factor = 1.0;
+
+        TypeBitmap TBM;
+        TBM.set_type_parameters(opts.type_height, opts.depth_of_drive, opts.raster_size, opts.layer_height);
+
+        mesh_validation check;
+        raster_validation raster;
+        std::string problem;
+
+        if (make_stress_bitmap(TBM, params) < 0)
+            return 1;
+        if (TBM.generateMesh(foot, nicks, 1.0, 1.0) < 0)
+            problem = "meshing failed";
+        else if (validate_mesh(TBM, foot, nicks, 1.0, 1.0, 0.5, check) < 0)
+            problem = "mesh check failed to run";
+        else if (!check.watertight || !check.volume_ok)
+            problem = describe_validation(check);
+        else if (raster_check(TBM, foot, nicks, 1.0, 1.0, 1, raster) < 0)
+            problem = "raster check failed to run";
+        else if (raster.mismatched)
+            problem = describe_raster(raster);
+
+        std::string name = (boost::format("%-9s %3ux%-3u cell %-3u %-8s")
+                            % params.family % params.width % params.height % params.cell % mode_names[m]).str();
+        if (problem.empty())
+        {
+            LOG_INFO(logger) << "round " << round << ": " << name << " ok" << endl;
+            continue;
+        }
+
+        failed++;
+        std::string path = (boost::format("%s/fuzz_%u.pbm") % opts.out_path % round).str();
+        TBM.store(path, true);
+        logger.WARNING() << "round " << round << ": " << name << " " << problem << " (" << path << ")" << endl;
+    }
+
+    logger.PRINT() << boost::format("%u of %u rounds failed") % failed % opts.fuzz << endl;
+    return failed ? 1 : 0;
+}
+
+int parse_options(int ac, char *av[])
+{
+    std::string families_arg;
+    std::string size_arg;
+
+    opts.out_path = "./";
+    opts.type_height = dim_t(0.918, inch);
+    opts.depth_of_drive = dim_t(2.0, mm);
+    opts.raster_size = dim_t(0.0285, mm);
+    opts.layer_height = dim_t(0.05, mm);
+
+    try
+    {
+        bpo::options_description desc("t3t_stressgen: Command-line options and arguments");
+        desc.add_options()("help", "produce this help message")("families,f", bpo::value<std::string>(&families_arg), "solid, empty, checker, noise, diagonals, text, logo, blobs, comma separated (default all)")("size,s", bpo::value<std::string>(&size_arg), "bitmap size in pixels, WIDTHxHEIGHT (default 600x1000)")("cell,c", bpo::value<uint32_t>(&opts.cell), "structure size in pixels: checker/noise cell, line pitch, x-height, ring width (default 1/40 of the height)")("density,d", bpo::value<float>(&opts.density), "share of inked noise cells (default 0.5)")("seed", bpo::value<uint32_t>(&opts.seed), "noise and text seed, fuzz start seed (default 1)")("out,o", bpo::value<std::string>(&opts.out_path), "output directory (default ./)")("fuzz", bpo::value<uint32_t>(&opts.fuzz), "mesh and check this many random bitmaps instead, keep failing ones")("fuzz-min", bpo::value<uint32_t>(&opts.fuzz_min_px), "smallest fuzz bitmap side in pixels (default 128)")("fuzz-max", bpo::value<uint32_t>(&opts.fuzz_max_px), "largest fuzz bitmap side in pixels (default 192)");
+        bpo::variables_map vm;
+        bpo::store(bpo::command_line_parser(ac, av).options(desc).run(), vm);
+        bpo::notify(vm);
+
+        if (vm.count("help"))
+        {
+            logger.PRINT() << desc << "\n";
+            exit(0);
+        }
+    }
+    catch (exception &e)
+    {
+        logger.ERROR() << e.what() << "\n";
+        exit(1);
+    }
+
+    if (!size_arg.empty() && (sscanf(size_arg.c_str(), "%ux%u", &opts.width, &opts.height) != 2))
+    {
+        logger.ERROR() << "Size must be WIDTHxHEIGHT, not " << size_arg << endl;
+        exit(1);
+    }
+    if ((opts.width == 0) || (opts.height == 0) || (opts.fuzz_min_px == 0) || (opts.fuzz_max_px < opts.fuzz_min_px))
+    {
+        logger.ERROR() << "Bitmap sizes must be at least 1 pixel, fuzz-max not below fuzz-min." << endl;
+        exit(1);
+    }
+
+    std::string item;
+    std::stringstream families(families_arg);
+    while (getline(families, item, ','))
+        if (!item.empty())
+            opts.families.push_back(item);
+    if (opts.families.empty())
+        opts.families.assign(stress_families, stress_families + stress_family_count);
+
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include "yaml.h"
 #include "PGMbitmap.h"
+#include "AppStats.h"
 #include <iostream>
 #include <fstream>
 #include <filesystem>
@@ -19,7 +20,9 @@ struct {
 
     std::vector<std::string> lines;
 
-} opts = { .create_work_path = false };
+    bool stats; // print per-stage timing and memory table at the end
+
+} opts = { .create_work_path = false, .stats = false };
 
 std::string make_ASCII_Unicode_string(uint32_t);
 int parse_options(int ac, char* av[]);
@@ -30,6 +33,9 @@ int main(int ac, char* av[])
 {
     parse_options(ac, av);
 
+    if (opts.stats)
+        appstats.enable();
+
     if (!opts.work_path.empty()) {
         if (!fs::exists(opts.work_path)) {
             if (opts.create_work_path) {
@@ -71,6 +77,8 @@ int main(int ac, char* av[])
     uint32_t overall_w = 0;
     uint32_t overall_h = 0;
 
+    ScopedTimer stage("measure lines");
+
     for(int i=0; i<text.size(); i++) {
         line_w = 0;
         line_h = 0;
@@ -88,6 +96,7 @@ int main(int ac, char* av[])
         overall_h += line_h;
     }
 
+    stage.next("compose");
     PGMbitmap InPBM;
     PGMbitmap OutPGM(overall_w, overall_h, 255);
 
@@ -121,7 +130,12 @@ int main(int ac, char* av[])
         overall_h += line_h;
     }
 
+    stage.next("store PGM");
     OutPGM.storePGM(opts.work_path + opts.pgm_path);
+    stage.next(NULL);
+
+    if (opts.stats)
+        appstats.write_table(cout);
 
     return 0;
 }
@@ -164,6 +178,7 @@ int parse_options(int ac, char* av[])
             ("help", "produce this help message")
             ("pgm,p", bpo::value<std::string>(&opts.pgm_path), "specify output PGM path")
             ("workdir,w", bpo::value<std::string>(&opts.work_path), "working directory (overrides YAML)")            
+            ("stats", bpo::bool_switch(&opts.stats), "print a per-stage timing and memory table")
             ("yaml,y", bpo::value< vector<string> >(&yaml_paths), "specify YAML configuration file(s)")
         ;
 
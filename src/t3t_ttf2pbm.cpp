@@ -1,6 +1,7 @@
 #include "yaml.h"
 #include "TypeBitmap.h"
 #include "AppLog.h"
+#include "MeshPlan.h"
 #include <iostream>
 #include <fstream>
 #include <filesystem>
@@ -43,7 +44,12 @@ extern "C" {
 
         float XYshrink_pct;
 
-    } opts = { .create_work_path = false, .XYshrink_pct = 0 };
+        bool plan; // estimate the meshes instead of writing bitmaps
+        std::vector<std::string> formats; // output formats of t3t_pbm2stl, for the estimate
+        bool mesh_duplicates;
+        float edge_px; // t3t_pbm2stl compensates the bitmaps before meshing, for the estimate
+
+    } opts = { .create_work_path = false, .XYshrink_pct = 0, .plan = false, .mesh_duplicates = false, .edge_px = 0 };
 
 
     std::string make_ASCII_Unicode_string(uint32_t unicode);
@@ -165,7 +171,8 @@ int main(int ac, char* av[])
 
     slot = face->glyph;
 
-
+    std::vector<mesh_plan> plans;
+    std::vector<packed_bitmap> bitmaps; // of the plans, to tell identical bitmaps from hash collisions
 
     for(int i=0; i<opts.characters.size(); i++) {
 
@@ -202,11 +209,39 @@ int main(int ac, char* av[])
 
         TBM.threshold(BW_THRESHOLD);
         TBM.mirror();
+
+        if (opts.plan) {
+            mesh_plan plan;
+            std::string name = make_ASCII_Unicode_string(current_char).substr(1);
+            if ((opts.edge_px != 0) && (TBM.compensate_edges(opts.edge_px) < 0)) {
+                plan = mesh_plan();
+                plan.name = name;
+                plan.valid = false;
+                plan.duplicate_of = -1;
+            }
+            else
+                plan_mesh(TBM, name, opts.formats, plan);
+            plans.push_back(plan);
+            bitmaps.push_back(packed_bitmap());
+            if (plan.valid)
+                TBM.pack(bitmaps.back());
+            continue;
+        }
+
         std::string output_path = 
                     opts.work_path + make_ASCII_Unicode_string(current_char) + ".pbm";
         TBM.store(output_path);
     }
 
+    if (opts.plan) {
+        if (!opts.mesh_duplicates)
+            mark_duplicates(plans, bitmaps);
+        std::stringstream table;
+        write_plan(table, plans);
+        logger.PRINT() << table.str();
+        logger.PRINT().flush();
+    }
+
     FT_Done_Face(face);
 
     FT_Done_FreeType(library);
@@ -252,6 +287,7 @@ int parse_options(int ac, char* av[])
         desc.add_options()
             ("help", "produce this help message")
             ("pbm,p", bpo::value<std::string>(&opts.pbm_path), "specify output PBM path")
+            ("plan", bpo::bool_switch(&opts.plan), "estimate triangles, memory, output size and meshing time, write no bitmaps")
             //("font,f", bpo::value<std::string>(&opts.font_path), "specify input font path")
             ("yaml,y", bpo::value< vector<string> >(&yaml_paths), "specify YAML configuration file(s)")
         ;
@@ -303,6 +339,14 @@ int parse_options(int ac, char* av[])
             opts.font_path = config["font file"].as<std::string>();
         }
 
+        // log levels (debug, info, warning, error) for console and log file
+        if (config["log level"]) {
+            YAML::Node levels = config["log level"];
+            if (logger.set_levels(levels["console"] ? levels["console"].as<std::string>() : "",
+                                  levels["file"] ? levels["file"].as<std::string>() : "") < 0)
+                logger.WARNING() << "log level must be debug, info, warning or error." << endl;
+        }
+
         if (config["working directory"]) {
             if (config["working directory"]["path"])
                 opts.work_path = config["working directory"]["path"].as<std::string>();
@@ -339,6 +383,25 @@ int parse_options(int ac, char* av[])
             opts.XYshrink_pct = config["XYshrink_pct"].as<float>();
         }
 
+        // what t3t_pbm2stl will write, for --plan
+        if (config["output formats"]) {
+            for(int i=0; i<config["output formats"].size(); i++)
+                opts.formats.push_back(config["output formats"][i].as<std::string>());
+        }
+        else {
+            opts.formats = {"stl", "obj"};
+        }
+        if (config["duplicate meshes"]) {
+            opts.mesh_duplicates = (config["duplicate meshes"].as<std::string>() == "mesh");
+        }
+        if (config["edge compensation px"]) {
+            opts.edge_px = config["edge compensation px"].as<float>();
+            if ((opts.edge_px != 0) && (fabsf(opts.edge_px) < 1.0f)) {
+                logger.ERROR() << "edge compensation px must be 0 or at least 1 pixel either way, not " << opts.edge_px << std::endl;
+                exit(1);
+            }
+        }
+
     }
     catch(exception& e) {
         logger.ERROR() << e.what() << "\n";
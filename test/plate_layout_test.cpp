@@ -0,0 +1,104 @@
+#include "PlateAssembler.h"
+#include "AppLog.h"
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+// Row layout with mixed line heights: every plate must stay within the
+// platform, lines stacked top to bottom without overlapping.
+
+AppLog logger("plate_layout_test", LOGMASK_NOINFO);
+
+static int failures = 0;
+
+// closed box of w x h x d mm at the origin
+static void make_box(float w, float h, float d, std::vector<pos3d_t> &vertices, std::vector<idx_tri_t> &triangles)
+{
+    vertices.clear();
+    for (int i=0; i<8; i++)
+        vertices.push_back((pos3d_t){(i & 1) ? w : 0, (i & 2) ? h : 0, (i & 4) ? d : 0});
+
+    const uint32_t faces[12][3] = {
+        {0, 2, 1}, {1, 2, 3}, {4, 5, 6}, {5, 7, 6}, // bottom, top
+        {0, 1, 4}, {1, 5, 4}, {2, 6, 3}, {3, 6, 7}, // front, back
+        {0, 4, 2}, {2, 4, 6}, {1, 3, 5}, {3, 7, 5}  // left, right
+    };
+    triangles.clear();
+    for (int i=0; i<12; i++)
+        triangles.push_back((idx_tri_t){faces[i][0], faces[i][1], faces[i][2]});
+}
+
+static void check(bool ok, const char *what)
+{
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Y extent of a plate's welded mesh
+static int plate_span(PlateAssembler &P, uint32_t plate, float &lowY, float &highY)
+{
+    std::vector<pos3d_t> vertices;
+    std::vector<idx_tri_t> triangles;
+
+    if ((P.get_plate_mesh(plate, vertices, triangles) < 0) || vertices.empty())
+        return -1;
+
+    lowY = highY = vertices[0].y;
+    for (pos3d_t &v : vertices) {
+        lowY = std::min(lowY, v.y);
+        highY = std::max(highY, v.y);
+    }
+    return 0;
+}
+
+// one sort per row, heights in mm; expects the given plate count and, per
+// plate, the sum of its line heights and gaps as Y extent from 0 downwards
+static void run_case(const char *name, float platform, float gap, std::vector<float> heights,
+                     uint32_t expect_plates, std::vector<float> expect_spans)
+{
+    PlateAssembler P;
+    P.set_platform(platform, platform, gap, gap);
+    P.set_layout(false, false);
+
+    std::vector<pos3d_t> vertices;
+    std::vector<idx_tri_t> triangles;
+    for (size_t i=0; i<heights.size(); i++) {
+        make_box(5, heights[i], 3, vertices, triangles);
+        int id = P.add_mesh(std::string(name) + "_" + std::to_string(i), vertices, triangles);
+        P.add_row(std::vector<int>(1, id));
+    }
+
+    char what[256];
+    int plates = P.layout();
+    snprintf(what, sizeof(what), "%s: %d plates, expected %u", name, plates, expect_plates);
+    check((plates == (int)expect_plates) && (P.skipped_count() == 0), what);
+
+    for (uint32_t p=0; (p < P.plate_count()) && (p < expect_spans.size()); p++) {
+        float lowY, highY;
+        snprintf(what, sizeof(what), "%s: plate %u mesh", name, p);
+        check(plate_span(P, p, lowY, highY) == 0, what);
+
+        snprintf(what, sizeof(what), "%s: plate %u spans Y %g..%g, expected %g..0", name, p, lowY, highY, -expect_spans[p]);
+        check((fabsf(highY) < 1e-4f) && (fabsf(lowY + expect_spans[p]) < 1e-4f), what);
+
+        snprintf(what, sizeof(what), "%s: plate %u taller than the platform", name, p);
+        check(highY - lowY <= platform + 1e-4f, what);
+    }
+}
+
+int main()
+{
+    // a short line above a tall one
+    run_case("short_tall", 100, 1, {2, 10}, 1, {13});
+    // 60 + 1 + 30 fits, 60 + 1 + 45 does not
+    run_case("fit", 100, 1, {60, 30}, 1, {91});
+    run_case("spill", 100, 1, {60, 45}, 2, {60, 45});
+    // mixed heights, the fourth line starts plate 2
+    run_case("mixed", 50, 2, {5, 20, 8, 30, 4}, 2, {37, 36});
+
+    if (failures)
+        printf("%d check(s) failed\n", failures);
+    return failures ? 1 : 0;
+}